@@ -0,0 +1,351 @@
+/*
+ * Host test and benchmark for the diag HDLC encoder and decoder.
+ *
+ * Runs drivers/char/diag/diagchar_hdlc.c side by side with the byte at
+ * a time reference in hdlc_ref.c.  Both get identical arguments, and
+ * after every call their state and output must be identical.  Every
+ * packet is also decoded again and checked against the input, the CRC
+ * and the terminating flag.  The cases cover:
+ *
+ *  - packets that wrap over many small destination buffers, including
+ *    sizes where an escaped data or CRC byte falls on the last byte;
+ *  - packets encoded as two fragments;
+ *  - encoded streams decoded in source chunks that end right after an
+ *    escape character, and into small destination buffers;
+ *  - source buffers starting at every alignment;
+ *  - data without special bytes up to data that is nothing but.
+ *
+ * Build and run from this directory:
+ *
+ *   gcc -O2 -Wall -Ishim -I../../../../drivers/char/diag -o hdlc_test \
+ *	hdlc_test.c hdlc_ref.c ../../../../drivers/char/diag/diagchar_hdlc.c \
+ *	../../../../lib/crc-ccitt.c
+ *   ./hdlc_test [random cases] [seed]
+ *
+ * Exits nonzero at the first mismatch, otherwise prints the throughput
+ * of both versions.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <linux/types.h>
+#include <linux/crc-ccitt.h>
+#include "diagchar_hdlc.h"
+
+void ref_hdlc_encode(struct diag_send_desc_type *src_desc,
+		     struct diag_hdlc_dest_type *enc);
+int ref_hdlc_decode(struct diag_hdlc_decode_type *hdlc);
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+#define MAX_PKT		4096
+/* every byte escaped, two escaped CRC bytes and the flag */
+#define MAX_ENC		(2 * MAX_PKT + 5)
+
+static uint32_t seed = 1;
+static unsigned long cases;
+
+static uint32_t rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+static void fail(const char *what)
+{
+	fprintf(stderr, "hdlc_test: %s (case %lu)\n", what, cases);
+	exit(1);
+}
+
+/* About one byte in @special is ESC_CHAR or CONTROL_CHAR, none if 0 */
+static void fill(uint8_t *p, unsigned len, unsigned special)
+{
+	unsigned i;
+	uint8_t b;
+
+	for (i = 0; i < len; i++) {
+		if (special && rnd() % special == 0) {
+			p[i] = (rnd() & 1) ? ESC_CHAR : CONTROL_CHAR;
+			continue;
+		}
+		do
+			b = rnd();
+		while (b == ESC_CHAR || b == CONTROL_CHAR);
+		p[i] = b;
+	}
+}
+
+/*
+ * Encode pkt[0..len) into out, as two fragments if 0 < split < len.
+ * Each call gets a fresh destination of @chunk bytes, random sizes if
+ * @chunk is 0.  Returns the encoded length.
+ */
+static unsigned check_encode(const uint8_t *pkt, unsigned len,
+			     unsigned split, unsigned chunk, uint8_t *out)
+{
+	static uint8_t buf[2][MAX_ENC];
+	struct diag_send_desc_type s[2];
+	struct diag_hdlc_dest_type e[2];
+	unsigned start = 0, end, pos = 0, n, k;
+	int stuck = 0;
+
+	memset(e, 0, sizeof(e));
+	if (split == 0 || split >= len)
+		split = len;
+
+	for (end = split; start < len; start = end, end = len) {
+		for (k = 0; k < 2; k++) {
+			s[k].pkt = pkt + start;
+			s[k].last = pkt + end - 1;
+			s[k].state = start ? DIAG_STATE_BUSY : DIAG_STATE_START;
+			s[k].terminate = end == len;
+		}
+
+		while (s[0].state != DIAG_STATE_COMPLETE) {
+			n = chunk ? chunk : 2 + rnd() % 64;
+			if (n > MAX_ENC - pos)
+				n = MAX_ENC - pos;
+			for (k = 0; k < 2; k++) {
+				e[k].dest = buf[k] + pos;
+				e[k].dest_last = buf[k] + pos + n - 1;
+			}
+
+			ref_hdlc_encode(&s[0], &e[0]);
+			diag_hdlc_encode(&s[1], &e[1]);
+
+			if (s[0].pkt != s[1].pkt || s[0].state != s[1].state)
+				fail("encode: source state differs");
+			if ((uint8_t *)e[0].dest - buf[0] !=
+			    (uint8_t *)e[1].dest - buf[1] ||
+			    e[0].crc != e[1].crc)
+				fail("encode: destination state differs");
+			n = (uint8_t *)e[0].dest - buf[0];
+			if (memcmp(buf[0] + pos, buf[1] + pos, n - pos))
+				fail("encode: output differs");
+
+			if (n == pos && ++stuck > 1)
+				fail("encode: no progress");
+			if (n != pos)
+				stuck = 0;
+			pos = n;
+		}
+	}
+
+	memcpy(out, buf[1], pos);
+	return pos;
+}
+
+/*
+ * Decode enc[0..len) in source chunks of @src_chunk bytes into
+ * destinations of @dest_chunk bytes, random sizes if 0.  Returns the
+ * decoded length.
+ */
+static unsigned check_decode(uint8_t *enc, unsigned len, unsigned src_chunk,
+			     unsigned dest_chunk, uint8_t *out)
+{
+	static uint8_t buf[2][MAX_ENC];
+	struct diag_hdlc_decode_type d[2];
+	unsigned pos = 0, outlen = 0, n, m, k;
+	int r[2];
+
+	memset(d, 0, sizeof(d));
+	while (pos < len) {
+		n = src_chunk ? src_chunk : 1 + rnd() % 64;
+		if (n > len - pos)
+			n = len - pos;
+		for (k = 0; k < 2; k++) {
+			d[k].src_ptr = enc + pos;
+			d[k].src_idx = 0;
+			d[k].src_size = n;
+		}
+
+		while (d[0].src_idx < d[0].src_size) {
+			m = dest_chunk ? dest_chunk : 1 + rnd() % 64;
+			for (k = 0; k < 2; k++) {
+				d[k].dest_ptr = buf[k];
+				d[k].dest_idx = 0;
+				d[k].dest_size = m;
+			}
+
+			r[0] = ref_hdlc_decode(&d[0]);
+			r[1] = diag_hdlc_decode(&d[1]);
+
+			if (r[0] != r[1] || d[0].escaping != d[1].escaping)
+				fail("decode: state differs");
+			if (d[0].src_idx != d[1].src_idx ||
+			    d[0].dest_idx != d[1].dest_idx)
+				fail("decode: indices differ");
+			if (memcmp(buf[0], buf[1], d[0].dest_idx))
+				fail("decode: output differs");
+			if (d[0].dest_idx == 0 && d[0].src_idx == 0)
+				fail("decode: no progress");
+
+			memcpy(out + outlen, buf[1], d[1].dest_idx);
+			outlen += d[1].dest_idx;
+		}
+		pos += n;
+	}
+	return outlen;
+}
+
+/* aligned, so that pkt + off has every alignment */
+static uint32_t pkt_words[MAX_PKT / 4 + 1];
+static uint32_t enc_words[MAX_ENC / 4 + 1];
+static uint8_t enc_out[MAX_ENC];
+static uint8_t dec_out[MAX_ENC];
+
+static void check(unsigned len, unsigned special, unsigned off,
+		  unsigned split, unsigned enc_chunk, unsigned src_chunk,
+		  unsigned dest_chunk)
+{
+	uint8_t *pkt = (uint8_t *)pkt_words + off;
+	uint8_t *enc = (uint8_t *)enc_words + (rnd() & 3);
+	unsigned enc_len, dec_len;
+	uint16_t crc;
+
+	cases++;
+	fill(pkt, len, special);
+
+	enc_len = check_encode(pkt, len, split, enc_chunk, enc_out);
+	memcpy(enc, enc_out, enc_len);
+	dec_len = check_decode(enc, enc_len, src_chunk, dest_chunk, dec_out);
+
+	crc = ~crc_ccitt(0xFFFF, pkt, len);
+	if (dec_len != len + 3 || memcmp(dec_out, pkt, len) ||
+	    dec_out[len] != (crc & 0xFF) || dec_out[len + 1] != (crc >> 8) ||
+	    dec_out[len + 2] != CONTROL_CHAR)
+		fail("round trip differs");
+}
+
+static void check_vectors(void)
+{
+	static const unsigned lens[] = {
+		1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 64, 100, 255
+	};
+	static const unsigned specials[] = { 0, 1, 2, 3, 7, 64 };
+	unsigned l, s, off, chunk, src_chunk;
+
+	for (s = 0; s < ARRAY_SIZE(specials); s++)
+		for (l = 0; l < ARRAY_SIZE(lens); l++)
+			for (off = 0; off < 4; off++)
+				for (chunk = 2; chunk <= 18; chunk++)
+					for (src_chunk = 1; src_chunk <= 9;
+					     src_chunk++)
+						check(lens[l], specials[s],
+						      off, lens[l] / 2, chunk,
+						      src_chunk, chunk - 1);
+}
+
+static void check_random(unsigned long n)
+{
+	static const unsigned specials[] = { 0, 1, 2, 16, 256, 4096 };
+	unsigned len;
+
+	while (n--) {
+		len = (rnd() & 1) ? 1 + rnd() % 64 : 1 + rnd() % MAX_PKT;
+		check(len, specials[rnd() % ARRAY_SIZE(specials)], rnd() & 3,
+		      (rnd() & 3) ? 0 : rnd() % len,
+		      (rnd() & 1) ? 0 : 2 + rnd() % 512,
+		      (rnd() & 1) ? 0 : 1 + rnd() % 512,
+		      (rnd() & 1) ? 0 : 1 + rnd() % 512);
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define BENCH_BYTES	(256 << 20)
+
+static double bench_encode(void (*encode)(struct diag_send_desc_type *,
+					  struct diag_hdlc_dest_type *),
+			   uint8_t *pkt, unsigned len)
+{
+	struct diag_send_desc_type s;
+	struct diag_hdlc_dest_type e;
+	unsigned long done;
+	double t = now();
+
+	for (done = 0; done < BENCH_BYTES; done += len) {
+		s.pkt = pkt;
+		s.last = pkt + len - 1;
+		s.state = DIAG_STATE_START;
+		s.terminate = 1;
+		e.dest = enc_out;
+		e.dest_last = enc_out + MAX_ENC - 1;
+		encode(&s, &e);
+	}
+	return BENCH_BYTES / (now() - t) / (1 << 20);
+}
+
+static double bench_decode(int (*decode)(struct diag_hdlc_decode_type *),
+			   uint8_t *enc, unsigned len)
+{
+	struct diag_hdlc_decode_type d;
+	unsigned long done;
+	double t = now();
+
+	memset(&d, 0, sizeof(d));
+	for (done = 0; done < BENCH_BYTES; done += len) {
+		d.src_ptr = enc;
+		d.src_idx = 0;
+		d.src_size = len;
+		d.dest_ptr = dec_out;
+		d.dest_idx = 0;
+		d.dest_size = MAX_ENC;
+		decode(&d);
+	}
+	return BENCH_BYTES / (now() - t) / (1 << 20);
+}
+
+static void bench(const char *name, unsigned special)
+{
+	uint8_t *pkt = (uint8_t *)pkt_words;
+	uint8_t *enc = (uint8_t *)enc_words;
+	unsigned enc_len;
+
+	fill(pkt, MAX_PKT, special);
+	enc_len = check_encode(pkt, MAX_PKT, 0, MAX_ENC, enc);
+	/* decode up to the flag only, like one packet from the host */
+	enc_len--;
+
+	printf("%-14s encode %7.1f -> %7.1f MB/s   decode %7.1f -> %7.1f MB/s\n",
+	       name, bench_encode(ref_hdlc_encode, pkt, MAX_PKT),
+	       bench_encode(diag_hdlc_encode, pkt, MAX_PKT),
+	       bench_decode(ref_hdlc_decode, enc, enc_len),
+	       bench_decode(diag_hdlc_decode, enc, enc_len));
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long n = 50000;
+
+	if (argc > 1)
+		n = strtoul(argv[1], NULL, 0);
+	if (argc > 2)
+		seed = strtoul(argv[2], NULL, 0) | 1;
+
+	diag_hdlc_init();
+	check_vectors();
+	check_random(n);
+	printf("%lu cases ok\n", cases);
+
+	printf("4K packets, reference -> current:\n");
+	bench("no escapes", 0);
+	bench("1/256 escaped", 256);
+	bench("1/16 escaped", 16);
+	bench("all escaped", 1);
+	return 0;
+}
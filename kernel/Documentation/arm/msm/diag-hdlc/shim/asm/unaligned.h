@@ -0,0 +1,14 @@
+/* Host stand-in for <asm/unaligned.h>, see ../../hdlc_test.c */
+#ifndef _HDLC_SHIM_UNALIGNED_H
+#define _HDLC_SHIM_UNALIGNED_H
+
+#include <linux/types.h>
+
+static inline u32 get_unaligned_le32(const void *p)
+{
+	const u8 *b = p;
+
+	return b[0] | b[1] << 8 | b[2] << 16 | (u32)b[3] << 24;
+}
+
+#endif
@@ -0,0 +1,2 @@
+/* The kernel header works as is once <linux/types.h> is the shim */
+#include "../../../../../../include/linux/crc-ccitt.h"
@@ -0,0 +1,2 @@
+/* Host stand-in for <linux/device.h>, see ../../hdlc_test.c */
+#include <linux/module.h>
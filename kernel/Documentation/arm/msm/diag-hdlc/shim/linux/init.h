@@ -0,0 +1,2 @@
+/* Host stand-in for <linux/init.h>, see ../../hdlc_test.c */
+#include <linux/module.h>
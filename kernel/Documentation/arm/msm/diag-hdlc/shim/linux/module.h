@@ -0,0 +1,16 @@
+/* Host stand-in for <linux/module.h>, see ../../hdlc_test.c */
+#ifndef _HDLC_SHIM_MODULE_H
+#define _HDLC_SHIM_MODULE_H
+
+#include <linux/types.h>
+
+#define MODULE_LICENSE(x)	extern int hdlc_shim_unused
+#define MODULE_DESCRIPTION(x)	extern int hdlc_shim_unused
+#define EXPORT_SYMBOL(x)	extern int hdlc_shim_unused
+
+#define __init
+#define noinline		__attribute__((noinline))
+
+#define min(x, y)		((x) < (y) ? (x) : (y))
+
+#endif
@@ -0,0 +1,13 @@
+/* Host stand-in for <linux/types.h>, see ../../hdlc_test.c */
+#ifndef _HDLC_SHIM_TYPES_H
+#define _HDLC_SHIM_TYPES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+
+#endif
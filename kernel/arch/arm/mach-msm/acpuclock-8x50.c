@@ -62,6 +62,11 @@
 #include <linux/mutex.h>
 #include <linux/errno.h>
 #include <linux/cpufreq.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <mach/board.h>
 #include <mach/msm_iomap.h>
@@ -89,6 +94,16 @@
 #define SEMC_ACPU_MIN_UV_MV 750U
 #define SEMC_ACPU_MAX_UV_MV 1500U
 
+/* How long a lowered VDD or an unused SCPLL is kept around after a
+ * downward switch. Switching back up within this window avoids both the
+ * VDD ramp and the SCPLL power-up delay. */
+#define ACPU_RELAX_DELAY_MS 20
+
+/* Transition latency histogram buckets: <50, <100, <200, <400, <800
+ * and >=800 us. */
+#define ACPU_LAT_BUCKETS 6
+#define ACPU_LAT_BASE_US 50
+
 #define dprintk(msg...) \
 	cpufreq_debug_printk(CPUFREQ_DEBUG_DRIVER, "cpufreq-msm", msg)
 
@@ -295,6 +310,27 @@ static void __init cpufreq_table_init(void)
 }
 #endif
 
+/* How to get from one operating point to another. */
+enum {
+	PATH_MUX,		/* neither end uses the SCPLL */
+	PATH_TO_SCPLL,		/* SCPLL has to be running before the switch */
+	PATH_FROM_SCPLL,	/* SCPLL is no longer needed after the switch */
+	PATH_SCPLL_HOP,		/* park on PLL0 and hop the SCPLL */
+};
+
+/* A switch is at most two config_pll() hops, through PLL0 for
+ * PATH_SCPLL_HOP. */
+#define ACPU_MAX_HOPS	2
+
+struct acpu_transition {
+	unsigned int			path;
+	unsigned int			nr_hops;
+	struct clkctl_acpu_speed	*hop[ACPU_MAX_HOPS];
+	uint32_t	count;
+	uint32_t	max_us;
+	uint32_t	hist[ACPU_LAT_BUCKETS];
+};
+
 struct clock_state {
 	struct clkctl_acpu_speed	*current_speed;
 	struct mutex			lock;
@@ -303,6 +339,15 @@ struct clock_state {
 	uint32_t			vdd_switch_time_us;
 	unsigned int			max_vdd;
 	int (*acpu_set_vdd) (int mvolts);
+	int				current_vdd;
+	int				scpll_on;
+	/* Last operating point requested by cpufreq; the relax work
+	 * settles VDD and the SCPLL to match it. */
+	struct clkctl_acpu_speed	*vdd_target;
+	struct delayed_work		relax_work;
+	/* nr_speeds x nr_speeds matrix, indexed [from][to]. */
+	struct acpu_transition		*transitions;
+	unsigned int			nr_speeds;
 };
 
 static struct clock_state drv_state = { 0 };
@@ -539,32 +584,149 @@ static int acpuclk_set_vdd_level(int vdd)
 	}
 }
 
+/* acpu_freq_tbl is sorted by frequency, so a binary search is enough to
+ * find the operating point for a rate. */
+static int acpu_speed_index(unsigned long rate)
+{
+	int lo = 0, hi = drv_state.nr_speeds - 1, mid;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (acpu_freq_tbl[mid].acpuclk_khz == rate)
+			return mid;
+		if (acpu_freq_tbl[mid].acpuclk_khz < rate)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return -EINVAL;
+}
+
+static unsigned int acpu_transition_path(struct clkctl_acpu_speed *strt_s,
+					 struct clkctl_acpu_speed *tgt_s)
+{
+	if (strt_s->pll != ACPU_PLL_3 && tgt_s->pll != ACPU_PLL_3)
+		return PATH_MUX;
+	if (strt_s->pll != ACPU_PLL_3 && tgt_s->pll == ACPU_PLL_3)
+		return PATH_TO_SCPLL;
+	if (strt_s->pll == ACPU_PLL_3 && tgt_s->pll != ACPU_PLL_3)
+		return PATH_FROM_SCPLL;
+	return PATH_SCPLL_HOP;
+}
+
+/* Work out the path and the config_pll() hops of one switch. */
+static void acpu_transition_fill(struct acpu_transition *t,
+				 struct clkctl_acpu_speed *strt_s,
+				 struct clkctl_acpu_speed *tgt_s)
+{
+	t->path = acpu_transition_path(strt_s, tgt_s);
+	t->nr_hops = 0;
+	/* Temporarily switch to PLL0 while reconfiguring PLL3. */
+	if (t->path == PATH_SCPLL_HOP)
+		t->hop[t->nr_hops++] = PLL0_S;
+	t->hop[t->nr_hops++] = tgt_s;
+}
+
+/* Power down the SCPLL if speed @s doesn't run from it. */
+static void acpu_scpll_release(struct clkctl_acpu_speed *s)
+{
+	if (drv_state.scpll_on && s->pll != ACPU_PLL_3) {
+		scpll_apps_enable(0);
+		drv_state.scpll_on = 0;
+	}
+}
+
+static void acpu_transition_account(int from, int to, ktime_t start)
+{
+	struct acpu_transition *t;
+	uint32_t us;
+	int bucket;
+
+	if (!drv_state.transitions)
+		return;
+
+	t = &drv_state.transitions[from * drv_state.nr_speeds + to];
+	us = ktime_to_us(ktime_sub(ktime_get(), start));
+
+	bucket = fls(us / ACPU_LAT_BASE_US);
+	if (bucket >= ACPU_LAT_BUCKETS)
+		bucket = ACPU_LAT_BUCKETS - 1;
+
+	t->count++;
+	t->hist[bucket]++;
+	if (us > t->max_us)
+		t->max_us = us;
+}
+
+/* Drop VDD and power down the SCPLL once cpufreq has settled on a lower
+ * operating point. Runs with drv_state.lock held. */
+static void acpuclk_relax(void)
+{
+	struct clkctl_acpu_speed *s = drv_state.vdd_target;
+	int res;
+
+	if (!s)
+		return;
+
+	acpu_scpll_release(drv_state.current_speed);
+
+#ifdef CONFIG_MSM_CPU_AVS
+	/* notify avs after changing frequency */
+	res = avs_adjust_freq(s - acpu_freq_tbl, 0);
+	if (res)
+		pr_warning("Unable to drop ACPU vdd (%d)\n", res);
+#endif
+
+	/* Drop VDD level if we can. */
+	if (s->vdd < drv_state.current_vdd) {
+		res = acpuclk_set_vdd_level(s->vdd);
+		if (res)
+			pr_warning("Unable to drop ACPU vdd (%d)\n", res);
+		else
+			drv_state.current_vdd = s->vdd;
+	}
+}
+
+static void acpuclk_relax_work(struct work_struct *work)
+{
+	mutex_lock(&drv_state.lock);
+	acpuclk_relax();
+	mutex_unlock(&drv_state.lock);
+}
+
 int acpuclk_set_rate(unsigned long rate, enum setrate_reason reason)
 {
 	struct clkctl_acpu_speed *tgt_s, *strt_s;
+	struct acpu_transition *t, fallback;
+	unsigned int i;
 	int res, rc = 0;
-	int freq_index = 0;
+	int freq_index, strt_index;
+	ktime_t start = ktime_get();
 
 	if (reason == SETRATE_CPUFREQ)
 		mutex_lock(&drv_state.lock);
 
 	strt_s = drv_state.current_speed;
 
-	if (rate == strt_s->acpuclk_khz)
+	/* Power collapse and SWFI must not leave the SCPLL running. The
+	 * rate may already be right if cpufreq settled there and left the
+	 * power-down to the relax work. */
+	if (rate == strt_s->acpuclk_khz) {
+		if (reason != SETRATE_CPUFREQ)
+			acpu_scpll_release(strt_s);
 		goto out;
-
-	for (tgt_s = acpu_freq_tbl; tgt_s->acpuclk_khz != 0; tgt_s++) {
-		if (tgt_s->acpuclk_khz == rate)
-			break;
-		freq_index++;
 	}
 
-	if (tgt_s->acpuclk_khz == 0) {
+	freq_index = acpu_speed_index(rate);
+	if (freq_index < 0) {
 		rc = -EINVAL;
 		goto out;
 	}
+	tgt_s = &acpu_freq_tbl[freq_index];
+	strt_index = strt_s - acpu_freq_tbl;
 
 	if (reason == SETRATE_CPUFREQ) {
+		drv_state.vdd_target = tgt_s;
 #ifdef CONFIG_MSM_CPU_AVS
 		/* Notify avs before changing frequency */
 		rc = avs_adjust_freq(freq_index, 1);
@@ -573,14 +735,17 @@ int acpuclk_set_rate(unsigned long rate, enum setrate_reason reason)
 			goto out;
 		}
 #endif
-		/* Increase VDD if needed. */
-		if (tgt_s->vdd > strt_s->vdd) {
+		/* Increase VDD if needed. A drop from an earlier switch
+		 * may still be pending, in which case VDD is already high
+		 * enough. */
+		if (tgt_s->vdd > drv_state.current_vdd) {
 			rc = acpuclk_set_vdd_level(tgt_s->vdd);
 			if (rc) {
 				pr_err("Unable to increase ACPU vdd (%d)\n",
 					rc);
 				goto out;
 			}
+			drv_state.current_vdd = tgt_s->vdd;
 		}
 	} else if (reason == SETRATE_PC
 		&& rate != POWER_COLLAPSE_KHZ) {
@@ -592,19 +757,22 @@ int acpuclk_set_rate(unsigned long rate, enum setrate_reason reason)
 	dprintk("Switching from ACPU rate %u KHz -> %u KHz\n",
 		strt_s->acpuclk_khz, tgt_s->acpuclk_khz);
 
-	if (strt_s->pll != ACPU_PLL_3 && tgt_s->pll != ACPU_PLL_3) {
-		config_pll(tgt_s);
-	} else if (strt_s->pll != ACPU_PLL_3 && tgt_s->pll == ACPU_PLL_3) {
-		scpll_apps_enable(1);
-		config_pll(tgt_s);
-	} else if (strt_s->pll == ACPU_PLL_3 && tgt_s->pll != ACPU_PLL_3) {
-		config_pll(tgt_s);
-		scpll_apps_enable(0);
+	if (drv_state.transitions) {
+		t = &drv_state.transitions[strt_index * drv_state.nr_speeds
+					   + freq_index];
 	} else {
-		/* Temporarily switch to PLL0 while reconfiguring PLL3. */
-		config_pll(PLL0_S);
-		config_pll(tgt_s);
+		t = &fallback;
+		acpu_transition_fill(t, strt_s, tgt_s);
+	}
+
+	/* The SCPLL may have been left running by a recent downward
+	 * switch. */
+	if (t->path == PATH_TO_SCPLL && !drv_state.scpll_on) {
+		scpll_apps_enable(1);
+		drv_state.scpll_on = 1;
 	}
+	for (i = 0; i < t->nr_hops; i++)
+		config_pll(t->hop[i]);
 
 	/* Update the driver state with the new clock freq */
 	drv_state.current_speed = tgt_s;
@@ -612,6 +780,10 @@ int acpuclk_set_rate(unsigned long rate, enum setrate_reason reason)
 	/* Re-adjust lpj for the new clock speed. */
 	loops_per_jiffy = tgt_s->lpj;
 
+	/* Power collapse and SWFI must not leave the SCPLL running. */
+	if (reason != SETRATE_CPUFREQ)
+		acpu_scpll_release(tgt_s);
+
 	/* Nothing else to do for SWFI. */
 	if (reason == SETRATE_SWFI)
 		goto out;
@@ -627,19 +799,25 @@ int acpuclk_set_rate(unsigned long rate, enum setrate_reason reason)
 	if (reason == SETRATE_PC)
 		goto out;
 
+	acpu_transition_account(strt_index, freq_index, start);
+
+	/* Dropping VDD and powering down the SCPLL are not needed to
+	 * complete the switch, so leave them to the relax work. */
+	if (tgt_s->vdd < drv_state.current_vdd
+	    || (drv_state.scpll_on && tgt_s->pll != ACPU_PLL_3)) {
+		cancel_delayed_work(&drv_state.relax_work);
+		schedule_delayed_work(&drv_state.relax_work,
+			round_jiffies_slack_relative(
+				msecs_to_jiffies(ACPU_RELAX_DELAY_MS),
+				msecs_to_jiffies(ACPU_RELAX_DELAY_MS) / 2));
+	}
 #ifdef CONFIG_MSM_CPU_AVS
-	/* notify avs after changing frequency */
-	res = avs_adjust_freq(freq_index, 0);
-	if (res)
-		pr_warning("Unable to drop ACPU vdd (%d)\n", res);
-#endif
-
-	/* Drop VDD level if we can. */
-	if (tgt_s->vdd < strt_s->vdd) {
-		res = acpuclk_set_vdd_level(tgt_s->vdd);
+	else {
+		res = avs_adjust_freq(freq_index, 0);
 		if (res)
 			pr_warning("Unable to drop ACPU vdd (%d)\n", res);
 	}
+#endif
 
 	dprintk("ACPU speed change complete\n");
 out:
@@ -705,6 +883,8 @@ static void __init acpuclk_init(void)
 	}
 
 	drv_state.current_speed = speed;
+	drv_state.current_vdd = speed->vdd;
+	drv_state.scpll_on = (speed->pll == ACPU_PLL_3);
 	res = ebi1_clk_set_min_rate(CLKVOTE_ACPUCLK, speed->axiclk_khz * 1000);
 	if (res < 0)
 		pr_warning("Setting AXI min rate failed (%d)\n", res);
@@ -826,6 +1006,29 @@ static void __init lpj_init(void)
 	}
 }
 
+/* Precompute the switch hops between every pair of operating points. */
+static void __init acpu_transitions_init(void)
+{
+	unsigned int i, j, n;
+
+	for (n = 0; acpu_freq_tbl[n].acpuclk_khz; n++)
+		;
+	drv_state.nr_speeds = n;
+
+	drv_state.transitions = kzalloc(n * n *
+		sizeof(*drv_state.transitions), GFP_KERNEL);
+	if (!drv_state.transitions) {
+		pr_warning("Unable to allocate ACPU transition table\n");
+		return;
+	}
+
+	for (i = 0; i < n; i++)
+		for (j = 0; j < n; j++)
+			acpu_transition_fill(&drv_state.transitions[i * n + j],
+					     &acpu_freq_tbl[i],
+					     &acpu_freq_tbl[j]);
+}
+
 #ifdef CONFIG_MSM_CPU_AVS
 static int __init acpu_avs_init(int (*set_vdd) (int), int khz)
 {
@@ -852,9 +1055,12 @@ void __init msm_acpu_clock_init(struct msm_acpu_clock_platform_data *clkdata)
 	drv_state.max_vdd = clkdata->max_vdd;
 	drv_state.acpu_set_vdd = clkdata->acpu_set_vdd;
 
+	INIT_DELAYED_WORK(&drv_state.relax_work, acpuclk_relax_work);
+
 	acpu_freq_tbl_fixup();
 	acpuclk_init();
 	lpj_init();
+	acpu_transitions_init();
 	/* Set a lower bound for ACPU rate for boot. This limits the
 	 * maximum frequency hop caused by the first CPUFREQ switch. */
 	if (drv_state.current_speed->acpuclk_khz < PLL0_S->acpuclk_khz)
@@ -873,6 +1079,74 @@ void __init msm_acpu_clock_init(struct msm_acpu_clock_platform_data *clkdata)
 #endif
 }
 
+#if defined(CONFIG_DEBUG_FS)
+static const char *acpu_path_names[] = {
+	[PATH_MUX] = "mux",
+	[PATH_TO_SCPLL] = "to_scpll",
+	[PATH_FROM_SCPLL] = "from_scpll",
+	[PATH_SCPLL_HOP] = "hop",
+};
+
+static int acpuclk_transitions_show(struct seq_file *m, void *unused)
+{
+	struct acpu_transition *t;
+	unsigned int i, j, b, n = drv_state.nr_speeds;
+
+	seq_printf(m, "%8s %8s %-10s %8s %8s %8s %8s %8s %8s %8s %8s\n",
+		   "from", "to", "path", "count", "max_us", "<50us",
+		   "<100us", "<200us", "<400us", "<800us", ">=800us");
+
+	mutex_lock(&drv_state.lock);
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < n; j++) {
+			t = &drv_state.transitions[i * n + j];
+			if (!t->count)
+				continue;
+			seq_printf(m, "%8u %8u %-10s %8u %8u",
+				   acpu_freq_tbl[i].acpuclk_khz,
+				   acpu_freq_tbl[j].acpuclk_khz,
+				   acpu_path_names[t->path],
+				   t->count, t->max_us);
+			for (b = 0; b < ACPU_LAT_BUCKETS; b++)
+				seq_printf(m, " %8u", t->hist[b]);
+			seq_printf(m, "\n");
+		}
+	}
+	mutex_unlock(&drv_state.lock);
+
+	return 0;
+}
+
+static int acpuclk_transitions_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, acpuclk_transitions_show, NULL);
+}
+
+static const struct file_operations acpuclk_transitions_fops = {
+	.open		= acpuclk_transitions_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init acpuclk_debugfs_init(void)
+{
+	struct dentry *dent;
+
+	if (!drv_state.transitions)
+		return 0;
+
+	dent = debugfs_create_dir("acpuclk", 0);
+	if (IS_ERR(dent))
+		return 0;
+
+	debugfs_create_file("transitions", 0444, dent, NULL,
+			    &acpuclk_transitions_fops);
+	return 0;
+}
+
+late_initcall(acpuclk_debugfs_init);
+#endif
 
 #ifdef CONFIG_CPU_FREQ_VDD_LEVELS
 
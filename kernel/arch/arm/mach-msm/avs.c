@@ -62,6 +62,10 @@
 #include <linux/delay.h>
 #include <linux/kernel_stat.h>
 #include <linux/workqueue.h>
+#include <linux/kobject.h>
+#include <linux/ctype.h>
+#include <linux/slab.h>
+#include <linux/jiffies.h>
 
 #include "avs.h"
 
@@ -71,6 +75,16 @@
 #define TEMPRS 16                /* total number of temperature regions */
 #define GET_TEMPR() (avs_get_tscsr() >> 28) /* scale TSCSR[CTEMP] to regions */
 
+/* Headroom added to every entry of a table loaded from user space; the
+ * delay circuits walk it back down online. */
+#define AVS_LEARNED_MARGIN VOLTAGE_STEP
+/* Number of voltage-up requests tolerated on a loaded table within one
+ * AVS_LEARNED_WINDOW before it is thrown away in favour of the
+ * conservative defaults.  Isolated corrections far apart are normal
+ * drift and must not discard the table. */
+#define AVS_LEARNED_MAX_UPS 3
+#define AVS_LEARNED_WINDOW (60 * HZ)
+
 struct mutex avs_lock;
 
 static struct avs_state_s
@@ -86,8 +100,19 @@ static struct avs_state_s
 	int changing;		/* Clock frequency is changing */
 	u32 freq_idx;		/* Current frequency index */
 	int vdd;		/* Current ACPU voltage */
+	int learned;		/* avs_v was loaded through sysfs */
+	int learned_ups;	/* Voltage-up requests in the current window */
+	unsigned long learned_window;	/* jiffies the window started */
 } avs_state;
 
+static void avs_reset_voltage_tables(void)
+{
+	int i;
+
+	for (i = 0; i < TEMPRS*avs_state.freq_cnt; i++)
+		avs_state.avs_v[i] = VOLTAGE_MAX;
+}
+
 /*
  *  Update the AVS voltage vs frequency table, for current temperature
  *  Adjust based on the AVS delay circuit hardware status
@@ -131,6 +156,23 @@ static void avs_update_voltage_table(short *vdd_table)
 			printk(KERN_ERR
 				"AVS: Voltage can not get high enough!\n");
 
+		/* A loaded table that keeps undershooting is not
+		 * trustworthy for this part; fall back to the defaults. */
+		if (avs_state.learned &&
+		    time_after(jiffies, avs_state.learned_window +
+			       AVS_LEARNED_WINDOW)) {
+			avs_state.learned_window = jiffies;
+			avs_state.learned_ups = 0;
+		}
+		if (avs_state.learned &&
+		    ++avs_state.learned_ups > AVS_LEARNED_MAX_UPS) {
+			printk(KERN_WARNING
+				"AVS: learned table unstable, using defaults\n");
+			avs_reset_voltage_tables();
+			avs_state.learned = 0;
+			return;
+		}
+
 		/* Raise the voltage for all frequencies */
 		for (i = 0; i < avs_state.freq_cnt; i++) {
 			vdd_table[i] = cur_voltage + VOLTAGE_STEP;
@@ -231,6 +273,7 @@ aaf_out:
 static struct delayed_work avs_work;
 static struct workqueue_struct  *kavs_wq;
 #define AVS_DELAY ((CONFIG_HZ * 50 + 999) / 1000)
+#define AVS_SLACK (AVS_DELAY / 2)
 
 static void do_avs_timer(struct work_struct *work)
 {
@@ -243,14 +286,16 @@ static void do_avs_timer(struct work_struct *work)
 		avs_set_target_voltage(cur_freq_idx, 1);
 	}
 	mutex_unlock(&avs_lock);
-	queue_delayed_work_on(0, kavs_wq, &avs_work, AVS_DELAY);
+	queue_delayed_work_on(0, kavs_wq, &avs_work,
+		round_jiffies_slack_relative(AVS_DELAY, AVS_SLACK));
 }
 
 
 static void __init avs_timer_init(void)
 {
 	INIT_DELAYED_WORK_DEFERRABLE(&avs_work, do_avs_timer);
-	queue_delayed_work_on(0, kavs_wq, &avs_work, AVS_DELAY);
+	queue_delayed_work_on(0, kavs_wq, &avs_work,
+		round_jiffies_slack_relative(AVS_DELAY, AVS_SLACK));
 }
 
 static void __exit avs_timer_exit(void)
@@ -276,10 +321,144 @@ static void __exit avs_work_exit(void)
 	destroy_workqueue(kavs_wq);
 }
 
-int __init avs_init(int (*set_vdd)(int), u32 freq_cnt, u32 freq_idx)
+/*
+ * The voltage tables are exported through /sys/kernel/avs/vdd_table as one
+ * line per temperature region:
+ *
+ *	<region>: <mV for freq 0> <mV for freq 1> ...
+ *
+ * User space saves the refined table before shutdown and writes it back
+ * early on the next boot, so the CPU starts close to its minimal stable
+ * voltage instead of VOLTAGE_MAX. Regions not written keep their current
+ * values.
+ */
+static ssize_t avs_vdd_table_show(struct kobject *kobj,
+	struct kobj_attribute *attr, char *buf)
 {
-	int i;
+	int len = 0;
+	int t, i;
+
+	mutex_lock(&avs_lock);
+	for (t = 0; t < TEMPRS; t++) {
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%d:", t);
+		for (i = 0; i < avs_state.freq_cnt; i++)
+			len += scnprintf(buf + len, PAGE_SIZE - len, " %d",
+				avs_state.avs_v[t * avs_state.freq_cnt + i]);
+		len += scnprintf(buf + len, PAGE_SIZE - len, "\n");
+	}
+	mutex_unlock(&avs_lock);
+
+	return len;
+}
+
+static const char *avs_skip_spaces(const char *p)
+{
+	while (isspace(*p))
+		p++;
+	return p;
+}
+
+static ssize_t avs_vdd_table_store(struct kobject *kobj,
+	struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	short *vdd_table;
+	const char *p = buf;
+	char *end;
+	unsigned long t, v, prev;
+	int i, regions = 0, ret = -EINVAL;
+
+	vdd_table = kmalloc(TEMPRS * avs_state.freq_cnt *
+		sizeof(avs_state.avs_v[0]), GFP_KERNEL);
+	if (!vdd_table)
+		return -ENOMEM;
+
+	mutex_lock(&avs_lock);
+	memcpy(vdd_table, avs_state.avs_v, TEMPRS * avs_state.freq_cnt *
+		sizeof(avs_state.avs_v[0]));
+	mutex_unlock(&avs_lock);
+
+	for (p = avs_skip_spaces(p); *p; p = avs_skip_spaces(p)) {
+		t = simple_strtoul(p, &end, 10);
+		if (end == p || *end != ':' || t >= TEMPRS)
+			goto out;
+		p = end + 1;
+
+		prev = 0;
+		for (i = 0; i < avs_state.freq_cnt; i++) {
+			p = avs_skip_spaces(p);
+			v = simple_strtoul(p, &end, 10);
+			if (end == p)
+				goto out;
+			p = end;
+
+			/* Reject anything out of range or not monotonic
+			 * in frequency. */
+			if (v < VOLTAGE_MIN || v > VOLTAGE_MAX || v < prev)
+				goto out;
+			prev = v;
+
+			v += AVS_LEARNED_MARGIN;
+			if (v > VOLTAGE_MAX)
+				v = VOLTAGE_MAX;
+			vdd_table[t * avs_state.freq_cnt + i] = v;
+		}
+		regions++;
+	}
+	if (!regions)
+		goto out;
+
+	mutex_lock(&avs_lock);
+	memcpy(avs_state.avs_v, vdd_table, TEMPRS * avs_state.freq_cnt *
+		sizeof(avs_state.avs_v[0]));
+	avs_state.learned = 1;
+	avs_state.learned_ups = 0;
+	avs_state.learned_window = jiffies;
+	mutex_unlock(&avs_lock);
+	ret = count;
+out:
+	kfree(vdd_table);
+	return ret;
+}
+
+static ssize_t avs_learned_show(struct kobject *kobj,
+	struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", avs_state.learned);
+}
+
+static struct kobj_attribute avs_vdd_table_attr =
+	__ATTR(vdd_table, 0644, avs_vdd_table_show, avs_vdd_table_store);
+static struct kobj_attribute avs_learned_attr =
+	__ATTR(learned, 0444, avs_learned_show, NULL);
+
+static struct attribute *avs_attrs[] = {
+	&avs_vdd_table_attr.attr,
+	&avs_learned_attr.attr,
+	NULL,
+};
+
+static struct attribute_group avs_attr_group = {
+	.attrs = avs_attrs,
+};
+
+static void __init avs_sysfs_init(void)
+{
+	struct kobject *kobj;
+
+	kobj = kobject_create_and_add("avs", kernel_kobj);
+	if (!kobj) {
+		printk(KERN_ERR "AVS: cannot create sysfs kobject\n");
+		return;
+	}
 
+	if (sysfs_create_group(kobj, &avs_attr_group)) {
+		printk(KERN_ERR "AVS: cannot create sysfs attributes\n");
+		kobject_put(kobj);
+	}
+}
+
+int __init avs_init(int (*set_vdd)(int), u32 freq_cnt, u32 freq_idx)
+{
 	mutex_init(&avs_lock);
 
 	if (freq_cnt == 0)
@@ -296,8 +475,7 @@ int __init avs_init(int (*set_vdd)(int), u32 freq_cnt, u32 freq_idx)
 	if (avs_state.avs_v == 0)
 		return -ENOMEM;
 
-	for (i = 0; i < TEMPRS*avs_state.freq_cnt; i++)
-		avs_state.avs_v[i] = VOLTAGE_MAX;
+	avs_reset_voltage_tables();
 
 	avs_reset_delays(AVSDSCR_INPUT);
 	avs_set_tscsr(TSCSR_INPUT);
@@ -309,6 +487,7 @@ int __init avs_init(int (*set_vdd)(int), u32 freq_cnt, u32 freq_idx)
 	avs_adjust_freq(freq_idx, 0);
 
 	avs_work_init();
+	avs_sysfs_init();
 
 	return 0;
 }
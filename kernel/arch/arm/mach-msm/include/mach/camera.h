@@ -114,6 +114,22 @@ struct msm_sensor_ctrl {
 };
 
 /* this structure is used in kernel */
+/* Command objects handed out to the VFE for its messages.  Anything that
+ * fits in MSM_QCMD_POOL_PAYLOAD comes from a per-sensor pool preallocated
+ * at probe time instead of the heap.
+ */
+#define MSM_QCMD_POOL_SIZE	32
+#define MSM_QCMD_POOL_PAYLOAD	512
+
+struct msm_qcmd_pool {
+	spinlock_t lock;
+	struct list_head free;
+	void *slots;
+	int avail;
+	int low;
+	unsigned long misses;
+};
+
 struct msm_queue_cmd {
 	struct list_head list_config;
 	struct list_head list_control;
@@ -122,6 +138,7 @@ struct msm_queue_cmd {
 	enum msm_queue type;
 	void *command;
 	int on_heap;
+	struct msm_qcmd_pool *pool; /* NULL if kmalloc'ed */
 	struct timespec ts;
 };
 
@@ -134,6 +151,14 @@ struct msm_device_queue {
 	const char *name;
 };
 
+#define MSM_PMEM_HASH_BITS	4
+#define MSM_PMEM_HASH_SIZE	(1 << MSM_PMEM_HASH_BITS)
+
+struct msm_pmem_index {
+	struct hlist_head by_paddr[MSM_PMEM_HASH_SIZE];
+	struct hlist_head by_vaddr[MSM_PMEM_HASH_SIZE];
+};
+
 struct msm_sync {
 	/* These two queues are accessed from a process context only
 	 * They contain pmem descriptors for the preview frames and the stats
@@ -142,6 +167,12 @@ struct msm_sync {
 	struct hlist_head pmem_frames;
 	struct hlist_head pmem_stats;
 
+	/* The same regions hashed by physical and by user address, so the
+	 * per-frame lookups do not walk the lists above.
+	 */
+	struct msm_pmem_index frame_index;
+	struct msm_pmem_index stats_index;
+
 	/* The message queue is used by the control thread to send commands
 	 * to the config thread, and also by the DSP to send messages to the
 	 * config thread.  Thus it is the only queue that is accessed from
@@ -155,6 +186,11 @@ struct msm_sync {
 	struct msm_device_queue frame_q;
 	int unblock_poll_frame;
 
+	/* Preview frames are delivered through this ring instead of frame_q
+	 * once the frame thread has mmap()ed it.  Protected by frame_q.lock.
+	 */
+	struct msm_frame_ring *frame_ring;
+
 	/* This queue contains snapshot frames.  It is accessed by the DSP (in
 	 * interrupt context, and by the control thread.
 	 */
@@ -184,6 +220,8 @@ struct msm_sync {
 
 	spinlock_t pmem_frame_spinlock;
 	spinlock_t pmem_stats_spinlock;
+
+	struct msm_qcmd_pool qcmd_pool;
 };
 
 #define MSM_APPS_ID_V4L2 "msm_v4l2"
@@ -220,6 +258,9 @@ struct register_address_value_pair {
 
 struct msm_pmem_region {
 	struct hlist_node list;
+	struct hlist_node pnode;	/* msm_pmem_index.by_paddr */
+	struct hlist_node vnode;	/* msm_pmem_index.by_vaddr */
+	unsigned long pkey;		/* address the VFE reports back */
 	unsigned long paddr;
 	unsigned long len;
 	struct file *file;
@@ -17,6 +17,8 @@
 #ifndef _MACH_MSM_QDSP6_Q6AUDIO_
 #define _MACH_MSM_QDSP6_Q6AUDIO_
 
+#include <linux/ktime.h>
+
 #define AUDIO_FLAG_READ		0
 #define AUDIO_FLAG_WRITE	1
 #define AUDIO_FLAG_INCALL_MIXED	2
@@ -27,6 +29,16 @@ struct audio_buffer {
 	uint32_t size;
 	uint32_t used;	/* 1 = CPU is waiting for DSP to consume this buf */
 	uint32_t actual_size; /* actual number of bytes read by DSP */
+	ktime_t submitted; /* when the buffer was handed to the DSP */
+};
+
+/* Time from q6audio_write() to the DSP's BUF_DONE for output clients */
+struct audio_latency {
+	uint32_t periods;
+	uint32_t last_us;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint64_t total_us;
 };
 
 struct audio_client {
@@ -41,6 +53,10 @@ struct audio_client {
 
 	int cb_status;
 	uint32_t flags;
+
+	struct audio_latency latency;
+	/* if set, advanced on every BUF_DONE (mmap'ed pcm_out) */
+	uint32_t *hw_ptr;
 };
 
 /* Obtain a 16bit signed, interleaved audio channel of the specified
@@ -41,6 +41,12 @@ int smd_read_from_cb(smd_channel_t *ch, void *data, int len);
 */
 int smd_write(smd_channel_t *ch, const void *data, int len);
 
+/* Same as smd_write() but without signalling the other side, so a
+** burst of writes can be followed by a single smd_notify_other_cpu().
+*/
+int smd_write_nonotify(smd_channel_t *ch, const void *data, int len);
+void smd_notify_other_cpu(smd_channel_t *ch);
+
 int smd_write_avail(smd_channel_t *ch);
 int smd_read_avail(smd_channel_t *ch);
 
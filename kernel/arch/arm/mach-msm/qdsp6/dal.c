@@ -89,6 +89,17 @@ struct dal_channel {
 	struct dal_client *active;
 };
 
+#define DAL_BATCH_MAX		8
+#define DAL_BATCH_DATA_MAX	16
+
+/* one call queued between dal_batch_begin() and dal_batch_commit() */
+struct dal_batch_slot {
+	struct dal_hdr hdr;
+	uint32_t data[DAL_BATCH_DATA_MAX / 4];
+	uint32_t reply;
+	int status;
+};
+
 struct dal_client {
 	struct list_head list;
 	struct dal_channel *dch;
@@ -111,6 +122,15 @@ struct dal_client {
 	int status;
 	unsigned msgid; /* msgid of expected reply */
 
+	/* pipelined calls: replies arrive in the order the calls were
+	 * sent, so slot batch_done owns the next reply until all
+	 * batch_count of them are in
+	 */
+	unsigned batch_count;
+	unsigned batch_done;
+	int batch_result;
+	struct dal_batch_slot batch[DAL_BATCH_MAX];
+
 	spinlock_t tr_lock;
 	unsigned tr_head;
 	unsigned tr_tail;
@@ -267,6 +287,20 @@ check_data:
 			goto again;
 		}
 
+		if (hdr->msgid == client->msgid &&
+		    client->batch_done < client->batch_count) {
+			struct dal_batch_slot *slot;
+
+			slot = client->batch + client->batch_done;
+			if (len > sizeof(slot->reply))
+				len = sizeof(slot->reply);
+			memcpy(&slot->reply, client->data, len);
+			slot->status = len;
+			if (++client->batch_done == client->batch_count)
+				wake_up(&client->wait);
+			goto again;
+		}
+
 		if (hdr->msgid == client->msgid) {
 			if (!client->remote)
 				client->remote = hdr->from;
@@ -395,6 +429,115 @@ int dal_call(struct dal_client *client,
 	return r;
 }
 
+/* Pipelined calls.  dal_batch_begin() takes the client for the caller;
+ * the f0/f1 calls that follow are only queued, and are written to the
+ * channel back to back by dal_batch_commit(), which then sleeps once
+ * for all of their replies.  A full queue is flushed early.  Plain
+ * dal_call() must not be used on the client in between.
+ */
+void dal_batch_begin(struct dal_client *client)
+{
+	mutex_lock(&client->write_lock);
+	client->batch_count = 0;
+	client->batch_result = 0;
+}
+
+static void dal_batch_flush(struct dal_client *client)
+{
+	struct dal_channel *dch = client->dch;
+	struct dal_batch_slot *slot;
+	unsigned long flags;
+	unsigned n, len;
+	int res;
+
+	if (client->batch_count == 0)
+		return;
+
+	client->batch_done = 0;
+	client->msgid = DAL_MSGID_DDI | DAL_MSGID_REPLY;
+
+	if (client->tr_log)
+		for (n = 0; n < client->batch_count; n++) {
+			slot = client->batch + n;
+			dal_trace_log(client, &slot->hdr, slot->data,
+				      slot->hdr.length - sizeof(slot->hdr));
+		}
+
+	spin_lock_irqsave(&dch->lock, flags);
+	for (n = 0; n < client->batch_count; n++) {
+		slot = client->batch + n;
+		len = slot->hdr.length - sizeof(slot->hdr);
+		slot->status = -EBUSY;
+		smd_write(dch->sch, &slot->hdr, sizeof(slot->hdr));
+		smd_write(dch->sch, slot->data, len);
+	}
+	spin_unlock_irqrestore(&dch->lock, flags);
+
+	if (!wait_event_timeout(client->wait,
+			(client->batch_done == client->batch_count), 5*HZ)) {
+		dal_trace_dump(client);
+		pr_err("dal: batch timed out after %d of %d replies. "
+		       "dsp is probably dead.\n",
+		       client->batch_done, client->batch_count);
+		BUG();
+	}
+
+	for (n = 0; n < client->batch_count; n++) {
+		slot = client->batch + n;
+		res = slot->status >= 4 ? (int) slot->reply : slot->status;
+		if (res && !client->batch_result)
+			client->batch_result = res;
+	}
+	client->batch_count = 0;
+	client->batch_done = 0;
+}
+
+static void dal_batch_queue(struct dal_client *client, uint32_t ddi,
+			    unsigned prototype, uint32_t *data, int data_len)
+{
+	struct dal_batch_slot *slot;
+
+	if (client->batch_count == DAL_BATCH_MAX)
+		dal_batch_flush(client);
+
+	slot = client->batch + client->batch_count++;
+	memset(&slot->hdr, 0, sizeof(slot->hdr));
+	slot->hdr.length = data_len + sizeof(slot->hdr);
+	slot->hdr.version = DAL_VERSION;
+	slot->hdr.msgid = DAL_MSGID_DDI;
+	slot->hdr.ddi = ddi;
+	slot->hdr.prototype = prototype;
+	slot->hdr.from = client;
+	slot->hdr.to = client->remote;
+	memcpy(slot->data, data, data_len);
+}
+
+void dal_batch_call_f0(struct dal_client *client, uint32_t ddi,
+		       uint32_t arg1)
+{
+	dal_batch_queue(client, ddi, 0, &arg1, sizeof(arg1));
+}
+
+void dal_batch_call_f1(struct dal_client *client, uint32_t ddi,
+		       uint32_t arg1, uint32_t arg2)
+{
+	uint32_t tmp[2];
+	tmp[0] = arg1;
+	tmp[1] = arg2;
+	dal_batch_queue(client, ddi, 1, tmp, sizeof(tmp));
+}
+
+/* returns the first non-zero result of the batch, if any */
+int dal_batch_commit(struct dal_client *client)
+{
+	int r;
+
+	dal_batch_flush(client);
+	r = client->batch_result;
+	mutex_unlock(&client->write_lock);
+	return r;
+}
+
 struct dal_msg_attach {
 	uint32_t device_id;
 	char attach[64];
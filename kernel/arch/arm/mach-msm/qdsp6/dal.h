@@ -37,6 +37,14 @@ int dal_call(struct dal_client *client,
 	     void *data, int data_len,
 	     void *reply, int reply_max);
 
+/* pipelined calls, see dal.c */
+void dal_batch_begin(struct dal_client *client);
+void dal_batch_call_f0(struct dal_client *client, uint32_t ddi,
+		       uint32_t arg1);
+void dal_batch_call_f1(struct dal_client *client, uint32_t ddi,
+		       uint32_t arg1, uint32_t arg2);
+int dal_batch_commit(struct dal_client *client);
+
 void dal_trace(struct dal_client *client);
 void dal_trace_dump(struct dal_client *client);
 
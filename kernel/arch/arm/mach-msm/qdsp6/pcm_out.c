@@ -21,6 +21,9 @@
 #include <linux/sched.h>
 #include <linux/wait.h>
 #include <linux/uaccess.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/math64.h>
 
 #include <linux/msm_audio.h>
 
@@ -36,8 +39,77 @@ struct pcm {
 	uint32_t sample_rate;
 	uint32_t channel_count;
 	size_t buffer_size;
+
+	/* low-latency mode: control page shared with userspace */
+	struct msm_audio_mmap_ctl *ctl;
 };
 
+static int pcm_start(struct pcm *pcm, uint32_t acdb_id)
+{
+	if (pcm->ac)
+		return -EBUSY;
+	pcm->ac = q6audio_open_pcm(pcm->buffer_size, pcm->sample_rate,
+				   pcm->channel_count, AUDIO_FLAG_WRITE,
+				   acdb_id);
+	if (!pcm->ac)
+		return -ENOMEM;
+	return 0;
+}
+
+static int pcm_submit(struct file *file, struct pcm *pcm, unsigned count)
+{
+	struct audio_client *ac;
+	struct audio_buffer *ab;
+
+	mutex_lock(&pcm->lock);
+	ac = pcm->ac;
+	mutex_unlock(&pcm->lock);
+	if (!ac || !pcm->ctl)
+		return -ENODEV;
+
+	ab = ac->buf + ac->cpu_buf;
+	if (count == 0 || count > ab->size)
+		return -EINVAL;
+
+	if (ab->used) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		if (!wait_event_timeout(ac->wait, (ab->used == 0), 5*HZ)) {
+			audio_client_dump(ac);
+			pr_err("pcm_submit: timeout. dsp dead?\n");
+			BUG();
+		}
+	}
+
+	ab->used = 1;
+	ab->actual_size = count;
+	q6audio_write(ac, ab);
+	ac->cpu_buf ^= 1;
+	pcm->ctl->appl_ptr++;
+	return 0;
+}
+
+static void pcm_get_latency(struct pcm *pcm,
+			    struct msm_audio_latency_stats *stats)
+{
+	struct audio_latency l;
+
+	memset(stats, 0, sizeof(*stats));
+	mutex_lock(&pcm->lock);
+	if (pcm->ac)
+		l = pcm->ac->latency;
+	else
+		memset(&l, 0, sizeof(l));
+	mutex_unlock(&pcm->lock);
+
+	stats->periods = l.periods;
+	stats->last_us = l.last_us;
+	stats->min_us = l.min_us;
+	stats->max_us = l.max_us;
+	if (l.periods)
+		stats->avg_us = (uint32_t) div_u64(l.total_us, l.periods);
+}
+
 static long pcm_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct pcm *pcm = file->private_data;
@@ -51,6 +123,18 @@ static long pcm_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		return 0;
 	}
 
+	/* may sleep on the DSP; keep it off pcm->lock like write() */
+	if (cmd == AUDIO_MMAP_SUBMIT)
+		return pcm_submit(file, pcm, (unsigned) arg);
+
+	if (cmd == AUDIO_GET_LATENCY_STATS) {
+		struct msm_audio_latency_stats stats;
+		pcm_get_latency(pcm, &stats);
+		if (copy_to_user((void *) arg, &stats, sizeof(stats)))
+			return -EFAULT;
+		return 0;
+	}
+
 	mutex_lock(&pcm->lock);
 	switch (cmd) {
 	case AUDIO_SET_VOLUME: {
@@ -71,16 +155,7 @@ static long pcm_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			rc = -EFAULT;
 			break;
 		}
-		if (pcm->ac) {
-			rc = -EBUSY;
-		} else {
-			pcm->ac = q6audio_open_pcm(pcm->buffer_size,
-						pcm->sample_rate,
-						pcm->channel_count,
-						AUDIO_FLAG_WRITE, acdb_id);
-			if (!pcm->ac)
-				rc = -ENOMEM;
-		}
+		rc = pcm_start(pcm, acdb_id);
 		break;
 	}
 	case AUDIO_STOP:
@@ -178,6 +253,8 @@ static ssize_t pcm_write(struct file *file, const char __user *buf,
 	ac = pcm->ac;
 	if (!ac)
 		return -ENODEV;
+	if (pcm->ctl)
+		return -EBUSY;
 
 	while (count > 0) {
 		ab = ac->buf + ac->cpu_buf;
@@ -208,11 +285,88 @@ static ssize_t pcm_write(struct file *file, const char __user *buf,
 	return buf - start;
 }
 
+/* Map the control page followed by both DSP buffers.  The buffers
+ * come from pmem in whole pages (see audio_client_alloc), so nothing
+ * beyond them is exposed.  Once mapped, playback goes through
+ * AUDIO_MMAP_SUBMIT and write() is refused.
+ */
+static int pcm_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct pcm *pcm = file->private_data;
+	struct audio_client *ac;
+	struct msm_audio_mmap_ctl *ctl;
+	unsigned long len, buflen;
+	int n, rc = 0;
+
+	mutex_lock(&pcm->lock);
+	if (!pcm->ac)
+		rc = pcm_start(pcm, 0);
+	ac = pcm->ac;
+	if (rc)
+		goto done;
+
+	buflen = PAGE_ALIGN(ac->buf[0].size);
+	len = PAGE_SIZE + 2 * buflen;
+	if (!(vma->vm_flags & VM_SHARED) || vma->vm_pgoff != 0 ||
+	    vma->vm_end - vma->vm_start != len) {
+		rc = -EINVAL;
+		goto done;
+	}
+	if (pcm->ctl) {
+		rc = -EBUSY;
+		goto done;
+	}
+
+	ctl = (void *) get_zeroed_page(GFP_KERNEL);
+	if (!ctl) {
+		rc = -ENOMEM;
+		goto done;
+	}
+	ctl->period_size = ac->buf[0].size;
+	ctl->buf_offset[0] = PAGE_SIZE;
+	ctl->buf_offset[1] = PAGE_SIZE + buflen;
+
+	rc = remap_pfn_range(vma, vma->vm_start,
+			     virt_to_phys(ctl) >> PAGE_SHIFT,
+			     PAGE_SIZE, vma->vm_page_prot);
+	/* the DSP buffers are uncached on the kernel side too */
+	for (n = 0; n < 2 && !rc; n++)
+		rc = remap_pfn_range(vma, vma->vm_start + ctl->buf_offset[n],
+				     ac->buf[n].phys >> PAGE_SHIFT, buflen,
+				     pgprot_noncached(vma->vm_page_prot));
+	if (rc) {
+		free_page((unsigned long) ctl);
+		goto done;
+	}
+
+	pcm->ctl = ctl;
+	ac->hw_ptr = &ctl->hw_ptr;
+done:
+	mutex_unlock(&pcm->lock);
+	return rc;
+}
+
+static unsigned int pcm_poll(struct file *file, struct poll_table_struct *wait)
+{
+	struct pcm *pcm = file->private_data;
+	struct audio_client *ac = pcm->ac;
+
+	if (!ac)
+		return POLLOUT | POLLWRNORM;
+
+	poll_wait(file, &ac->wait, wait);
+	if (ac->buf[ac->cpu_buf].used == 0)
+		return POLLOUT | POLLWRNORM;
+	return 0;
+}
+
 static int pcm_release(struct inode *inode, struct file *file)
 {
 	struct pcm *pcm = file->private_data;
 	if (pcm->ac)
 		q6audio_close(pcm->ac);
+	if (pcm->ctl)
+		free_page((unsigned long) pcm->ctl);
 	kfree(pcm);
 	return 0;
 }
@@ -221,6 +375,8 @@ static struct file_operations pcm_fops = {
 	.owner		= THIS_MODULE,
 	.open		= pcm_open,
 	.write		= pcm_write,
+	.mmap		= pcm_mmap,
+	.poll		= pcm_poll,
 	.release	= pcm_release,
 	.unlocked_ioctl	= pcm_ioctl,
 };
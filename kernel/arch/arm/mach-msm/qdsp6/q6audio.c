@@ -205,34 +205,38 @@ int q6_device_volume(uint32_t device_id, int level)
 	return hw->min_gain + ((hw->max_gain - hw->min_gain) * level) / 100;
 }
 
-static inline int adie_open(struct dal_client *client) 
+/* The adie path calls below are only queued; callers bracket each
+ * path sequence with dal_batch_begin()/dal_batch_commit() so the whole
+ * sequence costs one round trip to the modem.
+ */
+static inline void adie_open(struct dal_client *client)
 {
-	return dal_call_f0(client, DAL_OP_OPEN, 0);
+	dal_batch_call_f0(client, DAL_OP_OPEN, 0);
 }
 
-static inline int adie_close(struct dal_client *client) 
+static inline void adie_close(struct dal_client *client)
 {
-	return dal_call_f0(client, DAL_OP_CLOSE, 0);
+	dal_batch_call_f0(client, DAL_OP_CLOSE, 0);
 }
 
-static inline int adie_set_path(struct dal_client *client,
-				uint32_t id, uint32_t path_type)
+static inline void adie_set_path(struct dal_client *client,
+				 uint32_t id, uint32_t path_type)
 {
-	return dal_call_f1(client, ADIE_OP_SET_PATH, id, path_type);
+	dal_batch_call_f1(client, ADIE_OP_SET_PATH, id, path_type);
 }
 
-static inline int adie_set_path_freq_plan(struct dal_client *client,
-					  uint32_t path_type, uint32_t plan) 
+static inline void adie_set_path_freq_plan(struct dal_client *client,
+					   uint32_t path_type, uint32_t plan)
 {
-	return dal_call_f1(client, ADIE_OP_SET_PATH_FREQUENCY_PLAN,
-			   path_type, plan);
+	dal_batch_call_f1(client, ADIE_OP_SET_PATH_FREQUENCY_PLAN,
+			  path_type, plan);
 }
 
-static inline int adie_proceed_to_stage(struct dal_client *client,
-					uint32_t path_type, uint32_t stage)
+static inline void adie_proceed_to_stage(struct dal_client *client,
+					 uint32_t path_type, uint32_t stage)
 {
-	return dal_call_f1(client, ADIE_OP_PROCEED_TO_STAGE,
-			   path_type, stage);
+	dal_batch_call_f1(client, ADIE_OP_PROCEED_TO_STAGE,
+			  path_type, stage);
 }
 
 static inline int adie_mute_path(struct dal_client *client,
@@ -331,12 +335,13 @@ static struct audio_client *audio_client_alloc(unsigned bufsz)
 	ac->session = n;
 
 	if (bufsz > 0) {
-		ac->buf[0].phys = pmem_kalloc(bufsz,
+		/* whole pages, so pcm_out can hand them to userspace */
+		ac->buf[0].phys = pmem_kalloc(PAGE_ALIGN(bufsz),
 					PMEM_MEMTYPE_EBI1|PMEM_ALIGNMENT_4K);
 		ac->buf[0].data = ioremap(ac->buf[0].phys, bufsz);
 		if (!ac->buf[0].data)
 			goto fail;
-		ac->buf[1].phys = pmem_kalloc(bufsz,
+		ac->buf[1].phys = pmem_kalloc(PAGE_ALIGN(bufsz),
 					PMEM_MEMTYPE_EBI1|PMEM_ALIGNMENT_4K);
 		ac->buf[1].data = ioremap(ac->buf[1].phys, bufsz);
 		if (!ac->buf[1].data)
@@ -678,6 +683,9 @@ int q6audio_write(struct audio_client *ac, struct audio_buffer *ab)
 	rpc.buffer.max_size = ab->size;
 	rpc.buffer.actual_size = ab->actual_size;
 
+	/* stamp before the call: BUF_DONE may beat dal_call() back */
+	ab->submitted = ktime_get();
+
 	TRACE("%p: write\n", ac);
 	r = dal_call(ac->client, AUDIO_OP_DATA, 5, &rpc, sizeof(rpc),
 		     &res, sizeof(res));
@@ -744,6 +752,22 @@ static int audio_stream_mute(struct audio_client *ac, int mute)
 	return rc;
 }
 
+static void audio_latency_update(struct audio_client *ac,
+				 struct audio_buffer *ab)
+{
+	struct audio_latency *l = &ac->latency;
+	uint32_t us;
+
+	us = (uint32_t) ktime_us_delta(ktime_get(), ab->submitted);
+	if (!l->periods || us < l->min_us)
+		l->min_us = us;
+	if (us > l->max_us)
+		l->max_us = us;
+	l->last_us = us;
+	l->total_us += us;
+	l->periods++;
+}
+
 static void callback(void *data, int len, void *cookie)
 {
 	struct adsp_event_hdr *e = data;
@@ -779,8 +803,12 @@ static void callback(void *data, int len, void *cookie)
 			pr_err("buffer status %d\n", e->status);
 
 		ac->buf[ac->dsp_buf].actual_size = abe->buffer.actual_size;
+		if (ac->flags & AUDIO_FLAG_WRITE)
+			audio_latency_update(ac, ac->buf + ac->dsp_buf);
 		ac->buf[ac->dsp_buf].used = 0;
 		ac->dsp_buf ^= 1;
+		if (ac->hw_ptr)
+			(*ac->hw_ptr)++;
 		wake_up(&ac->wait);
 		return;
 	}
@@ -1056,6 +1084,7 @@ static int audio_update_acdb(uint32_t adev, uint32_t acdb_id)
 static void adie_rx_path_enable(uint32_t acdb_id)
 {
 	if (audio_rx_path_id) {
+		dal_batch_begin(adie);
 		adie_enable();
 		adie_set_path(adie, audio_rx_path_id, ADIE_PATH_RX);
 		adie_set_path_freq_plan(adie, ADIE_PATH_RX, 48000);
@@ -1064,6 +1093,7 @@ static void adie_rx_path_enable(uint32_t acdb_id)
 				ADIE_STAGE_DIGITAL_READY);
 		adie_proceed_to_stage(adie, ADIE_PATH_RX,
 				ADIE_STAGE_DIGITAL_ANALOG_READY);
+		dal_batch_commit(adie);
 	}
 }
 
@@ -1089,6 +1119,7 @@ static void _audio_tx_path_enable(int reconf, uint32_t acdb_id)
 	audio_tx_analog_enable(1);
 
 	if (audio_tx_path_id) {
+		dal_batch_begin(adie);
 		adie_enable();
 		adie_set_path(adie, audio_tx_path_id, ADIE_PATH_TX);
 
@@ -1103,6 +1134,7 @@ static void _audio_tx_path_enable(int reconf, uint32_t acdb_id)
 				ADIE_STAGE_DIGITAL_READY);
 		adie_proceed_to_stage(adie, ADIE_PATH_TX,
 				ADIE_STAGE_DIGITAL_ANALOG_READY);
+		dal_batch_commit(adie);
 	}
 
 	audio_update_acdb(audio_tx_device_id, acdb_id);
@@ -1121,11 +1153,13 @@ static void _audio_rx_path_disable(void)
 	audio_rx_analog_enable(0);
 
 	if (audio_rx_path_id) {
+		dal_batch_begin(adie);
 		adie_proceed_to_stage(adie, ADIE_PATH_RX,
 				ADIE_STAGE_ANALOG_OFF);
 		adie_proceed_to_stage(adie, ADIE_PATH_RX,
 				ADIE_STAGE_DIGITAL_OFF);
 		adie_disable();
+		dal_batch_commit(adie);
 	}
 }
 
@@ -1134,11 +1168,13 @@ static void _audio_tx_path_disable(void)
 	audio_tx_analog_enable(0);
 
 	if (audio_tx_path_id) {
+		dal_batch_begin(adie);
 		adie_proceed_to_stage(adie, ADIE_PATH_TX,
 				ADIE_STAGE_ANALOG_OFF);
 		adie_proceed_to_stage(adie, ADIE_PATH_TX,
 				ADIE_STAGE_DIGITAL_OFF);
 		adie_disable();
+		dal_batch_commit(adie);
 	}
 }
 
@@ -252,6 +252,7 @@ struct smd_channel {
 
 	int (*read)(smd_channel_t *ch, void *data, int len);
 	int (*write)(smd_channel_t *ch, const void *data, int len);
+	int (*write_nonotify)(smd_channel_t *ch, const void *data, int len);
 	int (*read_avail)(smd_channel_t *ch);
 	int (*write_avail)(smd_channel_t *ch);
 	int (*read_from_cb)(smd_channel_t *ch, void *data, int len);
@@ -623,7 +624,8 @@ static int smd_is_packet(struct smd_alloc_elm *alloc_elm)
 		return 0;
 }
 
-static int smd_stream_write(smd_channel_t *ch, const void *_data, int len)
+static int __smd_stream_write(smd_channel_t *ch, const void *_data, int len,
+			      int notify)
 {
 	void *ptr;
 	const unsigned char *buf = _data;
@@ -649,13 +651,25 @@ static int smd_stream_write(smd_channel_t *ch, const void *_data, int len)
 			break;
 	}
 
-	if (orig_len - len)
+	if (notify && (orig_len - len))
 		ch->notify_other_cpu();
 
 	return orig_len - len;
 }
 
-static int smd_packet_write(smd_channel_t *ch, const void *_data, int len)
+static int smd_stream_write(smd_channel_t *ch, const void *data, int len)
+{
+	return __smd_stream_write(ch, data, len, 1);
+}
+
+static int smd_stream_write_nonotify(smd_channel_t *ch, const void *data,
+				     int len)
+{
+	return __smd_stream_write(ch, data, len, 0);
+}
+
+static int __smd_packet_write(smd_channel_t *ch, const void *_data, int len,
+			      int notify)
 {
 	int ret;
 	unsigned hdr[5];
@@ -673,7 +687,8 @@ static int smd_packet_write(smd_channel_t *ch, const void *_data, int len)
 	hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
 
 
-	ret = smd_stream_write(ch, hdr, sizeof(hdr));
+	/* one signal for header and payload */
+	ret = __smd_stream_write(ch, hdr, sizeof(hdr), 0);
 	if (ret < 0 || ret != sizeof(hdr)) {
 		SMD_DBG("%s failed to write pkt header: "
 			"%d returned\n", __func__, ret);
@@ -681,7 +696,7 @@ static int smd_packet_write(smd_channel_t *ch, const void *_data, int len)
 	}
 
 
-	ret = smd_stream_write(ch, _data, len);
+	ret = __smd_stream_write(ch, _data, len, notify);
 	if (ret < 0 || ret != len) {
 		SMD_DBG("%s failed to write pkt data: "
 			"%d returned\n", __func__, ret);
@@ -691,6 +706,17 @@ static int smd_packet_write(smd_channel_t *ch, const void *_data, int len)
 	return len;
 }
 
+static int smd_packet_write(smd_channel_t *ch, const void *data, int len)
+{
+	return __smd_packet_write(ch, data, len, 1);
+}
+
+static int smd_packet_write_nonotify(smd_channel_t *ch, const void *data,
+				     int len)
+{
+	return __smd_packet_write(ch, data, len, 0);
+}
+
 static int smd_stream_read(smd_channel_t *ch, void *data, int len)
 {
 	int r;
@@ -821,6 +847,7 @@ static int smd_alloc_channel(struct smd_alloc_elm *alloc_elm)
 	if (smd_is_packet(alloc_elm)) {
 		ch->read = smd_packet_read;
 		ch->write = smd_packet_write;
+		ch->write_nonotify = smd_packet_write_nonotify;
 		ch->read_avail = smd_packet_read_avail;
 		ch->write_avail = smd_packet_write_avail;
 		ch->update_state = update_packet_state;
@@ -828,6 +855,7 @@ static int smd_alloc_channel(struct smd_alloc_elm *alloc_elm)
 	} else {
 		ch->read = smd_stream_read;
 		ch->write = smd_stream_write;
+		ch->write_nonotify = smd_stream_write_nonotify;
 		ch->read_avail = smd_stream_read_avail;
 		ch->write_avail = smd_stream_write_avail;
 		ch->update_state = update_stream_state;
@@ -888,6 +916,7 @@ static int smd_alloc_loopback_channel(void)
 
 	ch->read = smd_stream_read;
 	ch->write = smd_stream_write;
+	ch->write_nonotify = smd_stream_write_nonotify;
 	ch->read_avail = smd_stream_read_avail;
 	ch->write_avail = smd_stream_write_avail;
 	ch->update_state = update_stream_state;
@@ -1044,6 +1073,18 @@ int smd_write(smd_channel_t *ch, const void *data, int len)
 }
 EXPORT_SYMBOL(smd_write);
 
+int smd_write_nonotify(smd_channel_t *ch, const void *data, int len)
+{
+	return ch->write_nonotify(ch, data, len);
+}
+EXPORT_SYMBOL(smd_write_nonotify);
+
+void smd_notify_other_cpu(smd_channel_t *ch)
+{
+	ch->notify_other_cpu();
+}
+EXPORT_SYMBOL(smd_notify_other_cpu);
+
 int smd_read_avail(smd_channel_t *ch)
 {
 	return ch->read_avail(ch);
@@ -22,6 +22,8 @@
 #include <linux/wait.h>
 #include <linux/delay.h>
 #include <linux/wakelock.h>
+#include <linux/bitops.h>
+#include <linux/debugfs.h>
 
 #include <linux/tty.h>
 #include <linux/tty_driver.h>
@@ -32,60 +34,118 @@
 
 #define MAX_SMD_TTYS 37
 
-static DEFINE_MUTEX(smd_tty_lock);
+/* smd_tty_info rx_flags */
+#define RX_DRAINING	0	/* someone is emptying the FIFO */
+#define RX_PENDING	1	/* more data was signalled meanwhile */
+#define RX_PUSH		2	/* notify filled the flip buffer */
 
 struct smd_tty_info {
 	smd_channel_t *ch;
 	struct tty_struct *tty;
 	struct wake_lock wake_lock;
 	int open_count;
+	struct mutex lock;
+	unsigned long rx_flags;
 	struct work_struct tty_work;
+	struct workqueue_struct *wq;
+	char wq_name[16];
+
+	/* statistics, reported in debugfs */
+	unsigned long rx_bytes;
+	unsigned long tx_bytes;
+	unsigned long notifies;
+	unsigned long drains;
 };
 
 static struct smd_tty_info smd_tty[MAX_SMD_TTYS];
-static struct workqueue_struct *smd_tty_wq;
 
-static void smd_tty_work_func(struct work_struct *work)
+/* Read straight into the tty from the SMD interrupt instead of the
+ * port's workqueue, so the FIFO is freed before the thread runs. */
+static int rx_in_notify;
+module_param(rx_in_notify, bool, S_IRUGO | S_IWUSR);
+
+/*
+ * Empty the SMD FIFO into the tty flip buffer, across the ring wrap
+ * and any data that arrives while we copy, in a single pass.  Only
+ * the holder of RX_DRAINING gets here.
+ */
+static int smd_tty_drain(struct smd_tty_info *info, int from_cb)
 {
-	unsigned char *ptr;
-	int avail;
-	struct smd_tty_info *info = container_of(work,
-						struct smd_tty_info,
-						tty_work);
 	struct tty_struct *tty = info->tty;
+	unsigned char *ptr;
+	int avail, n, total = 0;
 
-	if (!tty)
-		return;
-
-	for (;;) {
-		if (test_bit(TTY_THROTTLED, &tty->flags)) break;
-
-		mutex_lock(&smd_tty_lock);
-		if (info->ch == 0) {
-			mutex_unlock(&smd_tty_lock);
-			break;
-		}
-
-		avail = smd_read_avail(info->ch);
-		if (avail == 0) {
-			mutex_unlock(&smd_tty_lock);
+	avail = smd_read_avail(info->ch);
+	while (avail > 0 && !test_bit(TTY_THROTTLED, &tty->flags)) {
+		n = tty_prepare_flip_string(tty, &ptr, avail);
+		if (n <= 0)
 			break;
-		}
 
-		avail = tty_prepare_flip_string(tty, &ptr, avail);
-
-		if (smd_read(info->ch, ptr, avail) != avail) {
-			/* shouldn't be possible since we're in interrupt
-			** context here and nobody else could 'steal' our
-			** characters.
+		if (from_cb)
+			avail = smd_read_from_cb(info->ch, ptr, n);
+		else
+			avail = smd_read(info->ch, ptr, n);
+		if (avail != n) {
+			/* shouldn't be possible since only the
+			** drainer reads and nobody else could
+			** 'steal' our characters.
 			*/
 			printk(KERN_ERR "OOPS - smd_tty_buffer mismatch?!");
 		}
-		mutex_unlock(&smd_tty_lock);
+		total += n;
+		avail = smd_read_avail(info->ch);
+	}
+
+	info->rx_bytes += total;
+	info->drains++;
+	return total;
+}
 
+/*
+ * Drain the port from either the notify callback or the workqueue,
+ * which may nest.  Whoever finds a drain in progress flags it as
+ * pending and the drainer goes round again.
+ */
+static int smd_tty_rx(struct smd_tty_info *info, int from_cb)
+{
+	int total = 0;
+
+again:
+	if (test_and_set_bit(RX_DRAINING, &info->rx_flags)) {
+		set_bit(RX_PENDING, &info->rx_flags);
+		return total;
+	}
+	do {
+		clear_bit(RX_PENDING, &info->rx_flags);
+		total += smd_tty_drain(info, from_cb);
+	} while (test_bit(RX_PENDING, &info->rx_flags));
+	clear_bit(RX_DRAINING, &info->rx_flags);
+
+	if (test_bit(RX_PENDING, &info->rx_flags))
+		goto again;
+	return total;
+}
+
+static void smd_tty_work_func(struct work_struct *work)
+{
+	struct smd_tty_info *info = container_of(work,
+						struct smd_tty_info,
+						tty_work);
+	struct tty_struct *tty;
+
+	mutex_lock(&info->lock);
+	tty = info->tty;
+	if (!tty || info->ch == 0) {
+		mutex_unlock(&info->lock);
+		return;
+	}
+
+	if (smd_tty_rx(info, 0) ||
+	    test_and_clear_bit(RX_PUSH, &info->rx_flags)) {
 		wake_lock_timeout(&info->wake_lock, HZ / 2);
 		tty_flip_buffer_push(tty);
 	}
+	mutex_unlock(&info->lock);
 
 	/* XXX only when writable and necessary */
 	tty_wakeup(tty);
@@ -98,7 +158,18 @@ static void smd_tty_notify(void *priv, unsigned event)
 	if (event != SMD_EVENT_DATA)
 		return;
 
-	queue_work(smd_tty_wq, &info->tty_work);
+	info->notifies++;
+
+	/* smd_lock is held here, so smd_close() cannot race with us.
+	 * flush_to_ldisc() cannot run in interrupt context, so the work
+	 * pushes what we drained; tty_schedule_flip() would wait a tick.
+	 */
+	if (rx_in_notify && info->tty && smd_tty_rx(info, 1)) {
+		wake_lock_timeout(&info->wake_lock, HZ / 2);
+		set_bit(RX_PUSH, &info->rx_flags);
+	}
+
+	queue_work(info->wq, &info->tty_work);
 }
 
 static int smd_tty_open(struct tty_struct *tty, struct file *f)
@@ -122,8 +193,10 @@ static int smd_tty_open(struct tty_struct *tty, struct file *f)
 		return -ENODEV;
 
 	info = smd_tty + n;
+	if (!info->wq)
+		return -ENODEV;
 
-	mutex_lock(&smd_tty_lock);
+	mutex_lock(&info->lock);
 	tty->driver_data = info;
 
 	if (info->open_count++ == 0) {
@@ -146,7 +219,7 @@ static int smd_tty_open(struct tty_struct *tty, struct file *f)
 				       smd_tty_notify);
 		}
 	}
-	mutex_unlock(&smd_tty_lock);
+	mutex_unlock(&info->lock);
 
 	return res;
 }
@@ -158,17 +231,18 @@ static void smd_tty_close(struct tty_struct *tty, struct file *f)
 	if (info == 0)
 		return;
 
-	mutex_lock(&smd_tty_lock);
+	mutex_lock(&info->lock);
 	if (--info->open_count == 0) {
-		info->tty = 0;
-		tty->driver_data = 0;
-		wake_lock_destroy(&info->wake_lock);
+		/* close the channel first so no notify can see the tty */
 		if (info->ch) {
 			smd_close(info->ch);
 			info->ch = 0;
 		}
+		info->tty = 0;
+		tty->driver_data = 0;
+		wake_lock_destroy(&info->wake_lock);
 	}
-	mutex_unlock(&smd_tty_lock);
+	mutex_unlock(&info->lock);
 }
 
 static int smd_tty_write(struct tty_struct *tty, const unsigned char *buf, int len)
@@ -184,7 +258,10 @@ static int smd_tty_write(struct tty_struct *tty, const unsigned char *buf, int l
 	if (len > avail)
 		len = avail;
 
-	return smd_write(info->ch, buf, len);
+	len = smd_write(info->ch, buf, len);
+	if (len > 0)
+		info->tx_bytes += len;
+	return len;
 }
 
 static int smd_tty_write_room(struct tty_struct *tty)
@@ -202,7 +279,7 @@ static int smd_tty_chars_in_buffer(struct tty_struct *tty)
 static void smd_tty_unthrottle(struct tty_struct *tty)
 {
 	struct smd_tty_info *info = tty->driver_data;
-	queue_work(smd_tty_wq, &info->tty_work);
+	queue_work(info->wq, &info->tty_work);
 	return;
 }
 
@@ -234,19 +311,86 @@ static struct tty_operations smd_tty_ops = {
 
 static struct tty_driver *smd_tty_driver;
 
-static int __init smd_tty_init(void)
+#if defined(CONFIG_DEBUG_FS)
+#define DEBUG_BUFMAX 1024
+static char debug_buffer[DEBUG_BUFMAX];
+
+static ssize_t smd_tty_debug_read(struct file *file, char __user *buf,
+				  size_t count, loff_t *ppos)
+{
+	struct smd_tty_info *info;
+	int n, i = 0;
+
+	for (n = 0; n < MAX_SMD_TTYS; n++) {
+		info = smd_tty + n;
+		if (!info->wq)
+			continue;
+		i += scnprintf(debug_buffer + i, DEBUG_BUFMAX - i,
+			       "smd%d: open %d rx %lu tx %lu notifies %lu "
+			       "drains %lu\n", n, info->open_count,
+			       info->rx_bytes, info->tx_bytes,
+			       info->notifies, info->drains);
+	}
+	return simple_read_from_buffer(buf, count, ppos, debug_buffer, i);
+}
+
+static const struct file_operations smd_tty_debug_ops = {
+	.read = smd_tty_debug_read,
+};
+
+static void smd_tty_debugfs_init(void)
 {
-	int ret;
+	struct dentry *dent;
+
+	dent = debugfs_create_dir("smd_tty", 0);
+	if (IS_ERR(dent))
+		return;
 
-	smd_tty_wq = create_singlethread_workqueue("smd_tty");
-	if (smd_tty_wq == 0)
+	debugfs_create_file("stats", 0444, dent, 0, &smd_tty_debug_ops);
+}
+#else
+static void smd_tty_debugfs_init(void) { }
+#endif
+
+/* Each port drains on its own thread so busy channels don't stall
+ * the others. */
+static int __init smd_tty_port_init(int n)
+{
+	struct smd_tty_info *info = smd_tty + n;
+
+	mutex_init(&info->lock);
+	INIT_WORK(&info->tty_work, smd_tty_work_func);
+	snprintf(info->wq_name, sizeof(info->wq_name), "smd_tty%d", n);
+	info->wq = create_singlethread_workqueue(info->wq_name);
+	if (info->wq == 0)
 		return -ENOMEM;
 
+	tty_register_device(smd_tty_driver, n, 0);
+	return 0;
+}
+
+static void __init smd_tty_port_exit(int n)
+{
+	struct smd_tty_info *info = smd_tty + n;
+
+	if (info->wq == 0)
+		return;
+
+	tty_unregister_device(smd_tty_driver, n);
+	destroy_workqueue(info->wq);
+	info->wq = 0;
+}
+
+/* this should be dynamic */
+static const int smd_tty_ports[] = { 0, 7, 27, 36, 21 };
+
+static int __init smd_tty_init(void)
+{
+	int ret, i;
+
 	smd_tty_driver = alloc_tty_driver(MAX_SMD_TTYS);
-	if (smd_tty_driver == 0) {
-		destroy_workqueue(smd_tty_wq);
+	if (smd_tty_driver == 0)
 		return -ENOMEM;
-	}
 
 	smd_tty_driver->owner = THIS_MODULE;
 	smd_tty_driver->driver_name = "smd_tty_driver";
@@ -265,25 +409,29 @@ static int __init smd_tty_init(void)
 	tty_set_operations(smd_tty_driver, &smd_tty_ops);
 
 	ret = tty_register_driver(smd_tty_driver);
-	if (ret) return ret;
-
-	/* this should be dynamic */
-	tty_register_device(smd_tty_driver, 0, 0);
-	INIT_WORK(&smd_tty[0].tty_work, smd_tty_work_func);
-
-	tty_register_device(smd_tty_driver, 7, 0);
-	INIT_WORK(&smd_tty[7].tty_work, smd_tty_work_func);
-
-	tty_register_device(smd_tty_driver, 27, 0);
-	INIT_WORK(&smd_tty[27].tty_work, smd_tty_work_func);
-
-	tty_register_device(smd_tty_driver, 36, 0);
-	INIT_WORK(&smd_tty[36].tty_work, smd_tty_work_func);
+	if (ret) {
+		put_tty_driver(smd_tty_driver);
+		return ret;
+	}
 
-	tty_register_device(smd_tty_driver, 21, 0);
-	INIT_WORK(&smd_tty[21].tty_work, smd_tty_work_func);
+	for (i = 0; i < ARRAY_SIZE(smd_tty_ports); i++) {
+		ret = smd_tty_port_init(smd_tty_ports[i]);
+		if (ret) {
+			printk(KERN_ERR "smd_tty: can't init port %d (%d)\n",
+			       smd_tty_ports[i], ret);
+			goto err;
+		}
+	}
 
+	smd_tty_debugfs_init();
 	return 0;
+
+err:
+	while (--i >= 0)
+		smd_tty_port_exit(smd_tty_ports[i]);
+	tty_unregister_driver(smd_tty_driver);
+	put_tty_driver(smd_tty_driver);
+	return ret;
 }
 
 module_init(smd_tty_init);
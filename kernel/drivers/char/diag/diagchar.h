@@ -35,6 +35,7 @@
 #include <linux/mutex.h>
 #include <linux/workqueue.h>
 #include <mach/msm_smd.h>
+#include <mach/usbdiag.h>
 #include <asm/atomic.h>
 
 /* Size of the USB buffers used for read and write*/
@@ -47,6 +48,11 @@
 #define POOL_TYPE_COPY 1
 #define POOL_TYPE_HDLC 0
 #define POOL_TYPE_USB_STRUCT 2
+#define NUM_POOL_TYPES 3
+/* Pools double on demand up to this many times their initial size */
+#define POOL_GROW_MAX 4
+/* Number of USB writes that can be in flight for each SMD channel */
+#define N_USB_IN_BUFS 4
 /* Number of maximum USB requests that the USB layer should handle at
    one time. */
 #define MAX_DIAG_USB_REQUESTS 12
@@ -65,6 +71,21 @@ struct diag_master_table {
 };
 
 
+/* Forwarding state for one SMD diag channel */
+struct diag_smd_fwd {
+	smd_channel_t *ch;
+	unsigned long flags;		/* SMD_FWD_* bits */
+	unsigned long in_busy;		/* bit n set while buf_in[n] is on USB */
+	unsigned char *buf_in[N_USB_IN_BUFS];
+	struct diag_request write_req[N_USB_IN_BUFS];
+	/* statistics, reported in debugfs */
+	unsigned long smd_pkts;
+	unsigned long usb_writes;
+	unsigned long bytes;
+	unsigned long stalls;		/* data waiting but all buffers busy */
+	unsigned long dropped;		/* packets discarded */
+};
+
 struct diagchar_dev {
 
 	/* State for the char driver */
@@ -87,6 +108,9 @@ struct diagchar_dev {
 	unsigned int poolsize_hdlc;
 	unsigned int itemsize_usb_struct;
 	unsigned int poolsize_usb_struct;
+	unsigned int poolsize_max;
+	unsigned int poolsize_hdlc_max;
+	unsigned int poolsize_usb_struct_max;
 	unsigned int debug_flag;
 	/* State for the mempool for the char driver */
 	mempool_t *diagpool;
@@ -96,16 +120,16 @@ struct diagchar_dev {
 	int count;
 	int count_hdlc_pool;
 	int count_usb_struct_pool;
+	unsigned long pool_grows[NUM_POOL_TYPES];
+	unsigned long pool_fails[NUM_POOL_TYPES];
 	int used;
 
 	/* State for diag forwarding */
-	unsigned char *usb_buf_in;
-	unsigned char *usb_buf_in_qdsp;
+	struct diag_smd_fwd modem;
+	struct diag_smd_fwd qdsp;
 	unsigned char *usb_buf_out;
-	smd_channel_t *ch;
-	smd_channel_t *chqdsp;
-	int in_busy;
-	int in_busy_qdsp;
+	unsigned long connect_jiffies;
+	unsigned long connect_bytes;
 	int read_len;
 	unsigned char *hdlc_buf;
 	unsigned hdlc_count;
@@ -120,10 +144,8 @@ struct diagchar_dev {
 	struct diag_master_table *table;
 	uint8_t *pkt_buf;
 	int pkt_length;
-	struct diag_request *usb_write_ptr;
 	struct diag_request *usb_read_ptr;
 	struct diag_request *usb_write_ptr_svc;
-	struct diag_request *usb_write_ptr_qdsp;
 };
 
 extern struct diagchar_dev *driver;
@@ -107,6 +107,45 @@ static uint16_t delayed_rsp_id = 1;
 #define DIAGPKT_NEXT_DELAYED_RSP_ID(x) \
 ((x < DIAGPKT_MAX_DELAYED_RSP) ? x++ : DIAGPKT_MAX_DELAYED_RSP)
 
+/*
+ * Queue the aggregated HDLC buffer to USB.  Called with diagchar_mutex
+ * held; buf_hdlc is always consumed, and freed if it could not be sent.
+ */
+static int diag_flush_hdlc(void)
+{
+	struct diag_request *req;
+	int err;
+
+	req = diagmem_alloc(driver, sizeof(struct diag_request),
+			    POOL_TYPE_USB_STRUCT);
+	if (!req) {
+		err = -ENOMEM;
+		goto fail;
+	}
+	req->buf = buf_hdlc;
+	req->length = driver->used;
+	err = diag_write(req);
+	if (err) {
+		diagmem_free(driver, (unsigned char *)req,
+			     POOL_TYPE_USB_STRUCT);
+		goto fail;
+	}
+	driver->usb_write_ptr_svc = req;
+#ifdef DIAG_DEBUG
+	printk(KERN_INFO "\n size written is %d\n", driver->used);
+#endif
+	goto out;
+
+fail:
+	/*Free the buffer right away if write failed */
+	diagmem_free(driver, buf_hdlc, POOL_TYPE_HDLC);
+	driver->dropped_count++;
+out:
+	buf_hdlc = NULL;
+	driver->used = 0;
+	return err;
+}
+
 static void drain_timer_func(unsigned long data)
 {
 	queue_work(driver->diag_wq , &(driver->diag_drain_work));
@@ -117,20 +156,8 @@ void diag_drain_work_fn(struct work_struct *work)
 	timer_in_progress = 0;
 
 	mutex_lock(&driver->diagchar_mutex);
-	if (buf_hdlc) {
-		driver->usb_write_ptr_svc = (struct diag_request *)
-			(diagmem_alloc(driver, sizeof(struct diag_request),
-				 POOL_TYPE_USB_STRUCT));
-		driver->usb_write_ptr_svc->buf = buf_hdlc;
-		driver->usb_write_ptr_svc->length = driver->used;
-		diag_write(driver->usb_write_ptr_svc);
-		buf_hdlc = NULL;
-#ifdef DIAG_DEBUG
-		printk(KERN_INFO "\n Number of bytes written "
-				 "from timer is %d ", driver->used);
-#endif
-		driver->used = 0;
-	}
+	if (buf_hdlc)
+		diag_flush_hdlc();
 	mutex_unlock(&driver->diagchar_mutex);
 }
 
@@ -418,25 +445,10 @@ static int diagchar_write(struct file *file, const char __user *buf,
 		goto fail_free_hdlc;
 	}
 	if (HDLC_OUT_BUF_SIZE - driver->used <= (2*payload_size) + 3) {
-		driver->usb_write_ptr_svc = (struct diag_request *)
-			(diagmem_alloc(driver, sizeof(struct diag_request),
-				POOL_TYPE_USB_STRUCT));
-		driver->usb_write_ptr_svc->buf = buf_hdlc;
-		driver->usb_write_ptr_svc->length = driver->used;
-		err = diag_write(driver->usb_write_ptr_svc);
-		if (err) {
-			/*Free the buffer right away if write failed */
-			diagmem_free(driver, buf_hdlc, POOL_TYPE_HDLC);
-			diagmem_free(driver, (unsigned char *)driver->
-				 usb_write_ptr_svc, POOL_TYPE_USB_STRUCT);
+		if (diag_flush_hdlc()) {
 			ret = -EIO;
 			goto fail_free_hdlc;
 		}
-		buf_hdlc = NULL;
-#ifdef DIAG_DEBUG
-		printk(KERN_INFO "\n size written is %d\n", driver->used);
-#endif
-		driver->used = 0;
 		buf_hdlc = diagmem_alloc(driver, HDLC_OUT_BUF_SIZE,
 							 POOL_TYPE_HDLC);
 		if (!buf_hdlc) {
@@ -454,25 +466,10 @@ static int diagchar_write(struct file *file, const char __user *buf,
 	and start aggregation in a newly allocated buffer */
 	if ((unsigned int) enc.dest >=
 		 (unsigned int)(buf_hdlc + HDLC_OUT_BUF_SIZE)) {
-		driver->usb_write_ptr_svc = (struct diag_request *)
-			(diagmem_alloc(driver, sizeof(struct diag_request),
-				POOL_TYPE_USB_STRUCT));
-		driver->usb_write_ptr_svc->buf = buf_hdlc;
-		driver->usb_write_ptr_svc->length = driver->used;
-		err = diag_write(driver->usb_write_ptr_svc);
-		if (err) {
-			/*Free the buffer right away if write failed */
-			diagmem_free(driver, buf_hdlc, POOL_TYPE_HDLC);
-			diagmem_free(driver, (unsigned char *)driver->
-				 usb_write_ptr_svc, POOL_TYPE_USB_STRUCT);
+		if (diag_flush_hdlc()) {
 			ret = -EIO;
 			goto fail_free_hdlc;
 		}
-		buf_hdlc = NULL;
-#ifdef DIAG_DEBUG
-		printk(KERN_INFO "\n size written is %d\n", driver->used);
-#endif
-		driver->used = 0;
 		buf_hdlc = diagmem_alloc(driver, HDLC_OUT_BUF_SIZE,
 							 POOL_TYPE_HDLC);
 		if (!buf_hdlc) {
@@ -487,25 +484,10 @@ static int diagchar_write(struct file *file, const char __user *buf,
 
 	driver->used = (uint32_t) enc.dest - (uint32_t) buf_hdlc;
 	if (pkt_type == DATA_TYPE_RESPONSE) {
-		driver->usb_write_ptr_svc = (struct diag_request *)
-			(diagmem_alloc(driver, sizeof(struct diag_request),
-				 POOL_TYPE_USB_STRUCT));
-		driver->usb_write_ptr_svc->buf = buf_hdlc;
-		driver->usb_write_ptr_svc->length = driver->used;
-		err = diag_write(driver->usb_write_ptr_svc);
-		if (err) {
-			/*Free the buffer right away if write failed */
-			diagmem_free(driver, buf_hdlc, POOL_TYPE_HDLC);
-			diagmem_free(driver, (unsigned char *)driver->
-				 usb_write_ptr_svc, POOL_TYPE_USB_STRUCT);
+		if (diag_flush_hdlc()) {
 			ret = -EIO;
 			goto fail_free_hdlc;
 		}
-		buf_hdlc = NULL;
-#ifdef DIAG_DEBUG
-		printk(KERN_INFO "\n size written is %d\n", driver->used);
-#endif
-		driver->used = 0;
 	}
 
 	mutex_unlock(&driver->diagchar_mutex);
@@ -603,9 +585,14 @@ static int __init diagchar_init(void)
 		driver->poolsize_hdlc = poolsize_hdlc;
 		driver->itemsize_usb_struct = itemsize_usb_struct;
 		driver->poolsize_usb_struct = poolsize_usb_struct;
+		driver->poolsize_max = POOL_GROW_MAX * poolsize;
+		driver->poolsize_hdlc_max = POOL_GROW_MAX * poolsize_hdlc;
+		driver->poolsize_usb_struct_max =
+			POOL_GROW_MAX * poolsize_usb_struct;
 		driver->num_clients = max_clients;
 		mutex_init(&driver->diagchar_mutex);
 		init_waitqueue_head(&driver->wait_q);
+		diag_hdlc_init();
 		diagfwd_init();
 		INIT_WORK(&(driver->diag_drain_work), diag_drain_work_fn);
 		printk(KERN_INFO "diagchar initializing ..\n");
@@ -62,6 +62,7 @@
 #include <linux/device.h>
 #include <linux/uaccess.h>
 #include <linux/crc-ccitt.h>
+#include <asm/unaligned.h>
 #include "diagchar_hdlc.h"
 
 
@@ -72,6 +73,79 @@ MODULE_LICENSE("GPL v2");
 #define CRC_16_L_STEP(xx_crc, xx_c) \
 	crc_ccitt_byte(xx_crc, xx_c)
 
+/* Nonzero if any byte of the 32-bit word x is zero */
+#define HAS_ZERO_BYTE(x) \
+	(((x) - 0x01010101UL) & ~(x) & 0x80808080UL)
+
+#define ESC_CHAR_X4     0x7D7D7D7DUL
+#define CONTROL_CHAR_X4 0x7E7E7E7EUL
+
+/* Nonzero if the 32-bit word x holds no ESC_CHAR or CONTROL_CHAR */
+#define HDLC_PLAIN_WORD(x) \
+	(!HAS_ZERO_BYTE((x) ^ ESC_CHAR_X4) && \
+	 !HAS_ZERO_BYTE((x) ^ CONTROL_CHAR_X4))
+
+/*
+ * crc_ccitt_table advanced by one to three more zero bytes, so that the
+ * encoder can fold four plain bytes into the CRC with independent table
+ * lookups instead of a chain of four.
+ */
+static uint16_t hdlc_crc_table[3][256];
+
+void __init diag_hdlc_init(void)
+{
+	uint16_t crc;
+	int i, k;
+
+	for (i = 0; i < 256; i++) {
+		crc = crc_ccitt_table[i];
+		for (k = 0; k < 3; k++) {
+			crc = CRC_16_L_STEP(crc, 0);
+			hdlc_crc_table[k][i] = crc;
+		}
+	}
+}
+
+/* CRC over the four bytes of w, least significant first */
+static inline uint16_t hdlc_crc_word(uint16_t crc, uint32_t w)
+{
+	w ^= crc;
+	return hdlc_crc_table[2][w & 0xFF] ^
+	       hdlc_crc_table[1][(w >> 8) & 0xFF] ^
+	       hdlc_crc_table[0][(w >> 16) & 0xFF] ^
+	       crc_ccitt_table[w >> 24];
+}
+
+/*
+ * Return the number of leading bytes of p[0..len) that need neither
+ * escaping nor special handling, checking a word at a time so that
+ * the decoder can copy runs of plain data in bulk.  Kept out of line:
+ * inlined, it slows down the decoder's escape path.
+ */
+static noinline unsigned int hdlc_plain_run(const uint8_t *p,
+					    unsigned int len)
+{
+	unsigned int i = 0;
+	uint32_t w;
+
+	while (i < len && ((unsigned long)(p + i) & 3)) {
+		if (p[i] == ESC_CHAR || p[i] == CONTROL_CHAR)
+			return i;
+		i++;
+	}
+
+	for (; i + 4 <= len; i += 4) {
+		w = *(const uint32_t *)(p + i);
+		if (!HDLC_PLAIN_WORD(w))
+			break;
+	}
+
+	while (i < len && p[i] != ESC_CHAR && p[i] != CONTROL_CHAR)
+		i++;
+
+	return i;
+}
+
 void diag_hdlc_encode(struct diag_send_desc_type *src_desc,
 		      struct diag_hdlc_dest_type *enc)
 {
@@ -83,6 +157,7 @@ void diag_hdlc_encode(struct diag_send_desc_type *src_desc,
 	unsigned char src_byte = 0;
 	enum diag_send_state_enum_type state;
 	unsigned int used = 0;
+	uint32_t w;
 
 	if (src_desc && enc) {
 
@@ -108,7 +183,27 @@ void diag_hdlc_encode(struct diag_send_desc_type *src_desc,
 			   of 2 dest bytes for an escaped byte */
 			while (src <= src_last && dest <= dest_last) {
 
-				src_byte = *src++;
+				src_byte = *src;
+
+				/* Four plain bytes at once. Only tried from
+				   a plain byte, so escaped data doesn't pay
+				   for the word test. */
+				if (src_byte != CONTROL_CHAR &&
+				    src_byte != ESC_CHAR &&
+				    src_last - src >= 3 &&
+				    dest_last - dest >= 3) {
+					w = get_unaligned_le32(src);
+					if (HDLC_PLAIN_WORD(w)) {
+						crc = hdlc_crc_word(crc, w);
+						memcpy(dest, src, 4);
+						src += 4;
+						dest += 4;
+						used += 4;
+						continue;
+					}
+				}
+
+				src++;
 
 				if ((src_byte == CONTROL_CHAR) ||
 				    (src_byte == ESC_CHAR)) {
@@ -211,7 +306,7 @@ int diag_hdlc_decode(struct diag_hdlc_decode_type *hdlc)
 	unsigned int src_length = 0, dest_length = 0;
 
 	unsigned int len = 0;
-	unsigned int i;
+	unsigned int i, n;
 	uint8_t src_byte;
 
 	int pkt_bnd = 0;
@@ -228,14 +323,18 @@ int diag_hdlc_decode(struct diag_hdlc_decode_type *hdlc)
 		dest_ptr = &dest_ptr[hdlc->dest_idx];
 		dest_length = hdlc->dest_size - hdlc->dest_idx;
 
-		for (i = 0; i < src_length; i++) {
+		i = 0;
+		/* finish an escape split over the previous call */
+		if (hdlc->escaping) {
+			dest_ptr[len++] = src_ptr[i++] ^ ESC_MASK;
+			hdlc->escaping = 0;
+		}
+
+		for (; i < src_length && len < dest_length; i++) {
 
 			src_byte = src_ptr[i];
 
-			if (hdlc->escaping) {
-				dest_ptr[len++] = src_byte ^ ESC_MASK;
-				hdlc->escaping = 0;
-			} else if (src_byte == ESC_CHAR) {
+			if (src_byte == ESC_CHAR) {
 				if (i == (src_length - 1)) {
 					hdlc->escaping = 1;
 					i++;
@@ -250,12 +349,12 @@ int diag_hdlc_decode(struct diag_hdlc_decode_type *hdlc)
 				i++;
 				break;
 			} else {
-				dest_ptr[len++] = src_byte;
-			}
-
-			if (len >= dest_length) {
-				i++;
-				break;
+				/* copy the plain run this byte starts */
+				n = hdlc_plain_run(&src_ptr[i],
+					min(src_length - i, dest_length - len));
+				memcpy(&dest_ptr[len], &src_ptr[i], n);
+				len += n;
+				i += n - 1;
 			}
 		}
 
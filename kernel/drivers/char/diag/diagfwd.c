@@ -61,6 +61,8 @@
 #include <linux/platform_device.h>
 #include <linux/sched.h>
 #include <linux/workqueue.h>
+#include <linux/bitops.h>
+#include <linux/debugfs.h>
 #include <linux/diagchar.h>
 #include <mach/usbdiag.h>
 #include <mach/msm_smd.h>
@@ -81,72 +83,130 @@ MODULE_VERSION("1.0");
 #define CHK_OVERFLOW(bufStart, start, end, length) \
 ((bufStart <= start) && (end - start >= length)) ? 1 : 0
 
-static void diag_smd_send_req(int context)
+/* diag_smd_fwd flags */
+#define SMD_FWD_READING	0	/* a context is draining the channel */
+#define SMD_FWD_PENDING	1	/* more data was signalled meanwhile */
+
+/*
+ * Move whole SMD packets into free USB buffers, packing as many as fit
+ * into each buffer so one USB transfer carries several diag packets.
+ * The modem already HDLC-frames its traffic, so packets are simply
+ * concatenated.  Only the context holding SMD_FWD_READING gets here.
+ */
+static void diag_smd_fill(struct diag_smd_fwd *fwd, int context)
 {
-	void *buf;
+	struct diag_request *req;
+	unsigned char *buf;
+	int n, r, len;
 
-	if (driver->ch && (!driver->in_busy)) {
-		int r = smd_read_avail(driver->ch);
+	while (fwd->ch && driver->usb_connected) {
+		r = smd_read_avail(fwd->ch);
+		if (r <= 0)
+			return;
 
 		if (r > USB_MAX_IN_BUF) {
 			printk(KERN_INFO "diag dropped num bytes = %d\n", r);
+			if (context == SMD_CONTEXT)
+				smd_read_from_cb(fwd->ch, NULL, r);
+			else
+				smd_read(fwd->ch, NULL, r);
+			fwd->dropped++;
+			continue;
+		}
+
+		n = find_first_zero_bit(&fwd->in_busy, N_USB_IN_BUFS);
+		if (n >= N_USB_IN_BUFS) {
+			/* leave it in the FIFO until a write completes */
+			fwd->stalls++;
 			return;
 		}
-		if (r > 0) {
-
-			buf = driver->usb_buf_in;
-			if (!buf) {
-				printk(KERN_INFO "Out of diagmem for a9\n");
-			} else {
-				if (context == SMD_CONTEXT)
-					smd_read_from_cb(driver->ch, buf, r);
-				else
-					smd_read(driver->ch, buf, r);
-				driver->in_busy = 1;
-				driver->usb_write_ptr->buf = buf;
-				driver->usb_write_ptr->length = r;
+
+		buf = fwd->buf_in[n];
+		len = 0;
+		do {
+			if (context == SMD_CONTEXT)
+				smd_read_from_cb(fwd->ch, buf + len, r);
+			else
+				smd_read(fwd->ch, buf + len, r);
+			len += r;
+			fwd->smd_pkts++;
+			r = smd_read_avail(fwd->ch);
+		} while (r > 0 && len + r <= USB_MAX_IN_BUF);
+
+		set_bit(n, &fwd->in_busy);
+		req = &fwd->write_req[n];
+		req->buf = buf;
+		req->length = len;
 #ifdef DIAG_DEBUG
-				printk(KERN_INFO "writing data to USB,"
-						 " pkt length %d \n", r);
-				print_hex_dump(KERN_DEBUG, "Written Packet Data"
-					       " to USB: ", 16, 1,
-					       DUMP_PREFIX_ADDRESS, buf, r, 1);
+		printk(KERN_INFO "writing data to USB, pkt length %d \n", len);
+		print_hex_dump(KERN_DEBUG, "Written Packet Data to USB: ",
+			       16, 1, DUMP_PREFIX_ADDRESS, buf, len, 1);
 #endif
-				diag_write(driver->usb_write_ptr);
-			}
+		if (diag_write(req)) {
+			clear_bit(n, &fwd->in_busy);
+			fwd->dropped++;
+			return;
 		}
+		fwd->usb_writes++;
+		fwd->bytes += len;
 	}
 }
 
-static void diag_smd_qdsp_send_req(int context)
+/*
+ * Called from the SMD notifier and from USB write completion, which
+ * may nest.  Instead of locking, whoever finds the channel already
+ * being drained flags it as pending and the drainer goes round again.
+ */
+static void diag_smd_send_req(struct diag_smd_fwd *fwd, int context)
 {
-	void *buf;
+again:
+	if (test_and_set_bit(SMD_FWD_READING, &fwd->flags)) {
+		set_bit(SMD_FWD_PENDING, &fwd->flags);
+		return;
+	}
+	do {
+		clear_bit(SMD_FWD_PENDING, &fwd->flags);
+		diag_smd_fill(fwd, context);
+	} while (test_bit(SMD_FWD_PENDING, &fwd->flags));
+	clear_bit(SMD_FWD_READING, &fwd->flags);
+
+	/* catch a notification that raced with clearing READING */
+	if (test_bit(SMD_FWD_PENDING, &fwd->flags))
+		goto again;
+}
 
-	if (driver->chqdsp && (!driver->in_busy_qdsp)) {
-		int r = smd_read_avail(driver->chqdsp);
+static struct diag_smd_fwd *diag_smd_fwd_of(struct diag_request *req)
+{
+	struct diag_smd_fwd *fwd = &driver->modem;
+
+	if (req >= fwd->write_req && req < fwd->write_req + N_USB_IN_BUFS)
+		return fwd;
+	fwd = &driver->qdsp;
+	if (req >= fwd->write_req && req < fwd->write_req + N_USB_IN_BUFS)
+		return fwd;
+	return NULL;
+}
 
-		if (r > USB_MAX_IN_BUF) {
-			printk(KERN_INFO "diag dropped num bytes = %d\n", r);
-			return;
-		}
-		if (r > 0) {
-
-			buf = driver->usb_buf_in_qdsp;
-			if (!buf) {
-				printk(KERN_INFO "Out of diagmem for q6\n");
-			} else {
-				if (context == SMD_CONTEXT)
-					smd_read_from_cb(
-						driver->chqdsp, buf, r);
-				else
-					smd_read(driver->chqdsp, buf, r);
-				driver->in_busy_qdsp = 1;
-				driver->usb_write_ptr_qdsp->buf = buf;
-				driver->usb_write_ptr_qdsp->length = r;
-				diag_write(driver->usb_write_ptr_qdsp);
-			}
-		}
+static int diag_smd_fwd_alloc(struct diag_smd_fwd *fwd)
+{
+	int i;
 
+	for (i = 0; i < N_USB_IN_BUFS; i++) {
+		if (fwd->buf_in[i] == NULL &&
+		    (fwd->buf_in[i] = kzalloc(USB_MAX_IN_BUF,
+					      GFP_KERNEL)) == NULL)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+static void diag_smd_fwd_free(struct diag_smd_fwd *fwd)
+{
+	int i;
+
+	for (i = 0; i < N_USB_IN_BUFS; i++) {
+		kfree(fwd->buf_in[i]);
+		fwd->buf_in[i] = NULL;
 	}
 }
 
@@ -433,8 +493,9 @@ static void diag_process_hdlc(void *data, unsigned len)
 	}
 
 	/* ignore 2 bytes for CRC, one for 7E and send */
-	if ((driver->ch) && (ret) && (type) && (hdlc.dest_idx > 3)) {
-		smd_write(driver->ch, driver->hdlc_buf, hdlc.dest_idx - 3);
+	if ((driver->modem.ch) && (ret) && (type) && (hdlc.dest_idx > 3)) {
+		smd_write(driver->modem.ch, driver->hdlc_buf,
+			  hdlc.dest_idx - 3);
 #ifdef DIAG_DEBUG
 		printk(KERN_INFO "writing data to SMD, pkt length %d \n", len);
 		print_hex_dump(KERN_DEBUG, "Written Packet Data to SMD: ", 16,
@@ -447,15 +508,18 @@ static void diag_process_hdlc(void *data, unsigned len)
 int diagfwd_connect(void)
 {
 	printk(KERN_DEBUG "diag: USB connected\n");
-	diag_open(driver->poolsize + 3); /* 2 for A9 ; 1 for q6*/
+	/* apps writes plus the in-flight buffers of both SMD channels */
+	diag_open(driver->poolsize_usb_struct_max + 2 * N_USB_IN_BUFS);
 
+	driver->modem.in_busy = 0;
+	driver->qdsp.in_busy = 0;
+	driver->connect_jiffies = jiffies;
+	driver->connect_bytes = driver->modem.bytes + driver->qdsp.bytes;
 	driver->usb_connected = 1;
-	driver->in_busy = 0;
-	driver->in_busy_qdsp = 0;
 
 	/* Poll SMD channels to check for data*/
-	diag_smd_send_req(NON_SMD_CONTEXT);
-	diag_smd_qdsp_send_req(NON_SMD_CONTEXT);
+	diag_smd_send_req(&driver->modem, NON_SMD_CONTEXT);
+	diag_smd_send_req(&driver->qdsp, NON_SMD_CONTEXT);
 
 	driver->usb_read_ptr->buf = driver->usb_buf_out;
 	driver->usb_read_ptr->length = USB_MAX_OUT_BUF;
@@ -467,8 +531,6 @@ int diagfwd_disconnect(void)
 {
 	printk(KERN_DEBUG "diag: USB disconnected\n");
 	driver->usb_connected = 0;
-	driver->in_busy = 1;
-	driver->in_busy_qdsp = 1;
 	driver->debug_flag = 1;
 	diag_close();
 	/* TBD - notify and flow control SMD */
@@ -478,14 +540,12 @@ int diagfwd_disconnect(void)
 int diagfwd_write_complete(struct diag_request *diag_write_ptr)
 {
 	unsigned char *buf = diag_write_ptr->buf;
+	struct diag_smd_fwd *fwd = diag_smd_fwd_of(diag_write_ptr);
+
 	/*Determine if the write complete is for data from arm9/apps/q6 */
-	/* Need a context variable here instead */
-	if (buf == (void *)driver->usb_buf_in) {
-		driver->in_busy = 0;
-		diag_smd_send_req(NON_SMD_CONTEXT);
-	} else if (buf == (void *)driver->usb_buf_in_qdsp) {
-		driver->in_busy_qdsp = 0;
-		diag_smd_qdsp_send_req(NON_SMD_CONTEXT);
+	if (fwd) {
+		clear_bit(diag_write_ptr - fwd->write_req, &fwd->in_busy);
+		diag_smd_send_req(fwd, NON_SMD_CONTEXT);
 	} else {
 		diagmem_free(driver, (unsigned char *)buf, POOL_TYPE_HDLC);
 		diagmem_free(driver, (unsigned char *)diag_write_ptr,
@@ -511,13 +571,13 @@ static struct diag_operations diagfwdops = {
 
 static void diag_smd_notify(void *ctxt, unsigned event)
 {
-	diag_smd_send_req(SMD_CONTEXT);
+	diag_smd_send_req(&driver->modem, SMD_CONTEXT);
 }
 
 #if defined(CONFIG_MSM_N_WAY_SMD)
 static void diag_smd_qdsp_notify(void *ctxt, unsigned event)
 {
-	diag_smd_qdsp_send_req(SMD_CONTEXT);
+	diag_smd_send_req(&driver->qdsp, SMD_CONTEXT);
 }
 #endif
 
@@ -526,26 +586,21 @@ static int diag_smd_probe(struct platform_device *pdev)
 	int r = 0;
 
 	if (pdev->id == 0) {
-		if (driver->usb_buf_in == NULL &&
-			(driver->usb_buf_in =
-			kzalloc(USB_MAX_IN_BUF, GFP_KERNEL)) == NULL)
-
+		if (diag_smd_fwd_alloc(&driver->modem))
 			goto err;
 		else
 
-		r = smd_open("DIAG", &driver->ch, driver, diag_smd_notify);
+		r = smd_open("DIAG", &driver->modem.ch, driver,
+			     diag_smd_notify);
 	}
 #if defined(CONFIG_MSM_N_WAY_SMD)
 	if (pdev->id == 1) {
-		if (driver->usb_buf_in_qdsp == NULL &&
-			(driver->usb_buf_in_qdsp =
-			kzalloc(USB_MAX_IN_BUF, GFP_KERNEL)) == NULL)
-
+		if (diag_smd_fwd_alloc(&driver->qdsp))
 			goto err;
 		else
 
 		r = smd_named_open_on_edge("DIAG", SMD_APPS_QDSP,
-			&driver->chqdsp, driver, diag_smd_qdsp_notify);
+			&driver->qdsp.ch, driver, diag_smd_qdsp_notify);
 
 	}
 #endif
@@ -579,6 +634,96 @@ void diag_read_work_fn(struct work_struct *work)
 #endif
 }
 
+#if defined(CONFIG_DEBUG_FS)
+static struct dentry *diag_dent;
+
+static int diag_debug_fwd(char *buf, int max, const char *name,
+			  struct diag_smd_fwd *fwd)
+{
+	return scnprintf(buf, max,
+			 "%s: pkts %lu writes %lu bytes %lu stalls %lu "
+			 "dropped %lu in_busy 0x%lx\n", name, fwd->smd_pkts,
+			 fwd->usb_writes, fwd->bytes, fwd->stalls,
+			 fwd->dropped, fwd->in_busy);
+}
+
+static int diag_debug_pool(char *buf, int max, const char *name,
+			   int count, unsigned int size, unsigned int size_max,
+			   int pool_type)
+{
+	return scnprintf(buf, max,
+			 "%s pool: used %d size %u max %u grows %lu fails %lu\n",
+			 name, count, size, size_max,
+			 driver->pool_grows[pool_type],
+			 driver->pool_fails[pool_type]);
+}
+
+#define DEBUG_BUFMAX 1024
+static char debug_buffer[DEBUG_BUFMAX];
+
+static ssize_t diag_debug_read(struct file *file, char __user *ubuf,
+			       size_t count, loff_t *ppos)
+{
+	char *buf = debug_buffer;
+	unsigned long bytes, elapsed;
+	int i = 0;
+
+	i += diag_debug_fwd(buf + i, DEBUG_BUFMAX - i, "modem",
+			    &driver->modem);
+	i += diag_debug_fwd(buf + i, DEBUG_BUFMAX - i, "qdsp",
+			    &driver->qdsp);
+
+	if (driver->usb_connected) {
+		bytes = driver->modem.bytes + driver->qdsp.bytes -
+			driver->connect_bytes;
+		elapsed = jiffies_to_msecs(jiffies - driver->connect_jiffies);
+		i += scnprintf(buf + i, DEBUG_BUFMAX - i,
+			       "throughput: %lu bytes in %lu ms (%lu KB/s)\n",
+			       bytes, elapsed,
+			       elapsed ? bytes / elapsed : 0);
+	}
+
+	i += diag_debug_pool(buf + i, DEBUG_BUFMAX - i, "copy",
+			     driver->count, driver->poolsize,
+			     driver->poolsize_max, POOL_TYPE_COPY);
+	i += diag_debug_pool(buf + i, DEBUG_BUFMAX - i, "hdlc",
+			     driver->count_hdlc_pool, driver->poolsize_hdlc,
+			     driver->poolsize_hdlc_max, POOL_TYPE_HDLC);
+	i += diag_debug_pool(buf + i, DEBUG_BUFMAX - i, "usb_struct",
+			     driver->count_usb_struct_pool,
+			     driver->poolsize_usb_struct,
+			     driver->poolsize_usb_struct_max,
+			     POOL_TYPE_USB_STRUCT);
+	i += scnprintf(buf + i, DEBUG_BUFMAX - i, "apps dropped: %d\n",
+		       driver->dropped_count);
+
+	return simple_read_from_buffer(ubuf, count, ppos, buf, i);
+}
+
+static const struct file_operations diag_debug_ops = {
+	.read = diag_debug_read,
+};
+
+static void diag_debugfs_init(void)
+{
+	diag_dent = debugfs_create_dir("diag", 0);
+	if (IS_ERR(diag_dent)) {
+		diag_dent = NULL;
+		return;
+	}
+
+	debugfs_create_file("stats", 0444, diag_dent, 0, &diag_debug_ops);
+}
+
+static void diag_debugfs_exit(void)
+{
+	debugfs_remove_recursive(diag_dent);
+}
+#else
+static void diag_debugfs_init(void) { }
+static void diag_debugfs_exit(void) { }
+#endif
+
 void diagfwd_init(void)
 {
 
@@ -613,16 +758,6 @@ void diagfwd_init(void)
 				      sizeof(struct diag_master_table),
 				       GFP_KERNEL)) == NULL)
 		goto err;
-	if (driver->usb_write_ptr == NULL)
-			driver->usb_write_ptr = kzalloc(
-				sizeof(struct diag_request), GFP_KERNEL);
-			if (driver->usb_write_ptr == NULL)
-					goto err;
-	if (driver->usb_write_ptr_qdsp == NULL)
-			driver->usb_write_ptr_qdsp = kzalloc(
-				sizeof(struct diag_request), GFP_KERNEL);
-			if (driver->usb_write_ptr_qdsp == NULL)
-					goto err;
 	if (driver->usb_read_ptr == NULL)
 			driver->usb_read_ptr = kzalloc(
 				sizeof(struct diag_request), GFP_KERNEL);
@@ -640,6 +775,7 @@ void diagfwd_init(void)
 
 	platform_driver_register(&msm_smd_ch1_driver);
 
+	diag_debugfs_init();
 	return;
 err:
 		printk(KERN_INFO "\n Could not initialize diag buffers\n");
@@ -652,27 +788,26 @@ err:
 		kfree(driver->data_ready);
 		kfree(driver->table);
 		kfree(driver->pkt_buf);
-		kfree(driver->usb_write_ptr);
-		kfree(driver->usb_write_ptr_qdsp);
 		kfree(driver->usb_read_ptr);
 }
 
 void diagfwd_exit(void)
 {
-	smd_close(driver->ch);
-	smd_close(driver->chqdsp);
-	driver->ch = 0;		/*SMD can make this NULL */
-	driver->chqdsp = 0;
+	smd_close(driver->modem.ch);
+	smd_close(driver->qdsp.ch);
+	driver->modem.ch = 0;		/*SMD can make this NULL */
+	driver->qdsp.ch = 0;
 
 	if (driver->usb_connected)
 		diag_close();
 
+	diag_debugfs_exit();
 	platform_driver_unregister(&msm_smd_ch1_driver);
 
 	diag_usb_unregister();
 
-	kfree(driver->usb_buf_in);
-	kfree(driver->usb_buf_in_qdsp);
+	diag_smd_fwd_free(&driver->modem);
+	diag_smd_fwd_free(&driver->qdsp);
 	kfree(driver->usb_buf_out);
 	kfree(driver->hdlc_buf);
 	kfree(driver->msg_masks);
@@ -682,7 +817,5 @@ void diagfwd_exit(void)
 	kfree(driver->data_ready);
 	kfree(driver->table);
 	kfree(driver->pkt_buf);
-	kfree(driver->usb_write_ptr);
-	kfree(driver->usb_write_ptr_qdsp);
 	kfree(driver->usb_read_ptr);
 }
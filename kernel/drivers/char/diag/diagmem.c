@@ -62,6 +62,24 @@
 #include <asm/atomic.h>
 #include "diagchar.h"
 
+/*
+ * Double the item limit of a pool that has run dry, up to its max.
+ * Allocations only happen from process context, so the reserve can
+ * be grown with GFP_KERNEL; the larger size is kept for later opens.
+ */
+static void diagmem_grow(struct diagchar_dev *driver, mempool_t *pool,
+			 unsigned int *size, unsigned int max, int pool_type)
+{
+	unsigned int new_size = min(*size * 2, max);
+
+	if (new_size <= *size)
+		return;
+	if (mempool_resize(pool, new_size, GFP_KERNEL))
+		return;
+	*size = new_size;
+	driver->pool_grows[pool_type]++;
+}
+
 void *diagmem_alloc(struct diagchar_dev *driver, int size, int pool_type)
 {
 	void *buf = NULL;
@@ -69,6 +87,10 @@ void *diagmem_alloc(struct diagchar_dev *driver, int size, int pool_type)
 	if (pool_type == POOL_TYPE_COPY) {
 		if (driver->diagpool) {
 			mutex_lock(&driver->diagmem_mutex);
+			if (driver->count >= driver->poolsize)
+				diagmem_grow(driver, driver->diagpool,
+					     &driver->poolsize,
+					     driver->poolsize_max, pool_type);
 			if (driver->count < driver->poolsize) {
 				atomic_add(1, (atomic_t *)&driver->count);
 				buf = mempool_alloc(driver->diagpool,
@@ -78,6 +100,11 @@ void *diagmem_alloc(struct diagchar_dev *driver, int size, int pool_type)
 		}
 	} else if (pool_type == POOL_TYPE_HDLC) {
 		if (driver->diag_hdlc_pool) {
+			if (driver->count_hdlc_pool >= driver->poolsize_hdlc)
+				diagmem_grow(driver, driver->diag_hdlc_pool,
+					     &driver->poolsize_hdlc,
+					     driver->poolsize_hdlc_max,
+					     pool_type);
 			if (driver->count_hdlc_pool < driver->poolsize_hdlc) {
 				atomic_add(1,
 					 (atomic_t *)&driver->count_hdlc_pool);
@@ -87,6 +114,13 @@ void *diagmem_alloc(struct diagchar_dev *driver, int size, int pool_type)
 		}
 	} else if (pool_type == POOL_TYPE_USB_STRUCT) {
 		if (driver->diag_usb_struct_pool) {
+			if (driver->count_usb_struct_pool >=
+					 driver->poolsize_usb_struct)
+				diagmem_grow(driver,
+					     driver->diag_usb_struct_pool,
+					     &driver->poolsize_usb_struct,
+					     driver->poolsize_usb_struct_max,
+					     pool_type);
 			if (driver->count_usb_struct_pool <
 					 driver->poolsize_usb_struct) {
 				atomic_add(1,
@@ -96,6 +130,8 @@ void *diagmem_alloc(struct diagchar_dev *driver, int size, int pool_type)
 			}
 		}
 	}
+	if (!buf && pool_type < NUM_POOL_TYPES)
+		driver->pool_fails[pool_type]++;
 	return buf;
 }
 
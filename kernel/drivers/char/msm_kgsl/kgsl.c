@@ -72,6 +72,7 @@
 #include <linux/pm_qos_params.h>
 #include <linux/highmem.h>
 #include <linux/vmalloc.h>
+#include <linux/ktime.h>
 #include <asm/cacheflush.h>
 
 #include <linux/delay.h>
@@ -88,12 +89,21 @@
 
 #include "kgsl_log.h"
 #include "kgsl_drm.h"
+#include "kgsl_pagepool.h"
+#include "kgsl_dcvs.h"
 
 #define KGSL_MAX_PRESERVED_BUFFERS		10
 #define KGSL_MAX_SIZE_OF_PRESERVED_BUFFER	0x10000
 
+/*
+ * mem_list and preserve_entry_list are only changed with both the driver
+ * mutex and mem_lock held, so either lock is enough to walk them.  Paths
+ * that only touch this process's memory (cache maintenance, lookups ahead
+ * of a free) take mem_lock alone and never stall other processes.
+ */
 struct kgsl_file_private {
 	struct list_head list;
+	struct mutex mem_lock;
 	struct list_head mem_list;
 	uint32_t yamato_ctxt_id_mask;
 	uint32_t g12_ctxt_id_mask;
@@ -170,9 +180,7 @@ static long kgsl_clean_cache_all(struct kgsl_file_private *private)
 	int result = 0;
 	struct kgsl_mem_entry *entry = NULL;
 
-	kgsl_runpending(&kgsl_driver.yamato_device);
-	kgsl_runpending(&kgsl_driver.g12_device);
-
+	mutex_lock(&private->mem_lock);
 	list_for_each_entry(entry, &private->mem_list, list) {
 		if (KGSL_MEMFLAGS_MEM_REQUIRES_FLUSH & entry->memdesc.priv) {
 			result =
@@ -185,6 +193,7 @@ static long kgsl_clean_cache_all(struct kgsl_file_private *private)
 		}
 	}
 done:
+	mutex_unlock(&private->mem_lock);
 	return result;
 }
 #endif /*CONFIG_MSM_KGSL_MMU*/
@@ -270,10 +279,10 @@ int kgsl_pwrctrl(unsigned int pwrflag)
 			if (kgsl_driver.clk_freq[KGSL_AXI_HIGH_3D])
 				pm_qos_update_requirement(
 					PM_QOS_SYSTEM_BUS_FREQ, "kgsl_3d",
-					kgsl_driver.clk_freq[KGSL_AXI_HIGH_3D]);
+					kgsl_dcvs_bus_freq());
 			if (kgsl_driver.clk_freq[KGSL_3D_MAX_FREQ])
 				clk_set_min_rate(kgsl_driver.yamato_grp_src_clk,
-					kgsl_driver.clk_freq[KGSL_3D_MAX_FREQ]);
+					kgsl_dcvs_gpu_freq());
 			if (kgsl_driver.yamato_grp_pclk)
 				clk_enable(kgsl_driver.yamato_grp_pclk);
 			clk_enable(kgsl_driver.yamato_grp_clk);
@@ -553,6 +562,8 @@ static int kgsl_open(struct inode *inodep, struct file *filep)
 		return -ENOMEM;
 	}
 
+	mutex_init(&private->mem_lock);
+
 	mutex_lock(&kgsl_driver.mutex);
 
 	private->yamato_ctxt_id_mask = 0;
@@ -747,17 +758,22 @@ static long kgsl_ioctl_device_waittimestamp(struct kgsl_file_private *private,
 		goto done;
 	}
 
-	mutex_unlock(&kgsl_driver.mutex);
 	/* Don't wait forever, set a max value for now */
 	if (param.timeout == -1)
 		param.timeout = 10 * MSEC_PER_SEC;
 	if (param.device_id == KGSL_DEVICE_YAMATO) {
+		/* the retired timestamp lives in the memstore, so the wait
+		 * itself needs neither the driver mutex nor a powered core */
 		result = kgsl_yamato_waittimestamp(&kgsl_driver.yamato_device,
 				     param.timestamp,
 				     param.timeout);
-		mutex_lock(&kgsl_driver.mutex);
 
-		kgsl_runpending(&kgsl_driver.yamato_device);
+		/* retire deferred frees only if nobody else holds the lock;
+		 * the next locked ioctl drains them otherwise */
+		if (mutex_trylock(&kgsl_driver.mutex)) {
+			kgsl_runpending(&kgsl_driver.yamato_device);
+			mutex_unlock(&kgsl_driver.mutex);
+		}
 	} else if (param.device_id == KGSL_DEVICE_G12) {
 		mutex_lock(&kgsl_driver.mutex);
 		KGSL_G12_PRE_HWACCESS();
@@ -766,8 +782,8 @@ static long kgsl_ioctl_device_waittimestamp(struct kgsl_file_private *private,
 				     param.timestamp,
 				     param.timeout);
 		mutex_lock(&kgsl_driver.mutex);
-
 		kgsl_runpending(&kgsl_driver.g12_device);
+		mutex_unlock(&kgsl_driver.mutex);
 	} else {
 		result = -EINVAL;
 	}
@@ -865,17 +881,29 @@ static long kgsl_ioctl_cmdstream_readtimestamp(struct kgsl_file_private
 		goto done;
 	}
 
-	if (param.device_id == KGSL_DEVICE_YAMATO) {
+	if (param.device_id == KGSL_DEVICE_YAMATO &&
+	    param.type == KGSL_TIMESTAMP_RETIRED) {
+		/* the retired timestamp is read from the memstore */
+		param.timestamp =
+			kgsl_cmdstream_readtimestamp(
+						&kgsl_driver.yamato_device,
+							param.type);
+	} else if (param.device_id == KGSL_DEVICE_YAMATO) {
+		/* the consumed timestamp is a register read */
+		KGSL_PRE_HWACCESS();
 		param.timestamp =
 			kgsl_cmdstream_readtimestamp(
 						&kgsl_driver.yamato_device,
 							param.type);
+		KGSL_POST_HWACCESS();
 	} else if (param.device_id == KGSL_DEVICE_G12) {
 		struct kgsl_device *device;
+		mutex_lock(&kgsl_driver.mutex);
 		KGSL_G12_PRE_HWACCESS();
 		device = &kgsl_driver.g12_device;
 
 		param.timestamp = device->timestamp;
+		mutex_unlock(&kgsl_driver.mutex);
 	} else {
 		result = -EINVAL;
 	}
@@ -910,8 +938,10 @@ static long kgsl_ioctl_cmdstream_freememontimestamp(struct kgsl_file_private
 		goto done;
 	}
 #ifdef CONFIG_MSM_KGSL_MMU
+	mutex_lock(&private->mem_lock);
 	if (entry->memdesc.priv & KGSL_MEMFLAGS_VMALLOC_MEM)
 		entry->memdesc.priv &= ~KGSL_MEMFLAGS_MEM_REQUIRES_FLUSH;
+	mutex_unlock(&private->mem_lock);
 #endif
 	if (param.device_id == KGSL_DEVICE_YAMATO) {
 		result = kgsl_cmdstream_freememontimestamp(
@@ -1031,6 +1061,37 @@ done:
 	return result;
 }
 
+/* Detach an entry from its process and the GPU; driver mutex held. */
+static void kgsl_unlink_mem_entry(struct kgsl_mem_entry *entry)
+{
+	mutex_lock(&entry->priv->mem_lock);
+	/* remove the entry from list and free_list if it exists */
+	if (entry->list.prev)
+		list_del(&entry->list);
+	if (entry->free_list.prev)
+		list_del(&entry->free_list);
+	if (KGSL_MEMFLAGS_VMALLOC_MEM & entry->memdesc.priv)
+		entry->priv->vmalloc_size -= entry->memdesc.size;
+	mutex_unlock(&entry->priv->mem_lock);
+
+	kgsl_mmu_unmap(entry->memdesc.pagetable,
+			entry->memdesc.gpuaddr & KGSL_PAGEMASK,
+			entry->memdesc.size);
+}
+
+/* Release the backing memory of an unlinked entry; no locks needed. */
+static void kgsl_free_mem_entry(struct kgsl_mem_entry *entry)
+{
+	if (KGSL_MEMFLAGS_VMALLOC_MEM & entry->memdesc.priv) {
+		vunmap((void *)entry->memdesc.physaddr);
+		kgsl_pagepool_free(entry->pages,
+				   entry->memdesc.size >> PAGE_SHIFT);
+	} else
+		kgsl_put_phys_file(entry->pmem_file);
+
+	kfree(entry);
+}
+
 void kgsl_remove_mem_entry(struct kgsl_mem_entry *entry, bool preserve)
 {
 	/* If allocation is vmalloc and preserve is requested then save
@@ -1040,6 +1101,7 @@ void kgsl_remove_mem_entry(struct kgsl_mem_entry *entry, bool preserve)
 		preserve &&
 		entry->priv->preserve_list_size < KGSL_MAX_PRESERVED_BUFFERS &&
 		entry->memdesc.size <= KGSL_MAX_SIZE_OF_PRESERVED_BUFFER) {
+		mutex_lock(&entry->priv->mem_lock);
 		if (entry->free_list.prev) {
 			list_del(&entry->free_list);
 			entry->free_list.prev = NULL;
@@ -1050,25 +1112,11 @@ void kgsl_remove_mem_entry(struct kgsl_mem_entry *entry, bool preserve)
 		}
 		list_add(&entry->list, &entry->priv->preserve_entry_list);
 		entry->priv->preserve_list_size++;
+		mutex_unlock(&entry->priv->mem_lock);
 		return;
 	}
-	kgsl_mmu_unmap(entry->memdesc.pagetable,
-			entry->memdesc.gpuaddr & KGSL_PAGEMASK,
-			entry->memdesc.size);
-	if (KGSL_MEMFLAGS_VMALLOC_MEM & entry->memdesc.priv) {
-		vfree((void *)entry->memdesc.physaddr);
-		entry->priv->vmalloc_size -= entry->memdesc.size;
-	} else
-		kgsl_put_phys_file(entry->pmem_file);
-
-	/* remove the entry from list and free_list if it exists */
-	if (entry->list.prev)
-		list_del(&entry->list);
-	if (entry->free_list.prev)
-		list_del(&entry->free_list);
-
-	kfree(entry);
-
+	kgsl_unlink_mem_entry(entry);
+	kgsl_free_mem_entry(entry);
 }
 
 static long kgsl_ioctl_sharedmem_free(struct kgsl_file_private *private,
@@ -1082,15 +1130,21 @@ static long kgsl_ioctl_sharedmem_free(struct kgsl_file_private *private,
 		result = -EFAULT;
 		goto done;
 	}
+	mutex_lock(&kgsl_driver.mutex);
 	entry = kgsl_sharedmem_find(private, param.gpuaddr);
 
 	if (entry == NULL) {
+		mutex_unlock(&kgsl_driver.mutex);
 		KGSL_DRV_ERR("invalid gpuaddr %08x\n", param.gpuaddr);
 		result = -EINVAL;
 		goto done;
 	}
 
-	kgsl_remove_mem_entry(entry, false);
+	kgsl_unlink_mem_entry(entry);
+	mutex_unlock(&kgsl_driver.mutex);
+
+	/* unmapping and scrubbing the pages happens outside the lock */
+	kgsl_free_mem_entry(entry);
 done:
 	return result;
 }
@@ -1103,6 +1157,7 @@ static long kgsl_ioctl_sharedmem_from_vmalloc(struct kgsl_file_private *private,
 	struct kgsl_sharedmem_from_vmalloc param;
 	struct kgsl_mem_entry *entry = NULL, *entry_tmp = NULL;
 	void *vmalloc_area;
+	struct page **pages;
 	struct vm_area_struct *vma;
 
 	if (copy_from_user(&param, arg, sizeof(param))) {
@@ -1140,6 +1195,7 @@ static long kgsl_ioctl_sharedmem_from_vmalloc(struct kgsl_file_private *private,
 		goto error;
 	}
 
+	mutex_lock(&private->mem_lock);
 	list_for_each_entry_safe(entry, entry_tmp,
 				&private->preserve_entry_list, list) {
 		/* make sure that read only pages aren't accidently
@@ -1149,10 +1205,12 @@ static long kgsl_ioctl_sharedmem_from_vmalloc(struct kgsl_file_private *private,
 		    ((entry->memdesc.priv & KGSL_MEMFLAGS_GPUREADONLY) ==
 		    (param.flags & KGSL_MEMFLAGS_GPUREADONLY))) {
 			list_del(&entry->list);
+			entry->priv->preserve_list_size--;
 			found = 1;
 			break;
 		}
 	}
+	mutex_unlock(&private->mem_lock);
 
 	if (!found) {
 		entry = kzalloc(sizeof(struct kgsl_mem_entry), GFP_KERNEL);
@@ -1161,19 +1219,26 @@ static long kgsl_ioctl_sharedmem_from_vmalloc(struct kgsl_file_private *private,
 			goto error;
 		}
 
-		/* allocate memory and map it to user space */
-		vmalloc_area = vmalloc_user(len);
-		if (!vmalloc_area) {
-			KGSL_MEM_ERR("vmalloc failed\n");
+		/* pool pages are already zeroed and flushed, so no
+		 * cache maintenance is needed before the GPU sees them */
+		pages = kgsl_pagepool_alloc(len >> PAGE_SHIFT);
+		if (!pages) {
+			KGSL_MEM_ERR("page pool allocation failed\n");
 			result = -ENOMEM;
 			goto error_free_entry;
 		}
-		kgsl_cache_range_op((unsigned int)vmalloc_area, len,
-				KGSL_CACHE_INV | KGSL_CACHE_VMALLOC_ADDR);
+
+		/* map the pages for the kernel and later for user space */
+		vmalloc_area = vmap(pages, len >> PAGE_SHIFT,
+				    VM_MAP | VM_USERMAP, PAGE_KERNEL);
+		if (!vmalloc_area) {
+			KGSL_MEM_ERR("vmap failed\n");
+			result = -ENOMEM;
+			goto error_free_pages;
+		}
 
 		result =
-		    kgsl_mmu_map(private->pagetable,
-			(unsigned long)vmalloc_area, len,
+		    kgsl_mmu_map_pages(private->pagetable, pages, len,
 			GSL_PT_PAGE_RV |
 			((param.flags & KGSL_MEMFLAGS_GPUREADONLY) ?
 			0 : GSL_PT_PAGE_WV),
@@ -1187,14 +1252,14 @@ static long kgsl_ioctl_sharedmem_from_vmalloc(struct kgsl_file_private *private,
 			    KGSL_MEMFLAGS_MEM_REQUIRES_FLUSH |
 			    (param.flags & KGSL_MEMFLAGS_GPUREADONLY);
 		entry->memdesc.physaddr = (unsigned long)vmalloc_area;
+		entry->pages = pages;
 		entry->priv = private;
-		private->vmalloc_size += len;
 
 	} else {
 		KGSL_MEM_INFO("Reusing memory entry: %x, size: %x\n",
 				(unsigned int)entry, entry->memdesc.size);
-		entry->priv->preserve_list_size--;
 		vmalloc_area = (void *)entry->memdesc.physaddr;
+		pages = entry->pages;
 	}
 
 	if (!kgsl_cache_enable)
@@ -1214,7 +1279,11 @@ static long kgsl_ioctl_sharedmem_from_vmalloc(struct kgsl_file_private *private,
 		result = -EFAULT;
 		goto error_unmap_entry;
 	}
+	mutex_lock(&private->mem_lock);
+	if (!found)
+		private->vmalloc_size += len;
 	list_add(&entry->list, &private->mem_list);
+	mutex_unlock(&private->mem_lock);
 
 	return 0;
 
@@ -1223,7 +1292,10 @@ error_unmap_entry:
 		       entry->memdesc.size);
 
 error_free_vmalloc:
-	vfree(vmalloc_area);
+	vunmap(vmalloc_area);
+
+error_free_pages:
+	kgsl_pagepool_free(pages, len >> PAGE_SHIFT);
 
 error_free_entry:
 	kfree(entry);
@@ -1315,6 +1387,7 @@ static int kgsl_ioctl_sharedmem_from_pmem(struct kgsl_file_private *private,
 	}
 
 	entry->pmem_file = pmem_file;
+	entry->priv = private;
 
 	entry->memdesc.pagetable = private->pagetable;
 
@@ -1345,7 +1418,9 @@ static int kgsl_ioctl_sharedmem_from_pmem(struct kgsl_file_private *private,
 		result = -EFAULT;
 		goto error_unmap_entry;
 	}
+	mutex_lock(&private->mem_lock);
 	list_add(&entry->list, &private->mem_list);
+	mutex_unlock(&private->mem_lock);
 	return result;
 
 error_unmap_entry:
@@ -1377,8 +1452,10 @@ static long kgsl_ioctl_sharedmem_flush_cache(struct kgsl_file_private *private,
 		goto done;
 	}
 
+	mutex_lock(&private->mem_lock);
 	entry = kgsl_sharedmem_find(private, param.gpuaddr);
 	if (!entry) {
+		mutex_unlock(&private->mem_lock);
 		KGSL_DRV_ERR("invalid gpuaddr %08x\n", param.gpuaddr);
 		result = -EINVAL;
 		goto done;
@@ -1388,6 +1465,7 @@ static long kgsl_ioctl_sharedmem_flush_cache(struct kgsl_file_private *private,
 				KGSL_CACHE_CLEAN | KGSL_CACHE_USER_ADDR);
 	/* Mark memory as being flushed so we don't flush it again */
 	entry->memdesc.priv &= ~KGSL_MEMFLAGS_MEM_REQUIRES_FLUSH;
+	mutex_unlock(&private->mem_lock);
 done:
 	return result;
 }
@@ -1398,10 +1476,51 @@ static long kgsl_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 	int result = 0;
 	struct kgsl_file_private *private = filep->private_data;
 	struct kgsl_drawctxt_set_bin_base_offset binbase;
+	ktime_t start;
+	s64 wait_us;
 
 	BUG_ON(private == NULL);
 
 	KGSL_DRV_VDBG("filep %p cmd 0x%08x arg 0x%08lx\n", filep, cmd, arg);
+
+	/* These only touch the memstore or this process's memory, and take
+	 * whatever locks they need themselves. */
+	switch (cmd) {
+	case IOCTL_KGSL_DEVICE_WAITTIMESTAMP:
+		result = kgsl_ioctl_device_waittimestamp(private,
+							(void __user *)arg);
+		/* order reads to the buffer written to by the GPU */
+		rmb();
+		goto done;
+
+	case IOCTL_KGSL_CMDSTREAM_READTIMESTAMP:
+		result =
+		    kgsl_ioctl_cmdstream_readtimestamp(private,
+							(void __user *)arg);
+		goto done;
+
+	case IOCTL_KGSL_SHAREDMEM_FREE:
+		result = kgsl_ioctl_sharedmem_free(private, (void __user *)arg);
+		goto done;
+
+#ifdef CONFIG_MSM_KGSL_MMU
+	case IOCTL_KGSL_SHAREDMEM_FLUSH_CACHE:
+		if (kgsl_cache_enable)
+			result =
+			    kgsl_ioctl_sharedmem_flush_cache(private,
+						       (void __user *)arg);
+		goto done;
+
+	case IOCTL_KGSL_RINGBUFFER_ISSUEIBCMDS:
+		/* clean this process's buffers before queueing up behind
+		 * other processes for the device */
+		if (kgsl_cache_enable)
+			kgsl_clean_cache_all(private);
+		break;
+#endif
+	}
+
+	start = ktime_get();
 	KGSL_PRE_HWACCESS();
 	switch (cmd) {
 
@@ -1414,17 +1533,17 @@ static long kgsl_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 		result = kgsl_ioctl_device_regread(private, (void __user *)arg);
 		break;
 
-	case IOCTL_KGSL_DEVICE_WAITTIMESTAMP:
-		result = kgsl_ioctl_device_waittimestamp(private,
-							(void __user *)arg);
-		/* order reads to the buffer written to by the GPU */
-		rmb();
-		break;
-
 	case IOCTL_KGSL_RINGBUFFER_ISSUEIBCMDS:
+		wait_us = ktime_us_delta(ktime_get(), start);
+		kgsl_driver.submit_count++;
+		kgsl_driver.submit_wait_us += wait_us;
+		if (wait_us > kgsl_driver.submit_wait_max_us)
+			kgsl_driver.submit_wait_max_us = wait_us;
 #ifdef CONFIG_MSM_KGSL_MMU
-		if (kgsl_cache_enable)
-			kgsl_clean_cache_all(private);
+		if (kgsl_cache_enable) {
+			kgsl_runpending(&kgsl_driver.yamato_device);
+			kgsl_runpending(&kgsl_driver.g12_device);
+		}
 #endif
 #ifdef CONFIG_MSM_KGSL_DRM
 		kgsl_gpu_mem_flush();
@@ -1432,12 +1551,6 @@ static long kgsl_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 		result = kgsl_ioctl_rb_issueibcmds(private, (void __user *)arg);
 		break;
 
-	case IOCTL_KGSL_CMDSTREAM_READTIMESTAMP:
-		result =
-		    kgsl_ioctl_cmdstream_readtimestamp(private,
-							(void __user *)arg);
-		break;
-
 	case IOCTL_KGSL_CMDSTREAM_FREEMEMONTIMESTAMP:
 		result =
 		    kgsl_ioctl_cmdstream_freememontimestamp(private,
@@ -1454,10 +1567,6 @@ static long kgsl_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 		    kgsl_ioctl_drawctxt_destroy(private, (void __user *)arg);
 		break;
 
-	case IOCTL_KGSL_SHAREDMEM_FREE:
-		result = kgsl_ioctl_sharedmem_free(private, (void __user *)arg);
-		break;
-
 #ifdef CONFIG_MSM_KGSL_MMU
 	case IOCTL_KGSL_SHAREDMEM_FROM_VMALLOC:
 		kgsl_runpending(&kgsl_driver.yamato_device);
@@ -1465,13 +1574,6 @@ static long kgsl_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 		result = kgsl_ioctl_sharedmem_from_vmalloc(private,
 							   (void __user *)arg);
 		break;
-
-	case IOCTL_KGSL_SHAREDMEM_FLUSH_CACHE:
-		if (kgsl_cache_enable)
-			result =
-			    kgsl_ioctl_sharedmem_flush_cache(private,
-						       (void __user *)arg);
-		break;
 #endif
 	case IOCTL_KGSL_SHAREDMEM_FROM_PMEM:
 		kgsl_runpending(&kgsl_driver.yamato_device);
@@ -1511,6 +1613,7 @@ static long kgsl_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 		break;
 	}
 	KGSL_POST_HWACCESS();
+done:
 	KGSL_DRV_VDBG("result %d\n", result);
 	return result;
 }
@@ -1616,6 +1719,7 @@ static void kgsl_driver_cleanup(void)
 		kgsl_driver.g12_interrupt_num = 0;
 	}
 
+	kgsl_dcvs_close(kgsl_driver.pdev);
 	pm_qos_remove_requirement(PM_QOS_SYSTEM_BUS_FREQ, "kgsl_3d");
 
 	if (kgsl_driver.yamato_grp_pclk) {
@@ -1737,6 +1841,7 @@ static int __devinit kgsl_platform_probe(struct platform_device *pdev)
 		kgsl_driver.clk_freq[KGSL_3D_MIN_FREQ] = pdata->min_grp3d_freq;
 		kgsl_driver.clk_freq[KGSL_3D_MAX_FREQ] = pdata->max_grp3d_freq;
 	}
+	kgsl_dcvs_init(pdev, pdata);
 
 	pm_qos_add_requirement(PM_QOS_SYSTEM_BUS_FREQ, "kgsl_3d",
 				PM_QOS_DEFAULT_VALUE);
@@ -1846,12 +1951,14 @@ static struct platform_driver kgsl_platform_driver = {
 
 static int __init kgsl_mod_init(void)
 {
+	kgsl_pagepool_init();
 	return platform_driver_register(&kgsl_platform_driver);
 }
 
 static void __exit kgsl_mod_exit(void)
 {
 	platform_driver_unregister(&kgsl_platform_driver);
+	kgsl_pagepool_close();
 }
 
 #ifdef MODULE
@@ -97,6 +97,11 @@ struct kgsl_driver {
 	struct list_head pagetable_list;
 	/* Mutex for accessing the pagetable list */
 	struct mutex pt_mutex;
+
+	/* time issueibcmds spent waiting for the device, see debugfs */
+	unsigned int submit_count;
+	unsigned int submit_wait_max_us;
+	u64 submit_wait_us;
 };
 
 extern struct kgsl_driver kgsl_driver;
@@ -107,6 +112,8 @@ struct kgsl_mem_entry {
 	struct list_head list;
 	struct list_head free_list;
 	uint32_t free_timestamp;
+	/* backing pages of a KGSL_MEMFLAGS_VMALLOC_MEM allocation */
+	struct page **pages;
 	/* back pointer to private structure under whose context this
 	* allocation is made */
 	struct kgsl_file_private *priv;
@@ -55,13 +55,26 @@
  *
  */
 
+#include <linux/slab.h>
+#include <linux/module.h>
+
 #include "kgsl.h"
 #include "kgsl_device.h"
 #include "kgsl_cmdstream.h"
 #include "kgsl_sharedmem.h"
 
+static void kgsl_cmdstream_event_work(struct work_struct *work);
+static void kgsl_cmdstream_event_timer(unsigned long data);
+
 int kgsl_cmdstream_init(struct kgsl_device *device)
 {
+	INIT_LIST_HEAD(&device->events);
+	spin_lock_init(&device->event_lock);
+	device->event_active = 0;
+	device->event_irq = 0;
+	INIT_WORK(&device->event_work, kgsl_cmdstream_event_work);
+	setup_timer(&device->event_timer, kgsl_cmdstream_event_timer,
+		    (unsigned long) device);
 	return 0;
 }
 
@@ -133,6 +146,15 @@ void kgsl_cmdstream_memqueue_drain(struct kgsl_device *device)
 	}
 }
 
+static void kgsl_cmdstream_memqueue_cb(struct kgsl_device *device,
+				       void *priv, uint32_t timestamp)
+{
+	mutex_lock(&kgsl_driver.mutex);
+	if (device->flags & KGSL_FLAGS_INITIALIZED)
+		kgsl_cmdstream_memqueue_drain(device);
+	mutex_unlock(&kgsl_driver.mutex);
+}
+
 int
 kgsl_cmdstream_freememontimestamp(struct kgsl_device *device,
 				  struct kgsl_mem_entry *entry,
@@ -140,11 +162,280 @@ kgsl_cmdstream_freememontimestamp(struct kgsl_device *device,
 				  enum kgsl_timestamp_type type)
 {
 	struct kgsl_ringbuffer *rb = &device->ringbuffer;
+	struct kgsl_mem_entry *last;
+	int need_event = 1;
+
 	KGSL_MEM_DBG("enter (dev %p gpuaddr %x ts %d)\n",
 		     device, entry->memdesc.gpuaddr, timestamp);
 
+	/* one event per timestamp drains everything queued against it */
+	if (!list_empty(&rb->memqueue)) {
+		last = list_entry(rb->memqueue.prev, struct kgsl_mem_entry,
+				  free_list);
+		need_event = (last->free_timestamp != timestamp);
+	}
+
 	list_add_tail(&entry->free_list, &rb->memqueue);
 	entry->free_timestamp = timestamp;
 
+	/* without an event the entry is freed by the next runpending */
+	if (need_event && device == &kgsl_driver.yamato_device)
+		kgsl_add_event(device, timestamp, kgsl_cmdstream_memqueue_cb,
+			       NULL);
+
+	return 0;
+}
+
+/*
+ * Timestamp events
+ *
+ * Pending events are kept on device->events sorted by timestamp.  The
+ * first one still outstanding is programmed into the memstore as
+ * ref_wait_ts; the conditional interrupt written after every EOP
+ * timestamp in the ringbuffer fires once the CP gets that far, and the
+ * work item below retires everything that is done and re-arms for the
+ * next one.  The CACHE_FLUSH_TS write can land slightly after the
+ * interrupt, so an interrupt that finds nothing retired re-polls on the
+ * next tick, and a slow safety poll covers an interrupt lost while the
+ * compare was being re-armed.
+ */
+#define KGSL_EVENT_POLL_JIFFIES		(HZ / 10)
+
+/* must be called with event_lock held */
+static void kgsl_cmdstream_arm_locked(struct kgsl_device *device,
+				      uint32_t ts_processed)
+{
+	struct kgsl_event *event;
+
+	list_for_each_entry(event, &device->events, list) {
+		if (timestamp_cmp(ts_processed, event->timestamp))
+			continue;
+		kgsl_sharedmem_writel(&device->memstore,
+				      KGSL_DEVICE_MEMSTORE_OFFSET(ref_wait_ts),
+				      event->timestamp);
+		wmb();
+		kgsl_sharedmem_writel(&device->memstore,
+				      KGSL_DEVICE_MEMSTORE_OFFSET(ts_cmp_enable),
+				      1);
+		return;
+	}
+
+	kgsl_sharedmem_writel(&device->memstore,
+			      KGSL_DEVICE_MEMSTORE_OFFSET(ts_cmp_enable), 0);
+}
+
+/* must be called with event_lock held */
+static void kgsl_cmdstream_insert_locked(struct kgsl_device *device,
+					 struct kgsl_event *new)
+{
+	struct kgsl_event *event;
+
+	list_for_each_entry(event, &device->events, list) {
+		if (!timestamp_cmp(new->timestamp, event->timestamp)) {
+			list_add_tail(&new->list, &event->list);
+			return;
+		}
+	}
+	list_add_tail(&new->list, &device->events);
+}
+
+static int kgsl_cmdstream_queue_event(struct kgsl_device *device,
+				      struct kgsl_event *event)
+{
+	unsigned long flags;
+	uint32_t ts_processed;
+
+	spin_lock_irqsave(&device->event_lock, flags);
+	if (!device->event_active) {
+		spin_unlock_irqrestore(&device->event_lock, flags);
+		return -ENODEV;
+	}
+
+	kgsl_cmdstream_insert_locked(device, event);
+	ts_processed = kgsl_cmdstream_readtimestamp(device,
+						    KGSL_TIMESTAMP_RETIRED);
+	kgsl_cmdstream_arm_locked(device, ts_processed);
+
+	/* close the race with a timestamp that retired before the compare
+	 * was armed */
+	if (timestamp_cmp(ts_processed, event->timestamp))
+		schedule_work(&device->event_work);
+	else
+		mod_timer(&device->event_timer,
+			  jiffies + KGSL_EVENT_POLL_JIFFIES);
+	spin_unlock_irqrestore(&device->event_lock, flags);
+
 	return 0;
 }
+
+/**
+ * kgsl_add_event - call func once the GPU has retired timestamp
+ * @device: the yamato device
+ * @timestamp: retired timestamp to wait for
+ * @func: callback, run from process context without any KGSL locks held
+ * @priv: passed back to func
+ *
+ * Returns 0, -ENOMEM, or -ENODEV if the device is not running.  Events
+ * still pending when the device stops are dropped without running their
+ * callback.
+ */
+int kgsl_add_event(struct kgsl_device *device, uint32_t timestamp,
+		   void (*func)(struct kgsl_device *, void *, uint32_t),
+		   void *priv)
+{
+	struct kgsl_event *event;
+	int result;
+
+	BUG_ON(func == NULL);
+
+	event = kmalloc(sizeof(*event), GFP_KERNEL);
+	if (event == NULL)
+		return -ENOMEM;
+
+	event->timestamp = timestamp;
+	event->func = func;
+	event->priv = priv;
+
+	result = kgsl_cmdstream_queue_event(device, event);
+	if (result)
+		kfree(event);
+	return result;
+}
+EXPORT_SYMBOL(kgsl_add_event);
+
+void kgsl_cmdstream_add_waiter(struct kgsl_device *device,
+			       struct kgsl_event *waiter, uint32_t timestamp)
+{
+	waiter->timestamp = timestamp;
+	waiter->func = NULL;
+	waiter->priv = NULL;
+	INIT_LIST_HEAD(&waiter->list);
+
+	/* without the interrupt the waiter falls back to its own timeout */
+	kgsl_cmdstream_queue_event(device, waiter);
+}
+
+void kgsl_cmdstream_del_waiter(struct kgsl_device *device,
+			       struct kgsl_event *waiter)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&device->event_lock, flags);
+	/* the list is reinitialised if the device stopped under us */
+	list_del_init(&waiter->list);
+	if (device->event_active)
+		kgsl_cmdstream_arm_locked(device,
+			kgsl_cmdstream_readtimestamp(device,
+						     KGSL_TIMESTAMP_RETIRED));
+	spin_unlock_irqrestore(&device->event_lock, flags);
+}
+
+/* called from the CP interrupt handler on RB_INT */
+void kgsl_cmdstream_event_irq(struct kgsl_device *device)
+{
+	device->event_irq = 1;
+	wake_up_interruptible_all(&device->ib1_wq);
+	schedule_work(&device->event_work);
+}
+
+static void kgsl_cmdstream_event_timer(unsigned long data)
+{
+	struct kgsl_device *device = (struct kgsl_device *) data;
+
+	schedule_work(&device->event_work);
+}
+
+static void kgsl_cmdstream_event_work(struct work_struct *work)
+{
+	struct kgsl_device *device = container_of(work, struct kgsl_device,
+						  event_work);
+	struct kgsl_event *event, *event_tmp;
+	unsigned long flags;
+	uint32_t ts_processed;
+	int retired = 0, irq;
+	LIST_HEAD(done);
+
+	spin_lock_irqsave(&device->event_lock, flags);
+	irq = device->event_irq;
+	device->event_irq = 0;
+
+	if (!device->event_active) {
+		spin_unlock_irqrestore(&device->event_lock, flags);
+		return;
+	}
+
+	ts_processed = kgsl_cmdstream_readtimestamp(device,
+						    KGSL_TIMESTAMP_RETIRED);
+
+	list_for_each_entry_safe(event, event_tmp, &device->events, list) {
+		if (!timestamp_cmp(ts_processed, event->timestamp))
+			break;
+		retired++;
+		/* waiters stay queued until their owner removes them */
+		if (event->func)
+			list_move_tail(&event->list, &done);
+	}
+
+	kgsl_cmdstream_arm_locked(device, ts_processed);
+
+	if (&event->list != &device->events) {
+		if (irq && !retired)
+			mod_timer(&device->event_timer, jiffies + 1);
+		else
+			mod_timer(&device->event_timer,
+				  jiffies + KGSL_EVENT_POLL_JIFFIES);
+	}
+	spin_unlock_irqrestore(&device->event_lock, flags);
+
+	if (retired)
+		wake_up_interruptible_all(&device->ib1_wq);
+
+	list_for_each_entry_safe(event, event_tmp, &done, list) {
+		list_del(&event->list);
+		event->func(device, event->priv, ts_processed);
+		kfree(event);
+	}
+}
+
+void kgsl_cmdstream_events_start(struct kgsl_device *device)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&device->event_lock, flags);
+	device->event_active = 1;
+	device->event_irq = 0;
+	kgsl_sharedmem_writel(&device->memstore,
+			      KGSL_DEVICE_MEMSTORE_OFFSET(ts_cmp_enable), 0);
+	spin_unlock_irqrestore(&device->event_lock, flags);
+}
+
+/*
+ * Called with the driver mutex held, which the memqueue callback also
+ * takes, so neither the timer nor the work item can be waited for here.
+ * Both check event_active and do nothing once it is cleared.
+ */
+void kgsl_cmdstream_events_stop(struct kgsl_device *device)
+{
+	struct kgsl_event *event, *event_tmp;
+	unsigned long flags;
+
+	spin_lock_irqsave(&device->event_lock, flags);
+	device->event_active = 0;
+	if (device->memstore.hostptr)
+		kgsl_sharedmem_writel(&device->memstore,
+			KGSL_DEVICE_MEMSTORE_OFFSET(ts_cmp_enable), 0);
+
+	list_for_each_entry_safe(event, event_tmp, &device->events, list) {
+		list_del_init(&event->list);
+		if (event->func) {
+			KGSL_DRV_WARN("dropping event for timestamp %d\n",
+				      event->timestamp);
+			kfree(event);
+		}
+	}
+	spin_unlock_irqrestore(&device->event_lock, flags);
+
+	del_timer(&device->event_timer);
+	/* wake anybody still waiting so they notice the device is gone */
+	wake_up_interruptible_all(&device->ib1_wq);
+}
@@ -71,4 +71,31 @@ kgsl_cmdstream_freememontimestamp(struct kgsl_device *device,
 				  uint32_t timestamp,
 				  enum kgsl_timestamp_type type);
 
+/*
+ * Timestamp events.  A callback registered with kgsl_add_event() runs
+ * from process context once the retired timestamp reaches the requested
+ * value.  Waiters use an event without a callback so that the CP raises
+ * an interrupt for their timestamp.
+ */
+struct kgsl_event {
+	uint32_t timestamp;
+	void (*func)(struct kgsl_device *device, void *priv,
+		     uint32_t timestamp);
+	void *priv;
+	struct list_head list;
+};
+
+int kgsl_add_event(struct kgsl_device *device, uint32_t timestamp,
+		   void (*func)(struct kgsl_device *, void *, uint32_t),
+		   void *priv);
+
+void kgsl_cmdstream_add_waiter(struct kgsl_device *device,
+			       struct kgsl_event *waiter, uint32_t timestamp);
+void kgsl_cmdstream_del_waiter(struct kgsl_device *device,
+			       struct kgsl_event *waiter);
+
+void kgsl_cmdstream_event_irq(struct kgsl_device *device);
+void kgsl_cmdstream_events_start(struct kgsl_device *device);
+void kgsl_cmdstream_events_stop(struct kgsl_device *device);
+
 #endif /* __KGSL_CMDSTREAM_H */
@@ -0,0 +1,517 @@
+/* Copyright (c) 2010, Code Aurora Forum. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Code Aurora nor
+ *       the names of its contributors may be used to endorse or promote
+ *       products derived from this software without specific prior written
+ *       permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <linux/kernel.h>
+#include <linux/device.h>
+#include <linux/platform_device.h>
+#include <linux/workqueue.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/clk.h>
+#include <linux/pm_qos_params.h>
+#include <mach/clk.h>
+
+#include "kgsl.h"
+#include "kgsl_dcvs.h"
+#include "kgsl_log.h"
+
+/*
+ * GPU dynamic clock and voltage scaling for the 3D core.
+ *
+ * Busy time is the time between a ringbuffer submit and the point where
+ * the ringbuffer is seen empty again, either from the interrupt handler
+ * or from the periodic sample.  Every sample_ms the busy percentage of
+ * the last window is run through kgsl_dcvs_policy(): a busy core jumps
+ * straight to the top level, a lightly loaded one steps down one level
+ * at a time.  Level 0 is always the platform maximum, so disabling
+ * DCVS restores the fixed clock and bus request.
+ */
+
+#define KGSL_DCVS_MAX_LEVELS		3
+#define KGSL_DCVS_SAMPLE_MS		50
+#define KGSL_DCVS_UP_THRESHOLD		80
+#define KGSL_DCVS_DOWN_THRESHOLD	30
+#define KGSL_DCVS_SIM_SAMPLES		128
+
+struct kgsl_dcvs_level {
+	unsigned int gpu_freq;	/* Hz, floor for grp_src_clk */
+	unsigned int bus_freq;	/* KHz, PM_QOS_SYSTEM_BUS_FREQ request */
+};
+
+static struct {
+	struct kgsl_dcvs_level levels[KGSL_DCVS_MAX_LEVELS];
+	int num_levels;
+	int level;
+
+	/* tunables */
+	unsigned int enabled;
+	unsigned int up_threshold;
+	unsigned int down_threshold;
+	unsigned int sample_ms;
+
+	/* busy accounting, lock protects against the isr */
+	spinlock_t lock;
+	int busy;
+	ktime_t busy_start;
+	ktime_t window_start;
+	s64 busy_us;
+
+	/* statistics */
+	unsigned int last_busy;
+	unsigned int transitions;
+	unsigned long level_stamp;
+	unsigned long time_in_level[KGSL_DCVS_MAX_LEVELS];
+
+	struct delayed_work work;
+	int running;
+	int have_sysfs;
+
+	/* simulation: busy trace in, chosen levels out */
+	unsigned int sim_count;
+	unsigned char sim_busy[KGSL_DCVS_SIM_SAMPLES];
+	unsigned char sim_level[KGSL_DCVS_SIM_SAMPLES];
+} kgsl_dcvs;
+
+static int kgsl_dcvs_policy(int level, unsigned int busy)
+{
+	if (busy >= kgsl_dcvs.up_threshold)
+		return 0;
+	if (busy < kgsl_dcvs.down_threshold &&
+	    level < kgsl_dcvs.num_levels - 1)
+		return level + 1;
+	return level;
+}
+
+unsigned int kgsl_dcvs_gpu_freq(void)
+{
+	return kgsl_dcvs.levels[kgsl_dcvs.level].gpu_freq;
+}
+
+unsigned int kgsl_dcvs_bus_freq(void)
+{
+	return kgsl_dcvs.levels[kgsl_dcvs.level].bus_freq;
+}
+
+static void kgsl_dcvs_account_level(void)
+{
+	unsigned long now = jiffies;
+
+	kgsl_dcvs.time_in_level[kgsl_dcvs.level] +=
+		now - kgsl_dcvs.level_stamp;
+	kgsl_dcvs.level_stamp = now;
+}
+
+/* Caller must hold the driver mutex. */
+static void kgsl_dcvs_set_level(int level)
+{
+	struct kgsl_dcvs_level *new = &kgsl_dcvs.levels[level];
+	int up = level < kgsl_dcvs.level;
+
+	if (level == kgsl_dcvs.level)
+		return;
+
+	if (kgsl_dcvs.running)
+		kgsl_dcvs_account_level();
+	kgsl_dcvs.level = level;
+	kgsl_dcvs.transitions++;
+
+	/* the new floors are applied when the core next clocks on */
+	if (!(kgsl_driver.power_flags & KGSL_PWRFLAGS_YAMATO_CLK_ON))
+		return;
+
+	/* raise the bus before the core clock, lower it after */
+	if (up && new->bus_freq)
+		pm_qos_update_requirement(PM_QOS_SYSTEM_BUS_FREQ, "kgsl_3d",
+					  new->bus_freq);
+	if (new->gpu_freq)
+		clk_set_min_rate(kgsl_driver.yamato_grp_src_clk,
+				 new->gpu_freq);
+	if (!up && new->bus_freq)
+		pm_qos_update_requirement(PM_QOS_SYSTEM_BUS_FREQ, "kgsl_3d",
+					  new->bus_freq);
+
+	KGSL_DRV_DBG("dcvs level %d gpu %u bus %u\n", level,
+		     new->gpu_freq, new->bus_freq);
+}
+
+void kgsl_dcvs_busy(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&kgsl_dcvs.lock, flags);
+	if (!kgsl_dcvs.busy) {
+		kgsl_dcvs.busy = 1;
+		kgsl_dcvs.busy_start = ktime_get();
+	}
+	spin_unlock_irqrestore(&kgsl_dcvs.lock, flags);
+}
+
+void kgsl_dcvs_idle(void)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&kgsl_dcvs.lock, flags);
+	if (kgsl_dcvs.busy) {
+		kgsl_dcvs.busy_us += ktime_us_delta(ktime_get(),
+						    kgsl_dcvs.busy_start);
+		kgsl_dcvs.busy = 0;
+	}
+	spin_unlock_irqrestore(&kgsl_dcvs.lock, flags);
+}
+
+/* Returns the busy percentage of the window just ended and opens a new one */
+static unsigned int kgsl_dcvs_window_busy(void)
+{
+	unsigned long flags;
+	ktime_t now = ktime_get();
+	s64 busy_us, total_us;
+
+	spin_lock_irqsave(&kgsl_dcvs.lock, flags);
+	busy_us = kgsl_dcvs.busy_us;
+	if (kgsl_dcvs.busy) {
+		busy_us += ktime_us_delta(now, kgsl_dcvs.busy_start);
+		kgsl_dcvs.busy_start = now;
+	}
+	total_us = ktime_us_delta(now, kgsl_dcvs.window_start);
+	kgsl_dcvs.window_start = now;
+	kgsl_dcvs.busy_us = 0;
+	spin_unlock_irqrestore(&kgsl_dcvs.lock, flags);
+
+	if (total_us <= 0)
+		return 0;
+	if (busy_us >= total_us)
+		return 100;
+	return div_u64((u64)busy_us * 100, (u32)total_us);
+}
+
+static void kgsl_dcvs_sample(struct work_struct *work)
+{
+	struct kgsl_device *device = &kgsl_driver.yamato_device;
+	unsigned int busy;
+
+	mutex_lock(&kgsl_driver.mutex);
+	if (!kgsl_dcvs.running || device->hwaccess_blocked == KGSL_TRUE)
+		goto done;
+
+	if (kgsl_yamato_isidle(device))
+		kgsl_dcvs_idle();
+
+	busy = kgsl_dcvs_window_busy();
+	kgsl_dcvs.last_busy = busy;
+	kgsl_dcvs_account_level();
+
+	if (kgsl_dcvs.enabled)
+		kgsl_dcvs_set_level(kgsl_dcvs_policy(kgsl_dcvs.level, busy));
+
+	schedule_delayed_work(&kgsl_dcvs.work,
+			      msecs_to_jiffies(kgsl_dcvs.sample_ms));
+done:
+	mutex_unlock(&kgsl_driver.mutex);
+}
+
+/* Caller must hold the driver mutex. */
+void kgsl_dcvs_start(void)
+{
+	unsigned long flags;
+
+	if (kgsl_dcvs.running || kgsl_dcvs.num_levels < 2)
+		return;
+
+	spin_lock_irqsave(&kgsl_dcvs.lock, flags);
+	kgsl_dcvs.window_start = ktime_get();
+	kgsl_dcvs.busy_us = 0;
+	spin_unlock_irqrestore(&kgsl_dcvs.lock, flags);
+
+	kgsl_dcvs.level_stamp = jiffies;
+	kgsl_dcvs.running = 1;
+	schedule_delayed_work(&kgsl_dcvs.work,
+			      msecs_to_jiffies(kgsl_dcvs.sample_ms));
+}
+
+/* Caller must hold the driver mutex. */
+void kgsl_dcvs_stop(void)
+{
+	if (!kgsl_dcvs.running)
+		return;
+
+	kgsl_dcvs_idle();
+	kgsl_dcvs_account_level();
+	kgsl_dcvs.running = 0;
+	/* a sample already running sees !running and does not re-arm */
+	cancel_delayed_work(&kgsl_dcvs.work);
+}
+
+static ssize_t kgsl_dcvs_enable_show(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", kgsl_dcvs.enabled);
+}
+
+static ssize_t kgsl_dcvs_enable_store(struct device *dev,
+				      struct device_attribute *attr,
+				      const char *buf, size_t count)
+{
+	unsigned long val = simple_strtoul(buf, NULL, 0);
+
+	mutex_lock(&kgsl_driver.mutex);
+	kgsl_dcvs.enabled = (val != 0);
+	if (!kgsl_dcvs.enabled)
+		kgsl_dcvs_set_level(0);
+	mutex_unlock(&kgsl_driver.mutex);
+
+	return count;
+}
+
+static ssize_t kgsl_dcvs_up_threshold_show(struct device *dev,
+					   struct device_attribute *attr,
+					   char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", kgsl_dcvs.up_threshold);
+}
+
+static ssize_t kgsl_dcvs_up_threshold_store(struct device *dev,
+					    struct device_attribute *attr,
+					    const char *buf, size_t count)
+{
+	unsigned long val = simple_strtoul(buf, NULL, 0);
+
+	if (val > 100 || val <= kgsl_dcvs.down_threshold)
+		return -EINVAL;
+
+	kgsl_dcvs.up_threshold = val;
+	return count;
+}
+
+static ssize_t kgsl_dcvs_down_threshold_show(struct device *dev,
+					     struct device_attribute *attr,
+					     char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", kgsl_dcvs.down_threshold);
+}
+
+static ssize_t kgsl_dcvs_down_threshold_store(struct device *dev,
+					      struct device_attribute *attr,
+					      const char *buf, size_t count)
+{
+	unsigned long val = simple_strtoul(buf, NULL, 0);
+
+	if (val >= kgsl_dcvs.up_threshold)
+		return -EINVAL;
+
+	kgsl_dcvs.down_threshold = val;
+	return count;
+}
+
+static ssize_t kgsl_dcvs_sample_ms_show(struct device *dev,
+					struct device_attribute *attr,
+					char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", kgsl_dcvs.sample_ms);
+}
+
+static ssize_t kgsl_dcvs_sample_ms_store(struct device *dev,
+					 struct device_attribute *attr,
+					 const char *buf, size_t count)
+{
+	unsigned long val = simple_strtoul(buf, NULL, 0);
+
+	if (val < 10 || val > 1000)
+		return -EINVAL;
+
+	kgsl_dcvs.sample_ms = val;
+	return count;
+}
+
+static ssize_t kgsl_dcvs_stats_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	int i, len = 0;
+
+	mutex_lock(&kgsl_driver.mutex);
+	if (kgsl_dcvs.running)
+		kgsl_dcvs_account_level();
+
+	len += snprintf(buf + len, PAGE_SIZE - len,
+			"level %d busy %u%% transitions %u\n",
+			kgsl_dcvs.level, kgsl_dcvs.last_busy,
+			kgsl_dcvs.transitions);
+	for (i = 0; i < kgsl_dcvs.num_levels; i++)
+		len += snprintf(buf + len, PAGE_SIZE - len,
+				"%d: gpu %u bus %u time %u ms\n", i,
+				kgsl_dcvs.levels[i].gpu_freq,
+				kgsl_dcvs.levels[i].bus_freq,
+				jiffies_to_msecs(kgsl_dcvs.time_in_level[i]));
+	mutex_unlock(&kgsl_driver.mutex);
+
+	return len;
+}
+
+/*
+ * Writing a list of busy percentages replays them through the policy
+ * with the current thresholds, starting from level 0, without touching
+ * the clocks.  Reading back gives the level chosen for every sample.
+ */
+static ssize_t kgsl_dcvs_simulate_show(struct device *dev,
+				       struct device_attribute *attr,
+				       char *buf)
+{
+	unsigned int i, transitions = 0;
+	int len = 0;
+
+	for (i = 1; i < kgsl_dcvs.sim_count; i++)
+		if (kgsl_dcvs.sim_level[i] != kgsl_dcvs.sim_level[i - 1])
+			transitions++;
+
+	len += snprintf(buf + len, PAGE_SIZE - len,
+			"samples %u transitions %u\n",
+			kgsl_dcvs.sim_count, transitions);
+	for (i = 0; i < kgsl_dcvs.sim_count; i++)
+		len += snprintf(buf + len, PAGE_SIZE - len, "%u %u %u\n",
+				kgsl_dcvs.sim_busy[i], kgsl_dcvs.sim_level[i],
+			kgsl_dcvs.levels[kgsl_dcvs.sim_level[i]].gpu_freq);
+
+	return len;
+}
+
+static ssize_t kgsl_dcvs_simulate_store(struct device *dev,
+					struct device_attribute *attr,
+					const char *buf, size_t count)
+{
+	const char *p = buf;
+	char *end;
+	unsigned long busy;
+	unsigned int n = 0;
+	int level = 0;
+
+	while (n < KGSL_DCVS_SIM_SAMPLES) {
+		while (*p == ' ' || *p == ',' || *p == '\n')
+			p++;
+		if (p >= buf + count || *p == '\0')
+			break;
+		busy = simple_strtoul(p, &end, 0);
+		if (end == p || busy > 100)
+			return -EINVAL;
+		p = end;
+
+		level = kgsl_dcvs_policy(level, busy);
+		kgsl_dcvs.sim_busy[n] = busy;
+		kgsl_dcvs.sim_level[n] = level;
+		n++;
+	}
+	kgsl_dcvs.sim_count = n;
+
+	return count;
+}
+
+static DEVICE_ATTR(enable, 0644, kgsl_dcvs_enable_show,
+		   kgsl_dcvs_enable_store);
+static DEVICE_ATTR(up_threshold, 0644, kgsl_dcvs_up_threshold_show,
+		   kgsl_dcvs_up_threshold_store);
+static DEVICE_ATTR(down_threshold, 0644, kgsl_dcvs_down_threshold_show,
+		   kgsl_dcvs_down_threshold_store);
+static DEVICE_ATTR(sample_ms, 0644, kgsl_dcvs_sample_ms_show,
+		   kgsl_dcvs_sample_ms_store);
+static DEVICE_ATTR(stats, 0444, kgsl_dcvs_stats_show, NULL);
+static DEVICE_ATTR(simulate, 0644, kgsl_dcvs_simulate_show,
+		   kgsl_dcvs_simulate_store);
+
+static struct attribute *kgsl_dcvs_attrs[] = {
+	&dev_attr_enable.attr,
+	&dev_attr_up_threshold.attr,
+	&dev_attr_down_threshold.attr,
+	&dev_attr_sample_ms.attr,
+	&dev_attr_stats.attr,
+	&dev_attr_simulate.attr,
+	NULL,
+};
+
+static struct attribute_group kgsl_dcvs_attr_group = {
+	.name = "dcvs",
+	.attrs = kgsl_dcvs_attrs,
+};
+
+void kgsl_dcvs_init(struct platform_device *pdev,
+		    struct kgsl_platform_data *pdata)
+{
+	unsigned int max_freq = 0, min_freq = 0, bus = 0;
+	int i;
+
+	spin_lock_init(&kgsl_dcvs.lock);
+	INIT_DELAYED_WORK_DEFERRABLE(&kgsl_dcvs.work, kgsl_dcvs_sample);
+
+	kgsl_dcvs.up_threshold = KGSL_DCVS_UP_THRESHOLD;
+	kgsl_dcvs.down_threshold = KGSL_DCVS_DOWN_THRESHOLD;
+	kgsl_dcvs.sample_ms = KGSL_DCVS_SAMPLE_MS;
+	kgsl_dcvs.level = 0;
+
+	if (pdata) {
+		max_freq = pdata->max_grp3d_freq;
+		min_freq = pdata->min_grp3d_freq;
+		bus = pdata->high_axi_3d;
+	}
+
+	/*
+	 * Level 0 is the fixed setting used so far.  Lower levels spread
+	 * evenly down to the platform minimum, with the bus request
+	 * scaled in proportion to the core clock.
+	 */
+	kgsl_dcvs.levels[0].gpu_freq = max_freq;
+	kgsl_dcvs.levels[0].bus_freq = bus;
+	kgsl_dcvs.num_levels = 1;
+	if (max_freq && min_freq && min_freq < max_freq) {
+		for (i = 1; i < KGSL_DCVS_MAX_LEVELS; i++) {
+			unsigned int freq = max_freq - (max_freq - min_freq) *
+				i / (KGSL_DCVS_MAX_LEVELS - 1);
+
+			kgsl_dcvs.levels[i].gpu_freq = freq;
+			kgsl_dcvs.levels[i].bus_freq = bus ?
+				(unsigned int)div_u64((u64)bus * freq,
+						      max_freq) : 0;
+		}
+		kgsl_dcvs.num_levels = KGSL_DCVS_MAX_LEVELS;
+		kgsl_dcvs.enabled = 1;
+	}
+
+	if (sysfs_create_group(&pdev->dev.kobj, &kgsl_dcvs_attr_group))
+		KGSL_DRV_ERR("failed to create dcvs sysfs group\n");
+	else
+		kgsl_dcvs.have_sysfs = 1;
+}
+
+void kgsl_dcvs_close(struct platform_device *pdev)
+{
+	if (kgsl_dcvs.num_levels == 0)
+		return;
+
+	kgsl_dcvs.running = 0;
+	cancel_delayed_work_sync(&kgsl_dcvs.work);
+	if (kgsl_dcvs.have_sysfs)
+		sysfs_remove_group(&pdev->dev.kobj, &kgsl_dcvs_attr_group);
+	kgsl_dcvs.have_sysfs = 0;
+	kgsl_dcvs.num_levels = 0;
+}
@@ -32,6 +32,8 @@
 #include <linux/irqreturn.h>
 #include <linux/wait.h>
 #include <linux/workqueue.h>
+#include <linux/spinlock.h>
+#include <linux/timer.h>
 #include <linux/msm_kgsl.h>
 
 #include <asm/atomic.h>
@@ -125,6 +127,14 @@ struct kgsl_device {
 	int timestamp;
 
 	wait_queue_head_t wait_timestamp_wq;
+
+	/* timestamp events, sorted by timestamp; see kgsl_cmdstream.c */
+	struct list_head events;
+	spinlock_t event_lock;
+	int event_active;
+	int event_irq;
+	struct work_struct event_work;
+	struct timer_list event_timer;
 };
 
 struct kgsl_devconfig {
@@ -153,6 +163,8 @@ int kgsl_yamato_idle(struct kgsl_device *device, unsigned int timeout);
 
 int kgsl_yamato_wake(struct kgsl_device *device);
 
+unsigned int kgsl_yamato_isidle(struct kgsl_device *device);
+
 int kgsl_yamato_suspend(struct kgsl_device *device);
 
 int kgsl_yamato_getproperty(struct kgsl_device *device,
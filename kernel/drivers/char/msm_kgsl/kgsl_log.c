@@ -55,10 +55,13 @@
  *
  */
 #include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/math64.h>
 #include "kgsl_log.h"
 #include "kgsl_ringbuffer.h"
 #include "kgsl_device.h"
 #include "kgsl.h"
+#include "kgsl_pagepool.h"
 
 /*default log levels is error for everything*/
 #define KGSL_LOG_LEVEL_DEFAULT 3
@@ -294,6 +297,49 @@ DEFINE_SIMPLE_ATTRIBUTE(kgsl_cache_enable_fops, kgsl_cache_enable_get,
 			kgsl_cache_enable_set, "%llu\n");
 #endif /*CONFIG_MSM_KGSL_MMU*/
 
+/* Time issueibcmds waits to own the device; write anything to reset. */
+static int kgsl_submit_stats_show(struct seq_file *s, void *unused)
+{
+	unsigned int count, max_us;
+	u64 total_us;
+
+	mutex_lock(&kgsl_driver.mutex);
+	count = kgsl_driver.submit_count;
+	max_us = kgsl_driver.submit_wait_max_us;
+	total_us = kgsl_driver.submit_wait_us;
+	mutex_unlock(&kgsl_driver.mutex);
+
+	seq_printf(s, "submits %u wait total %llu us avg %llu us max %u us\n",
+		   count, total_us, count ? div_u64(total_us, count) : 0,
+		   max_us);
+	return 0;
+}
+
+static int kgsl_submit_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, kgsl_submit_stats_show, NULL);
+}
+
+static ssize_t kgsl_submit_stats_write(struct file *file,
+				       const char __user *buf,
+				       size_t count, loff_t *ppos)
+{
+	mutex_lock(&kgsl_driver.mutex);
+	kgsl_driver.submit_count = 0;
+	kgsl_driver.submit_wait_max_us = 0;
+	kgsl_driver.submit_wait_us = 0;
+	mutex_unlock(&kgsl_driver.mutex);
+	return count;
+}
+
+static const struct file_operations kgsl_submit_stats_fops = {
+	.open = kgsl_submit_stats_open,
+	.read = seq_read,
+	.write = kgsl_submit_stats_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 #endif /* CONFIG_DEBUG_FS */
 
 int kgsl_debug_init(void)
@@ -312,6 +358,8 @@ int kgsl_debug_init(void)
 				&kgsl_drv_log_fops);
 	debugfs_create_file("log_level_mem", 0644, dent, 0,
 				&kgsl_mem_log_fops);
+	debugfs_create_file("submit_stats", 0644, dent, 0,
+				&kgsl_submit_stats_fops);
 #ifdef DEBUG
 	debugfs_create_file("rb_regs", 0444, dent, 0,
 				&kgsl_rb_regs_fops);
@@ -325,6 +373,7 @@ int kgsl_debug_init(void)
 #ifdef CONFIG_MSM_KGSL_MMU
     debugfs_create_file("cache_enable", 0644, dent, 0,
 				&kgsl_cache_enable_fops);
+	kgsl_pagepool_debugfs_init(dent);
 #endif
 
 #endif /* CONFIG_DEBUG_FS */
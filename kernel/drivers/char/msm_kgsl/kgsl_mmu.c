@@ -55,6 +55,7 @@
  *
  */
 #include <linux/types.h>
+#include <linux/mm.h>
 #include <linux/mutex.h>
 #include <linux/spinlock.h>
 #include <linux/genalloc.h>
@@ -573,9 +574,10 @@ pte_t *kgsl_get_pte_from_vaddr(unsigned int virtaddr)
 	return pte_ptr;
 }
 
-int
-kgsl_mmu_map(struct kgsl_pagetable *pagetable,
+static int
+kgsl_mmu_map_common(struct kgsl_pagetable *pagetable,
 				unsigned int address,
+				struct page **pages,
 				int range,
 				unsigned int protflags,
 				unsigned int *gpuaddr,
@@ -654,6 +656,8 @@ kgsl_mmu_map(struct kgsl_pagetable *pagetable,
 		/* mark pte as in use */
 		if (phys_contiguous)
 			physaddr = address;
+		else if (pages)
+			physaddr = page_to_phys(pages[pte - ptefirst]);
 		else {
 			physaddr = vmalloc_to_pfn((void *)address);
 			physaddr <<= PAGE_SHIFT;
@@ -701,6 +705,38 @@ kgsl_mmu_map(struct kgsl_pagetable *pagetable,
 	return 0;
 }
 
+int
+kgsl_mmu_map(struct kgsl_pagetable *pagetable,
+				unsigned int address,
+				int range,
+				unsigned int protflags,
+				unsigned int *gpuaddr,
+				unsigned int flags)
+{
+	return kgsl_mmu_map_common(pagetable, address, NULL, range,
+				   protflags, gpuaddr, flags);
+}
+
+/*
+ * Map an array of pages, such as one handed out by the page pool.  The
+ * physical addresses come straight from the page array, which saves a
+ * kernel page table walk per page compared to mapping the vmap()ed
+ * address with kgsl_mmu_map().
+ */
+int
+kgsl_mmu_map_pages(struct kgsl_pagetable *pagetable,
+				struct page **pages,
+				int range,
+				unsigned int protflags,
+				unsigned int *gpuaddr,
+				unsigned int flags)
+{
+	BUG_ON(flags & KGSL_MEMFLAGS_CONPHYS);
+
+	return kgsl_mmu_map_common(pagetable, 0, pages, range,
+				   protflags, gpuaddr, flags);
+}
+
 int
 kgsl_mmu_unmap(struct kgsl_pagetable *pagetable, unsigned int gpuaddr,
 		int range)
@@ -67,6 +67,7 @@ extern unsigned int kgsl_cache_enable;
 #endif
 
 struct kgsl_device;
+struct page;
 
 struct kgsl_mmu_debug {
 	unsigned int  config;
@@ -168,6 +169,13 @@ int kgsl_mmu_map(struct kgsl_pagetable *pagetable,
 		 unsigned int *gpuaddr,
 		 unsigned int flags);
 
+int kgsl_mmu_map_pages(struct kgsl_pagetable *pagetable,
+		 struct page **pages,
+		 int range,
+		 unsigned int protflags,
+		 unsigned int *gpuaddr,
+		 unsigned int flags);
+
 int kgsl_mmu_unmap(struct kgsl_pagetable *pagetable,
 					unsigned int gpuaddr, int range);
 
@@ -0,0 +1,321 @@
+/* Copyright (c) 2010, Code Aurora Forum. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Code Aurora nor
+ *       the names of its contributors may be used to endorse or promote
+ *       products derived from this software without specific prior written
+ *       permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/list.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <asm/cacheflush.h>
+
+#include "kgsl_log.h"
+#include "kgsl_pagepool.h"
+
+/* Default cap on the number of idle pages held by the pool (4MB) */
+#define KGSL_PAGEPOOL_MAX_PAGES	1024
+
+/*
+ * Pages sitting in the pool are always zeroed and flushed out of the
+ * data cache, so they can be handed to the GPU and to userspace without
+ * any further cache maintenance.  Pages are linked through page->lru.
+ */
+static struct {
+	spinlock_t lock;
+	struct list_head list;
+	unsigned int count;
+	unsigned int max_pages;
+
+	/* statistics, protected by lock */
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int allocs;
+	unsigned int shrunk;
+	u64 total_us;
+	unsigned int max_us;
+} kgsl_pagepool;
+
+static void kgsl_pagepool_clean(struct page *page)
+{
+	void *addr = page_address(page);
+
+	dmac_flush_range(addr, addr + PAGE_SIZE);
+}
+
+static struct page **kgsl_pagepool_array_alloc(unsigned int count)
+{
+	unsigned int size = count * sizeof(struct page *);
+
+	if (size > PAGE_SIZE)
+		return vmalloc(size);
+	return kmalloc(size, GFP_KERNEL);
+}
+
+static void kgsl_pagepool_array_free(struct page **pages, unsigned int count)
+{
+	if (count * sizeof(struct page *) > PAGE_SIZE)
+		vfree(pages);
+	else
+		kfree(pages);
+}
+
+/**
+ * kgsl_pagepool_alloc - get @count zeroed, cache clean pages
+ * @count: number of pages
+ *
+ * Pages come from the pool first and from the page allocator after
+ * that.  Returns an array of @count pages that must be released with
+ * kgsl_pagepool_free(), or NULL on failure.
+ */
+struct page **kgsl_pagepool_alloc(unsigned int count)
+{
+	struct page **pages;
+	struct page *page;
+	unsigned int i, hits;
+	ktime_t start;
+	s64 us;
+
+	start = ktime_get();
+
+	pages = kgsl_pagepool_array_alloc(count);
+	if (pages == NULL)
+		return NULL;
+
+	spin_lock(&kgsl_pagepool.lock);
+	for (i = 0; i < count && kgsl_pagepool.count; i++) {
+		page = list_first_entry(&kgsl_pagepool.list, struct page, lru);
+		list_del(&page->lru);
+		kgsl_pagepool.count--;
+		pages[i] = page;
+	}
+	spin_unlock(&kgsl_pagepool.lock);
+	hits = i;
+
+	for (; i < count; i++) {
+		page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if (page == NULL) {
+			KGSL_MEM_ERR("alloc_page failed after %d of %d pages\n",
+				     i, count);
+			while (i--)
+				__free_page(pages[i]);
+			kgsl_pagepool_array_free(pages, count);
+			return NULL;
+		}
+		kgsl_pagepool_clean(page);
+		pages[i] = page;
+	}
+
+	us = ktime_us_delta(ktime_get(), start);
+
+	spin_lock(&kgsl_pagepool.lock);
+	kgsl_pagepool.hits += hits;
+	kgsl_pagepool.misses += count - hits;
+	kgsl_pagepool.allocs++;
+	kgsl_pagepool.total_us += us;
+	if (us > kgsl_pagepool.max_us)
+		kgsl_pagepool.max_us = us;
+	spin_unlock(&kgsl_pagepool.lock);
+
+	return pages;
+}
+
+/**
+ * kgsl_pagepool_free - release pages obtained from kgsl_pagepool_alloc
+ * @pages: page array, freed by this call
+ * @count: number of pages in @pages
+ *
+ * Pages are scrubbed and kept for reuse while the pool is below its
+ * cap.  A page that still has another reference (a userspace mapping
+ * that outlived the GPU allocation) is never recycled.
+ */
+void kgsl_pagepool_free(struct page **pages, unsigned int count)
+{
+	LIST_HEAD(scrubbed);
+	unsigned int i, room, kept = 0;
+
+	spin_lock(&kgsl_pagepool.lock);
+	room = kgsl_pagepool.max_pages > kgsl_pagepool.count ?
+		kgsl_pagepool.max_pages - kgsl_pagepool.count : 0;
+	spin_unlock(&kgsl_pagepool.lock);
+
+	for (i = 0; i < count; i++) {
+		struct page *page = pages[i];
+
+		if (kept < room && page_count(page) == 1) {
+			clear_page(page_address(page));
+			kgsl_pagepool_clean(page);
+			list_add_tail(&page->lru, &scrubbed);
+			kept++;
+		} else
+			__free_page(page);
+	}
+
+	if (kept) {
+		spin_lock(&kgsl_pagepool.lock);
+		list_splice(&scrubbed, &kgsl_pagepool.list);
+		kgsl_pagepool.count += kept;
+		spin_unlock(&kgsl_pagepool.lock);
+	}
+
+	kgsl_pagepool_array_free(pages, count);
+}
+
+static unsigned int kgsl_pagepool_drain(unsigned int nr)
+{
+	LIST_HEAD(victims);
+	struct page *page, *tmp;
+	unsigned int freed = 0;
+
+	spin_lock(&kgsl_pagepool.lock);
+	while (freed < nr && kgsl_pagepool.count) {
+		page = list_first_entry(&kgsl_pagepool.list, struct page, lru);
+		list_move(&page->lru, &victims);
+		kgsl_pagepool.count--;
+		freed++;
+	}
+	kgsl_pagepool.shrunk += freed;
+	spin_unlock(&kgsl_pagepool.lock);
+
+	list_for_each_entry_safe(page, tmp, &victims, lru) {
+		list_del(&page->lru);
+		__free_page(page);
+	}
+
+	return freed;
+}
+
+static int kgsl_pagepool_shrink(int nr_to_scan, gfp_t gfp_mask)
+{
+	if (nr_to_scan > 0)
+		kgsl_pagepool_drain(nr_to_scan);
+
+	return kgsl_pagepool.count;
+}
+
+static struct shrinker kgsl_pagepool_shrinker = {
+	.shrink = kgsl_pagepool_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+int kgsl_pagepool_init(void)
+{
+	spin_lock_init(&kgsl_pagepool.lock);
+	INIT_LIST_HEAD(&kgsl_pagepool.list);
+	kgsl_pagepool.max_pages = KGSL_PAGEPOOL_MAX_PAGES;
+
+	register_shrinker(&kgsl_pagepool_shrinker);
+	return 0;
+}
+
+void kgsl_pagepool_close(void)
+{
+	unregister_shrinker(&kgsl_pagepool_shrinker);
+	kgsl_pagepool_drain(UINT_MAX);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int kgsl_pagepool_stats_show(struct seq_file *s, void *unused)
+{
+	unsigned int hits, misses, allocs, count, shrunk, max_us;
+	u64 total_us;
+
+	spin_lock(&kgsl_pagepool.lock);
+	hits = kgsl_pagepool.hits;
+	misses = kgsl_pagepool.misses;
+	allocs = kgsl_pagepool.allocs;
+	count = kgsl_pagepool.count;
+	shrunk = kgsl_pagepool.shrunk;
+	total_us = kgsl_pagepool.total_us;
+	max_us = kgsl_pagepool.max_us;
+	spin_unlock(&kgsl_pagepool.lock);
+
+	seq_printf(s, "pool pages:     %u / %u\n", count,
+		   kgsl_pagepool.max_pages);
+	seq_printf(s, "page hits:      %u\n", hits);
+	seq_printf(s, "page misses:    %u\n", misses);
+	seq_printf(s, "hit rate:       %u%%\n", (hits + misses) ?
+		   (unsigned int)div_u64((u64)hits * 100, hits + misses) : 0);
+	seq_printf(s, "shrunk pages:   %u\n", shrunk);
+	seq_printf(s, "allocations:    %u\n", allocs);
+	seq_printf(s, "avg alloc (us): %llu\n",
+		   allocs ? div_u64(total_us, allocs) : 0);
+	seq_printf(s, "max alloc (us): %u\n", max_us);
+	return 0;
+}
+
+static int kgsl_pagepool_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, kgsl_pagepool_stats_show, NULL);
+}
+
+static const struct file_operations kgsl_pagepool_stats_fops = {
+	.open = kgsl_pagepool_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int kgsl_pagepool_max_set(void *data, u64 val)
+{
+	unsigned int excess = 0;
+
+	spin_lock(&kgsl_pagepool.lock);
+	kgsl_pagepool.max_pages = val;
+	if (kgsl_pagepool.count > kgsl_pagepool.max_pages)
+		excess = kgsl_pagepool.count - kgsl_pagepool.max_pages;
+	spin_unlock(&kgsl_pagepool.lock);
+
+	if (excess)
+		kgsl_pagepool_drain(excess);
+	return 0;
+}
+
+static int kgsl_pagepool_max_get(void *data, u64 *val)
+{
+	*val = kgsl_pagepool.max_pages;
+	return 0;
+}
+
+DEFINE_SIMPLE_ATTRIBUTE(kgsl_pagepool_max_fops, kgsl_pagepool_max_get,
+			kgsl_pagepool_max_set, "%llu\n");
+
+void kgsl_pagepool_debugfs_init(struct dentry *dent)
+{
+	debugfs_create_file("pagepool_stats", 0444, dent, 0,
+				&kgsl_pagepool_stats_fops);
+	debugfs_create_file("pagepool_max_pages", 0644, dent, 0,
+				&kgsl_pagepool_max_fops);
+}
+#else
+void kgsl_pagepool_debugfs_init(struct dentry *dent)
+{
+}
+#endif /* CONFIG_DEBUG_FS */
@@ -0,0 +1,54 @@
+/* Copyright (c) 2010, Code Aurora Forum. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of Code Aurora nor
+ *       the names of its contributors may be used to endorse or promote
+ *       products derived from this software without specific prior written
+ *       permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NON-INFRINGEMENT ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef __KGSL_PAGEPOOL_H
+#define __KGSL_PAGEPOOL_H
+
+struct page;
+struct dentry;
+
+#ifdef CONFIG_MSM_KGSL_MMU
+int kgsl_pagepool_init(void);
+void kgsl_pagepool_close(void);
+
+struct page **kgsl_pagepool_alloc(unsigned int count);
+void kgsl_pagepool_free(struct page **pages, unsigned int count);
+
+void kgsl_pagepool_debugfs_init(struct dentry *dent);
+#else
+static inline int kgsl_pagepool_init(void) { return 0; }
+static inline void kgsl_pagepool_close(void) { }
+
+static inline struct page **kgsl_pagepool_alloc(unsigned int count)
+{ return NULL; }
+static inline void kgsl_pagepool_free(struct page **pages,
+				      unsigned int count) { }
+
+static inline void kgsl_pagepool_debugfs_init(struct dentry *dent) { }
+#endif /* CONFIG_MSM_KGSL_MMU */
+
+#endif /* __KGSL_PAGEPOOL_H */
@@ -66,6 +66,7 @@
 #include "kgsl_pm4types.h"
 #include "kgsl_ringbuffer.h"
 #include "kgsl_cmdstream.h"
+#include "kgsl_dcvs.h"
 
 #include "yamato_reg.h"
 
@@ -170,8 +171,10 @@ void kgsl_cp_intrcallback(struct kgsl_device *device)
 	if (status & CP_INT_CNTL__SW_INT_MASK)
 		KGSL_CMD_DBG("ringbuffer software interrupt\n");
 
-	if (status & CP_INT_CNTL__RB_INT_MASK)
+	if (status & CP_INT_CNTL__RB_INT_MASK) {
 		KGSL_CMD_DBG("ringbuffer rb interrupt\n");
+		kgsl_cmdstream_event_irq(device);
+	}
 
 	if (status & CP_INT_CNTL__IB2_INT_MASK)
 		KGSL_CMD_DBG("ringbuffer ib2 interrupt\n");
@@ -248,6 +251,7 @@ static void kgsl_ringbuffer_submit(struct kgsl_ringbuffer *rb)
 	kgsl_yamato_regwrite(rb->device, REG_CP_RB_WPTR, rb->wptr);
 
 	rb->flags |= KGSL_FLAGS_ACTIVE;
+	kgsl_dcvs_busy();
 }
 
 static int
@@ -672,7 +676,7 @@ kgsl_ringbuffer_addcmds(struct kgsl_ringbuffer *rb,
 	pmodesizedwords = pmodeoff ? 4 : 0;
 
 	ringcmds = kgsl_ringbuffer_allocspace(rb,
-					pmodesizedwords + sizedwords + 6);
+					pmodesizedwords + sizedwords + 13);
 
 	if (pmodeoff) {
 		/* disable protected mode error checking */
@@ -706,6 +710,19 @@ kgsl_ringbuffer_addcmds(struct kgsl_ringbuffer *rb,
 		      KGSL_DEVICE_MEMSTORE_OFFSET(eoptimestamp)));
 	GSL_RB_WRITE(ringcmds, rb->timestamp);
 
+	/* interrupt if a timestamp event is armed for this timestamp;
+	 * see kgsl_cmdstream.c */
+	GSL_RB_WRITE(ringcmds, pm4_type3_packet(PM4_COND_EXEC, 4));
+	GSL_RB_WRITE(ringcmds, (rb->device->memstore.gpuaddr +
+		     KGSL_DEVICE_MEMSTORE_OFFSET(ts_cmp_enable)) >> 2);
+	GSL_RB_WRITE(ringcmds, (rb->device->memstore.gpuaddr +
+		     KGSL_DEVICE_MEMSTORE_OFFSET(ref_wait_ts)) >> 2);
+	GSL_RB_WRITE(ringcmds, rb->timestamp);
+	/* number of conditional dwords */
+	GSL_RB_WRITE(ringcmds, 2);
+	GSL_RB_WRITE(ringcmds, pm4_type3_packet(PM4_INTERRUPT, 1));
+	GSL_RB_WRITE(ringcmds, CP_INT_CNTL__RB_INT_MASK);
+
 	kgsl_ringbuffer_submit(rb);
 
 	GSL_RB_STATS(rb->stats.words_total += sizedwords);
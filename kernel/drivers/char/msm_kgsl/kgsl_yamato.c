@@ -66,6 +66,7 @@
 #include "kgsl_log.h"
 #include "kgsl_pm4types.h"
 #include "kgsl_cmdstream.h"
+#include "kgsl_dcvs.h"
 
 #include "yamato_reg.h"
 
@@ -279,7 +280,8 @@ irqreturn_t kgsl_yamato_isr(int irq, void *data)
 	irqreturn_t result = IRQ_NONE;
 
 	struct kgsl_device *device = &kgsl_driver.yamato_device;
-	unsigned int status;
+	struct kgsl_ringbuffer *rb = &device->ringbuffer;
+	unsigned int status, rptr;
 
 	kgsl_yamato_regread(device, REG_MASTER_INT_SIGNAL, &status);
 
@@ -302,6 +304,14 @@ irqreturn_t kgsl_yamato_isr(int irq, void *data)
 		kgsl_yamato_sq_intrcallback(device);
 		result = IRQ_HANDLED;
 	}
+
+	/* End the DCVS busy period once the ringbuffer has drained */
+	if (rb->flags & KGSL_FLAGS_STARTED) {
+		GSL_RB_GET_READPTR(rb, &rptr);
+		if (rptr == rb->wptr)
+			kgsl_dcvs_idle();
+	}
+
 	/* Reset the time-out in our idle timer */
 	mod_timer(&idle_timer, jiffies + INTERVAL_TIMEOUT);
 	return result;
@@ -731,6 +741,7 @@ int kgsl_yamato_start(struct kgsl_device *device, uint32_t flags)
 	}
 
 	device->flags |= KGSL_FLAGS_STARTED;
+	kgsl_cmdstream_events_start(device);
 	init_timer(&idle_timer);
 	idle_timer.function = kgsl_yamato_timer;
 	idle_timer.expires = jiffies + FIRST_TIMEOUT;
@@ -746,6 +757,8 @@ int kgsl_yamato_stop(struct kgsl_device *device)
 	del_timer(&idle_timer);
 	if (device->flags & KGSL_FLAGS_STARTED) {
 
+		kgsl_cmdstream_events_stop(device);
+
 		kgsl_yamato_regwrite(device, REG_RBBM_INT_CNTL, 0);
 
 		kgsl_yamato_regwrite(device, REG_SQ_INT_CNTL, 0);
@@ -895,7 +908,7 @@ done:
 	return status;
 }
 
-static unsigned int kgsl_yamato_isidle(struct kgsl_device *device)
+unsigned int kgsl_yamato_isidle(struct kgsl_device *device)
 {
 	int status = KGSL_FALSE;
 	struct kgsl_ringbuffer *rb = &device->ringbuffer;
@@ -928,6 +941,7 @@ int kgsl_yamato_sleep(struct kgsl_device *device, const int idle)
 		/* the core clock until the next attempt to access the HW. */
 		if (idle == KGSL_TRUE || kgsl_yamato_isidle(device)) {
 			kgsl_pwrctrl(KGSL_PWRFLAGS_YAMATO_IRQ_OFF);
+			kgsl_dcvs_stop();
 			/* Turn off the core clocks */
 			status = kgsl_pwrctrl(KGSL_PWRFLAGS_YAMATO_CLK_OFF);
 
@@ -950,6 +964,7 @@ int kgsl_yamato_wake(struct kgsl_device *device)
 	/* Turn on the core clocks */
 	status = kgsl_pwrctrl(KGSL_PWRFLAGS_YAMATO_CLK_ON);
 	kgsl_pwrctrl(KGSL_PWRFLAGS_YAMATO_IRQ_ON);
+	kgsl_dcvs_start();
 
 	/* Re-enable HW access */
 	device->hwaccess_blocked = KGSL_FALSE;
@@ -1021,20 +1036,28 @@ int kgsl_yamato_waittimestamp(struct kgsl_device *device,
 				unsigned int msecs)
 {
 	long status;
+	struct kgsl_event waiter;
 
 	KGSL_DRV_INFO("enter (device=%p,timestamp=%d,timeout=0x%08x)\n",
 			device, timestamp, msecs);
 
+	/* have the CP interrupt us when this timestamp retires */
+	kgsl_cmdstream_add_waiter(device, &waiter, timestamp);
 	status = wait_event_interruptible_timeout(device->ib1_wq,
 			kgsl_cmdstream_check_timestamp(device, timestamp),
 			msecs_to_jiffies(msecs));
+	kgsl_cmdstream_del_waiter(device, &waiter);
 
 	if (status > 0)
 		status = 0;
 	else if (status == 0) {
 		if (!kgsl_cmdstream_check_timestamp(device, timestamp)) {
 			status = -ETIMEDOUT;
+			/* the wait ran without the driver mutex, so the core
+			 * may have been power collapsed meanwhile */
+			KGSL_PRE_HWACCESS();
 			kgsl_register_dump(device);
+			KGSL_POST_HWACCESS();
 		}
 	}
 
@@ -113,7 +113,7 @@ static void cpufreq_interactive_timer(unsigned long data)
 	if (!timer_pending(t) && nr_running() > 0) {
 			*cpu_time_in_idle = get_cpu_idle_time_us(
 					data, cpu_idle_exit_time);
-			mod_timer(t, jiffies + 2);
+			mod_timer(t, round_jiffies_slack(jiffies + 2, 1));
 	}
 
 	if (policy->cur == policy->min)
@@ -142,7 +142,7 @@ static void cpufreq_idle(void)
 	if (!cpumask_test_cpu(smp_processor_id(), policy->cpus))
 			return;
 
-	/* Timer to fire in 1-2 ticks, jiffie aligned. */
+	/* Timer to fire in 2-3 ticks, coalesced with other timers. */
 	t = &per_cpu(cpu_timer, smp_processor_id());
 	cpu_idle_exit_time = &per_cpu(idle_exit_time, smp_processor_id());
 	cpu_time_in_idle = &per_cpu(time_in_idle, smp_processor_id());
@@ -150,7 +150,7 @@ static void cpufreq_idle(void)
 	if (timer_pending(t) == 0) {
 		*cpu_time_in_idle = get_cpu_idle_time_us(
 				smp_processor_id(), cpu_idle_exit_time);
-		mod_timer(t, jiffies + 2);
+		mod_timer(t, round_jiffies_slack(jiffies + 2, 1));
 	}
 }
 
@@ -202,7 +202,9 @@ inline static unsigned int validate_freq(struct cpufreq_policy *policy, int freq
 
 inline static void reset_timer(unsigned long cpu, struct smartass_info_s *this_smartass) {
 	this_smartass->time_in_idle = get_cpu_idle_time_us(cpu, &this_smartass->idle_exit_time);
-	mod_timer(&this_smartass->timer, jiffies + sample_rate_jiffies);
+	mod_timer(&this_smartass->timer,
+		  round_jiffies_slack(jiffies + sample_rate_jiffies,
+				      sample_rate_jiffies >> 1));
 }
 
 inline static void work_cpumask_set(unsigned long cpu) {
@@ -0,0 +1,267 @@
+/*
+ *  drivers/cpufreq/cpufreq_times.c
+ *
+ *  Per-task and per-uid time spent at each CPU frequency.
+ *
+ *  Every scheduler tick charged to a task is also charged to the
+ *  frequency the CPU was running at, so the switch path is left alone and
+ *  the tick only pays for an array increment. Times are kept in the same
+ *  units as utime/stime and reported in clock_t like cpufreq_stats.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/cpufreq_times.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/uid_stat.h>
+
+/* Frequencies are taken from the first policy that shows up; all CPUs are
+ * assumed to share the same table. */
+static unsigned int *freq_table;
+static unsigned int num_states;
+
+static DEFINE_PER_CPU(int, cpufreq_times_index) = -1;
+
+static int cpufreq_times_get_index(unsigned int freq)
+{
+	int index;
+
+	for (index = 0; index < num_states; index++)
+		if (freq_table[index] == freq)
+			return index;
+	return -1;
+}
+
+void cpufreq_task_times_account(struct task_struct *p, cputime_t cputime)
+{
+	int index = __get_cpu_var(cpufreq_times_index);
+	cputime_t *times;
+
+	/* Exiting tasks have already been folded into their uid. */
+	if (index < 0 || (p->flags & PF_EXITING))
+		return;
+
+	times = p->cpufreq_times;
+	if (unlikely(!times))
+		return;
+	times[index] = cputime_add(times[index], cputime);
+}
+
+/*
+ * Allocate the per-task array from process context, at fork and again
+ * at exec for tasks that were created before the frequency table was
+ * known.  The tick path never allocates.
+ */
+void cpufreq_task_times_init(struct task_struct *p)
+{
+	cputime_t *times;
+
+	if (p->cpufreq_times || !num_states)
+		return;
+
+	times = kzalloc(num_states * sizeof(*times), GFP_KERNEL);
+	if (!times)
+		return;
+	/* Zeroed array must be visible before the tick can index it. */
+	smp_wmb();
+	p->cpufreq_times = times;
+}
+
+void cpufreq_task_times_exit(struct task_struct *p)
+{
+#ifdef CONFIG_UID_STAT
+	if (p->cpufreq_times)
+		update_time_in_state(task_uid(p), p->cpufreq_times,
+				     num_states);
+#endif
+}
+
+void cpufreq_task_times_free(struct task_struct *p)
+{
+	kfree(p->cpufreq_times);
+	p->cpufreq_times = NULL;
+}
+
+int cpufreq_task_times_show(struct seq_file *m, struct task_struct *p,
+			    int whole)
+{
+	struct task_struct *t = p;
+	cputime64_t *sum;
+	cputime_t *times;
+	unsigned long flags;
+	int i;
+
+	if (!num_states)
+		return 0;
+
+	sum = kzalloc(num_states * sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		return -ENOMEM;
+
+	if (whole && lock_task_sighand(p, &flags)) {
+		do {
+			times = ACCESS_ONCE(t->cpufreq_times);
+			if (!times)
+				continue;
+			for (i = 0; i < num_states; i++)
+				sum[i] = cputime64_add(sum[i],
+					cputime_to_cputime64(times[i]));
+		} while_each_thread(p, t);
+		unlock_task_sighand(p, &flags);
+	} else {
+		times = ACCESS_ONCE(p->cpufreq_times);
+		for (i = 0; times && i < num_states; i++)
+			sum[i] = cputime_to_cputime64(times[i]);
+	}
+
+	for (i = 0; i < num_states; i++)
+		seq_printf(m, "%u %llu\n", freq_table[i],
+			(unsigned long long)cputime64_to_clock_t(sum[i]));
+
+	kfree(sum);
+	return 0;
+}
+
+unsigned int cpufreq_task_times_num_states(void)
+{
+	return num_states;
+}
+
+unsigned int cpufreq_task_times_freq(unsigned int index)
+{
+	return index < num_states ? freq_table[index] : 0;
+}
+
+/* Add the times of all live tasks owned by uid to times[]. */
+void cpufreq_task_times_add_uid(uid_t uid, cputime64_t *times)
+{
+	struct task_struct *g, *t;
+	cputime_t *tt;
+	int i;
+
+	rcu_read_lock();
+	do_each_thread(g, t) {
+		if (t->flags & PF_EXITING)
+			continue;
+		tt = ACCESS_ONCE(t->cpufreq_times);
+		if (!tt || task_uid(t) != uid)
+			continue;
+		for (i = 0; i < num_states; i++)
+			times[i] = cputime64_add(times[i],
+				cputime_to_cputime64(tt[i]));
+	} while_each_thread(g, t);
+	rcu_read_unlock();
+}
+
+static int cpufreq_times_create_table(struct cpufreq_policy *policy)
+{
+	struct cpufreq_frequency_table *table;
+	unsigned int *freqs;
+	unsigned int i, count = 0;
+
+	table = cpufreq_frequency_get_table(policy->cpu);
+	if (!table)
+		return 0;
+
+	for (i = 0; table[i].frequency != CPUFREQ_TABLE_END; i++)
+		if (table[i].frequency != CPUFREQ_ENTRY_INVALID)
+			count++;
+
+	freqs = kzalloc(count * sizeof(*freqs), GFP_KERNEL);
+	if (!freqs)
+		return -ENOMEM;
+
+	count = 0;
+	for (i = 0; table[i].frequency != CPUFREQ_TABLE_END; i++) {
+		unsigned int freq = table[i].frequency;
+		unsigned int j;
+
+		if (freq == CPUFREQ_ENTRY_INVALID)
+			continue;
+		for (j = 0; j < count; j++)
+			if (freqs[j] == freq)
+				break;
+		if (j == count)
+			freqs[count++] = freq;
+	}
+
+	freq_table = freqs;
+	/* Publish the table before anybody can index into it. */
+	smp_wmb();
+	num_states = count;
+	return 0;
+}
+
+static int cpufreq_times_notifier_policy(struct notifier_block *nb,
+		unsigned long val, void *data)
+{
+	struct cpufreq_policy *policy = data;
+	int ret;
+
+	if (val != CPUFREQ_NOTIFY)
+		return 0;
+
+	if (!num_states) {
+		ret = cpufreq_times_create_table(policy);
+		if (ret)
+			return ret;
+	}
+
+	per_cpu(cpufreq_times_index, policy->cpu) =
+		cpufreq_times_get_index(policy->cur);
+	return 0;
+}
+
+static int cpufreq_times_notifier_trans(struct notifier_block *nb,
+		unsigned long val, void *data)
+{
+	struct cpufreq_freqs *freq = data;
+
+	if (val != CPUFREQ_POSTCHANGE || !num_states)
+		return 0;
+
+	per_cpu(cpufreq_times_index, freq->cpu) =
+		cpufreq_times_get_index(freq->new);
+	return 0;
+}
+
+static struct notifier_block notifier_policy_block = {
+	.notifier_call = cpufreq_times_notifier_policy
+};
+
+static struct notifier_block notifier_trans_block = {
+	.notifier_call = cpufreq_times_notifier_trans
+};
+
+static int __init cpufreq_times_init(void)
+{
+	int ret;
+	unsigned int cpu;
+
+	ret = cpufreq_register_notifier(&notifier_policy_block,
+					CPUFREQ_POLICY_NOTIFIER);
+	if (ret)
+		return ret;
+
+	ret = cpufreq_register_notifier(&notifier_trans_block,
+					CPUFREQ_TRANSITION_NOTIFIER);
+	if (ret) {
+		cpufreq_unregister_notifier(&notifier_policy_block,
+					    CPUFREQ_POLICY_NOTIFIER);
+		return ret;
+	}
+
+	for_each_online_cpu(cpu)
+		cpufreq_update_policy(cpu);
+	return 0;
+}
+
+late_initcall(cpufreq_times_init);
@@ -39,6 +39,8 @@
 #include <mach/camera.h>
 #include <linux/syscalls.h>
 #include <linux/hrtimer.h>
+#include <linux/hash.h>
+#include <linux/mm.h>
 
 DEFINE_MUTEX(hlist_mut);
 DEFINE_MUTEX(pp_prev_lock);
@@ -90,18 +92,109 @@ int g_v4l2_opencnt;
 	res;							\
 })
 
+#define MSM_QCMD_SLOT_SIZE \
+	ALIGN(sizeof(struct msm_queue_cmd) + MSM_QCMD_POOL_PAYLOAD, \
+		L1_CACHE_BYTES)
+
+static int msm_qcmd_pool_init(struct msm_qcmd_pool *pool)
+{
+	struct msm_queue_cmd *qcmd;
+	int i;
+
+	spin_lock_init(&pool->lock);
+	INIT_LIST_HEAD(&pool->free);
+
+	pool->slots = kmalloc(MSM_QCMD_POOL_SIZE * MSM_QCMD_SLOT_SIZE,
+			GFP_KERNEL);
+	if (!pool->slots)
+		return -ENOMEM;
+
+	for (i = 0; i < MSM_QCMD_POOL_SIZE; i++) {
+		qcmd = pool->slots + i * MSM_QCMD_SLOT_SIZE;
+		qcmd->pool = pool;
+		list_add_tail(&qcmd->list_config, &pool->free);
+	}
+	pool->avail = MSM_QCMD_POOL_SIZE;
+	pool->low = MSM_QCMD_POOL_SIZE;
+	pool->misses = 0;
+	return 0;
+}
+
+static void msm_qcmd_pool_destroy(struct msm_qcmd_pool *pool)
+{
+	if (pool->avail != MSM_QCMD_POOL_SIZE)
+		pr_warning("%s: %d commands still in use\n", __func__,
+			MSM_QCMD_POOL_SIZE - pool->avail);
+	kfree(pool->slots);
+	pool->slots = NULL;
+}
+
+/* May be called in interrupt context. */
+static struct msm_queue_cmd *msm_qcmd_pool_get(struct msm_qcmd_pool *pool)
+{
+	struct msm_queue_cmd *qcmd = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	if (!list_empty(&pool->free)) {
+		qcmd = list_first_entry(&pool->free,
+				struct msm_queue_cmd, list_config);
+		list_del(&qcmd->list_config);
+		if (--pool->avail < pool->low)
+			pool->low = pool->avail;
+	} else
+		pool->misses++;
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	return qcmd;
+}
+
+static void msm_qcmd_release(struct msm_queue_cmd *qcmd)
+{
+	struct msm_qcmd_pool *pool = qcmd->pool;
+	unsigned long flags;
+
+	if (!pool) {
+		kfree(qcmd);
+		return;
+	}
+
+	spin_lock_irqsave(&pool->lock, flags);
+	list_add(&qcmd->list_config, &pool->free);
+	pool->avail++;
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
+
 static inline void free_qcmd(struct msm_queue_cmd *qcmd)
 {
 	if (!qcmd || !qcmd->on_heap)
 		return;
 	if (!--qcmd->on_heap)
-		kfree(qcmd);
+		msm_qcmd_release(qcmd);
+}
+
+static void msm_pmem_index_init(struct msm_pmem_index *index)
+{
+	int i;
+
+	for (i = 0; i < MSM_PMEM_HASH_SIZE; i++) {
+		INIT_HLIST_HEAD(&index->by_paddr[i]);
+		INIT_HLIST_HEAD(&index->by_vaddr[i]);
+	}
+}
+
+static inline struct hlist_head *msm_pmem_bucket(struct hlist_head *table,
+		unsigned long key)
+{
+	return &table[hash_long(key, MSM_PMEM_HASH_BITS)];
 }
 
 static void msm_region_init(struct msm_sync *sync)
 {
 	INIT_HLIST_HEAD(&sync->pmem_frames);
 	INIT_HLIST_HEAD(&sync->pmem_stats);
+	msm_pmem_index_init(&sync->frame_index);
+	msm_pmem_index_init(&sync->stats_index);
 	spin_lock_init(&sync->pmem_frame_spinlock);
 	spin_lock_init(&sync->pmem_stats_spinlock);
 }
@@ -204,7 +297,11 @@ static int check_pmem_info(struct msm_pmem_info *info, int len)
 		len);
 	return -EINVAL;
 }
+/* Frames are looked up by the Y plane address the VFE hands back, stats
+ * by the start of the buffer.
+ */
 static int msm_pmem_table_add(struct hlist_head *ptype,
+	struct msm_pmem_index *index, int frame,
 	struct msm_pmem_info *info, spinlock_t* pmem_spinlock)
 {
 	struct file *file;
@@ -256,8 +353,14 @@ static int msm_pmem_table_add(struct hlist_head *ptype,
 	region->len = len;
 	region->file = file;
 	memcpy(&region->info, info, sizeof(region->info));
+	region->pkey = frame ? paddr + info->y_off : paddr;
 
 	hlist_add_head(&(region->list), ptype);
+	hlist_add_head(&region->pnode,
+		msm_pmem_bucket(index->by_paddr, region->pkey));
+	hlist_add_head(&region->vnode,
+		msm_pmem_bucket(index->by_vaddr,
+			(unsigned long)region->info.vaddr));
 	spin_unlock_irqrestore(pmem_spinlock, flags);
 
 	return 0;
@@ -297,12 +400,13 @@ static int msm_pmem_frame_ptov_lookup(struct msm_sync *sync,
 		int clear_active)
 {
 	struct msm_pmem_region *region;
-	struct hlist_node *node, *n;
+	struct hlist_node *node;
 	unsigned long flags = 0;
 
 	spin_lock_irqsave(&sync->pmem_frame_spinlock, flags);
-	hlist_for_each_entry_safe(region, node, n, &sync->pmem_frames, list) {
-		if (pyaddr == (region->paddr + region->info.y_off) &&
+	hlist_for_each_entry(region, node,
+		msm_pmem_bucket(sync->frame_index.by_paddr, pyaddr), pnode) {
+		if (pyaddr == region->pkey &&
 				pcbcraddr == (region->paddr +
 						region->info.cbcr_off) &&
 				region->info.active) {
@@ -326,12 +430,13 @@ static unsigned long msm_pmem_stats_ptov_lookup(struct msm_sync *sync,
 		unsigned long addr, int *fd)
 {
 	struct msm_pmem_region *region;
-	struct hlist_node *node, *n;
+	struct hlist_node *node;
 	unsigned long flags = 0;
 
 	spin_lock_irqsave(&sync->pmem_stats_spinlock, flags);
-	hlist_for_each_entry_safe(region, node, n, &sync->pmem_stats, list) {
-		if (addr == region->paddr && region->info.active) {
+	hlist_for_each_entry(region, node,
+		msm_pmem_bucket(sync->stats_index.by_paddr, addr), pnode) {
+		if (addr == region->pkey && region->info.active) {
 			/* offset since we could pass vaddr inside a
 			 * registered pmem buffer */
 			*fd = region->info.fd;
@@ -351,12 +456,12 @@ static unsigned long msm_pmem_frame_vtop_lookup(struct msm_sync *sync,
 		uint32_t yoff, uint32_t cbcroff, int fd)
 {
 	struct msm_pmem_region *region;
-	struct hlist_node *node, *n;
+	struct hlist_node *node;
 	unsigned long flags = 0;
 
 	spin_lock_irqsave(&sync->pmem_frame_spinlock, flags);
-	hlist_for_each_entry_safe(region,
-		node, n, &sync->pmem_frames, list) {
+	hlist_for_each_entry(region, node,
+		msm_pmem_bucket(sync->frame_index.by_vaddr, buffer), vnode) {
 		if (((unsigned long)(region->info.vaddr) == buffer) &&
 				(region->info.y_off == yoff) &&
 				(region->info.cbcr_off == cbcroff) &&
@@ -379,11 +484,12 @@ static unsigned long msm_pmem_stats_vtop_lookup(
 		int fd)
 {
 	struct msm_pmem_region *region;
-	struct hlist_node *node, *n;
+	struct hlist_node *node;
 	unsigned long flags = 0;
 
 	spin_lock_irqsave(&sync->pmem_stats_spinlock, flags);
-	hlist_for_each_entry_safe(region, node, n, &sync->pmem_stats, list) {
+	hlist_for_each_entry(region, node,
+		msm_pmem_bucket(sync->stats_index.by_vaddr, buffer), vnode) {
 		if (((unsigned long)(region->info.vaddr) == buffer) &&
 				(region->info.fd == fd) &&
 				region->info.active == 0) {
@@ -420,6 +526,8 @@ static int __msm_pmem_table_del(struct msm_sync *sync,
 					pinfo->vaddr == region->info.vaddr &&
 					pinfo->fd == region->info.fd) {
 				hlist_del(node);
+				hlist_del(&region->pnode);
+				hlist_del(&region->vnode);
 				put_pmem_file(region->file);
 				kfree(region);
 			}
@@ -437,6 +545,8 @@ static int __msm_pmem_table_del(struct msm_sync *sync,
 					pinfo->vaddr == region->info.vaddr &&
 					pinfo->fd == region->info.fd) {
 				hlist_del(node);
+				hlist_del(&region->pnode);
+				hlist_del(&region->vnode);
 				put_pmem_file(region->file);
 				kfree(region);
 			}
@@ -668,6 +778,7 @@ static struct msm_queue_cmd *__msm_control_nb(struct msm_sync *sync,
 	memcpy(udata->value, udata_to_copy->value, udata_to_copy->length);
 
 	qcmd->on_heap = 1;
+	qcmd->pool = NULL;
 
 	/* qcmd_resp will be set to NULL */
 	return __msm_control(sync, NULL, qcmd, 0);
@@ -1442,7 +1553,8 @@ static int __msm_register_pmem(struct msm_sync *sync,
 	case MSM_PMEM_THUMBNAIL:
 	case MSM_PMEM_MAINIMG:
 	case MSM_PMEM_RAW_MAINIMG:
-		rc = msm_pmem_table_add(&sync->pmem_frames, pinfo,
+		rc = msm_pmem_table_add(&sync->pmem_frames,
+			&sync->frame_index, 1, pinfo,
 			&sync->pmem_frame_spinlock);
 		break;
 
@@ -1455,8 +1567,9 @@ static int __msm_register_pmem(struct msm_sync *sync,
 	case MSM_PMEM_IHIST:
 	case MSM_PMEM_SKIN:
 
-		rc = msm_pmem_table_add(&sync->pmem_stats, pinfo,
-			 &sync->pmem_stats_spinlock);
+		rc = msm_pmem_table_add(&sync->pmem_stats,
+			&sync->stats_index, 0, pinfo,
+			&sync->pmem_stats_spinlock);
 		break;
 
 	default:
@@ -2026,7 +2139,11 @@ static int __msm_release(struct msm_sync *sync)
 			put_pmem_file(region->file);
 			kfree(region);
 		}
+		msm_pmem_index_init(&sync->frame_index);
+		msm_pmem_index_init(&sync->stats_index);
 		msm_queue_drain(&sync->pict_q, list_pict);
+		CDBG("%s: qcmd pool low water %d, %lu misses\n", __func__,
+			sync->qcmd_pool.low, sync->qcmd_pool.misses);
 
 #ifdef CONFIG_SEMC_IMX046_CAMERA
 		wake_unlock(&sync->suspend_lock);
@@ -2072,15 +2189,53 @@ static int msm_release_frame(struct inode *node, struct file *filep)
 {
 	int rc;
 	struct msm_device *pmsm = filep->private_data;
+	struct msm_frame_ring *ring;
+	unsigned long flags;
 	CDBG("%s: %s\n", __func__, filep->f_path.dentry->d_name.name);
 	rc = __msm_release(pmsm->sync);
 	if (!rc) {
+		/* no mapping is left once the file is released */
+		spin_lock_irqsave(&pmsm->sync->frame_q.lock, flags);
+		ring = pmsm->sync->frame_ring;
+		pmsm->sync->frame_ring = NULL;
+		spin_unlock_irqrestore(&pmsm->sync->frame_q.lock, flags);
+		if (ring)
+			free_page((unsigned long)ring);
+
 		msm_queue_drain(&pmsm->sync->frame_q, list_frame);
 		atomic_set(&pmsm->opened, 0);
 	}
 	return rc;
 }
 
+static int msm_mmap_frame(struct file *filep, struct vm_area_struct *vma)
+{
+	struct msm_device *pmsm = filep->private_data;
+	struct msm_sync *sync = pmsm->sync;
+	struct msm_frame_ring *ring, *new;
+	unsigned long flags;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+
+	new = (struct msm_frame_ring *)get_zeroed_page(GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+	new->entries = MSM_FRAME_RING_ENTRIES;
+
+	spin_lock_irqsave(&sync->frame_q.lock, flags);
+	ring = sync->frame_ring;
+	if (!ring)
+		ring = sync->frame_ring = new;
+	spin_unlock_irqrestore(&sync->frame_q.lock, flags);
+	if (ring != new)
+		free_page((unsigned long)new);
+
+	return remap_pfn_range(vma, vma->vm_start,
+			virt_to_phys(ring) >> PAGE_SHIFT,
+			PAGE_SIZE, vma->vm_page_prot);
+}
+
 static int msm_unblock_poll_frame(struct msm_sync *sync)
 {
 	unsigned long flags;
@@ -2102,7 +2257,9 @@ static unsigned int __msm_poll_frame(struct msm_sync *sync,
 	poll_wait(filep, &sync->frame_q.wait, pll_table);
 
 	spin_lock_irqsave(&sync->frame_q.lock, flags);
-	if (!list_empty_careful(&sync->frame_q.list))
+	if (!list_empty_careful(&sync->frame_q.list) ||
+	    (sync->frame_ring && sync->frame_ring->head !=
+				ACCESS_ONCE(sync->frame_ring->tail)))
 		/* frame ready */
 		rc = POLLIN | POLLRDNORM;
 	if (sync->unblock_poll_frame) {
@@ -2127,16 +2284,22 @@ static unsigned int msm_poll_frame(struct file *filep,
  */
 
 static void *msm_vfe_sync_alloc(int size,
-			void *syncdata __attribute__((unused)),
+			void *syncdata,
 			gfp_t gfp)
 {
-	struct msm_queue_cmd *qcmd =
-		kmalloc(sizeof(struct msm_queue_cmd) + size, gfp);
-	if (qcmd) {
-		qcmd->on_heap = 1;
-		return qcmd + 1;
+	struct msm_sync *sync = (struct msm_sync *)syncdata;
+	struct msm_queue_cmd *qcmd = NULL;
+
+	if (sync && sync->qcmd_pool.slots && size <= MSM_QCMD_POOL_PAYLOAD)
+		qcmd = msm_qcmd_pool_get(&sync->qcmd_pool);
+	if (!qcmd) {
+		qcmd = kmalloc(sizeof(struct msm_queue_cmd) + size, gfp);
+		if (!qcmd)
+			return NULL;
+		qcmd->pool = NULL;
 	}
-	return NULL;
+	qcmd->on_heap = 1;
+	return qcmd + 1;
 }
 
 static void msm_vfe_sync_free(void *ptr)
@@ -2146,10 +2309,62 @@ static void msm_vfe_sync_free(void *ptr)
 			(struct msm_queue_cmd *)ptr;
 		qcmd--;
 		if (qcmd->on_heap)
-			kfree(qcmd);
+			msm_qcmd_release(qcmd);
 	}
 }
 
+/*
+ * Hand a preview or video frame to the frame thread, through the mmap()ed
+ * ring when there is one and it has room, otherwise through frame_q.
+ */
+static void msm_deliver_frame(struct msm_sync *sync,
+		struct msm_queue_cmd *qcmd)
+{
+	struct msm_vfe_resp *vdata = qcmd->command;
+	struct msm_frame_ring *ring;
+	struct msm_frame_desc *desc;
+	struct msm_pmem_info pmem_info;
+	unsigned long flags;
+	uint32_t head;
+
+	spin_lock_irqsave(&sync->frame_q.lock, flags);
+	ring = sync->frame_ring;
+	if (!ring)
+		goto enqueue;
+
+	head = ring->head;
+	if (head - ACCESS_ONCE(ring->tail) >= MSM_FRAME_RING_ENTRIES) {
+		ring->overruns++;
+		goto enqueue;
+	}
+
+	/* leave unknown buffers to GETFRAME, which reports them */
+	if (msm_pmem_frame_ptov_lookup(sync, vdata->phy.y_phy,
+			vdata->phy.cbcr_phy, &pmem_info, 1) < 0)
+		goto enqueue;
+
+	desc = &ring->desc[head % MSM_FRAME_RING_ENTRIES];
+	desc->ts = qcmd->ts;
+	desc->path = vdata->phy.output_id;
+	desc->buffer = (unsigned long)pmem_info.vaddr;
+	desc->y_off = pmem_info.y_off;
+	desc->cbcr_off = pmem_info.cbcr_off;
+	desc->fd = pmem_info.fd;
+
+	/* publish the descriptor before the new head */
+	smp_wmb();
+	ring->head = head + 1;
+	wake_up(&sync->frame_q.wait);
+	spin_unlock_irqrestore(&sync->frame_q.lock, flags);
+	return;
+
+enqueue:
+	spin_unlock_irqrestore(&sync->frame_q.lock, flags);
+	msm_enqueue(&sync->frame_q, &qcmd->list_frame);
+	if (qcmd->on_heap)
+		qcmd->on_heap++;
+}
+
 /*
  * This function executes in interrupt context.
  */
@@ -2192,17 +2407,13 @@ static void msm_vfe_sync(struct msm_vfe_resp *vdata,
 			mutex_unlock(&pp_prev_lock);
 				break;
 			}
-		CDBG("%s: msm_enqueue frame_q\n", __func__);
-		msm_enqueue(&sync->frame_q, &qcmd->list_frame);
-		if (qcmd->on_heap)
-			qcmd->on_heap++;
+		CDBG("%s: deliver preview frame\n", __func__);
+		msm_deliver_frame(sync, qcmd);
 		break;
 
 		case VFE_MSG_OUTPUT_V:
-		CDBG("%s: msm_enqueue video frame_q\n", __func__);
-		msm_enqueue(&sync->frame_q, &qcmd->list_frame);
-		if (qcmd->on_heap)
-			qcmd->on_heap++;
+		CDBG("%s: deliver video frame\n", __func__);
+		msm_deliver_frame(sync, qcmd);
 		break;
 
 		case VFE_MSG_SNAPSHOT:
@@ -2291,6 +2502,7 @@ void msm_sensor_sync(struct msm_sensor_resp_t *vdata,
 		CDBG("evt_msg: cannot allocate buffer\n");
 		goto mem_fail1;
 	}
+	qcmd->pool = NULL;
 
 	sensorcmd->type = vdata->type;
 	sensorcmd->extdata = NULL;
@@ -2494,6 +2706,7 @@ static int __msm_v4l2_control(struct msm_sync *sync,
 	qcmd->type = MSM_CAM_Q_V4L2_REQ;
 	qcmd->command = out;
 	qcmd->on_heap = 1;
+	qcmd->pool = NULL;
 
 	if (out->type == V4L2_CAMERA_EXIT) {
 		rcmd = __msm_control(sync, NULL, qcmd, out->timeout_ms);
@@ -2541,6 +2754,7 @@ static const struct file_operations msm_fops_frame = {
 	.unlocked_ioctl = msm_ioctl_frame,
 	.release = msm_release_frame,
 	.poll = msm_poll_frame,
+	.mmap = msm_mmap_frame,
 };
 
 static int msm_setup_cdev(struct msm_device *msm,
@@ -2623,6 +2837,11 @@ static int msm_sync_init(struct msm_sync *sync,
 	msm_queue_init(&sync->event_q, "event");
 	msm_queue_init(&sync->frame_q, "frame");
 	msm_queue_init(&sync->pict_q, "pict");
+	sync->frame_ring = NULL;
+
+	rc = msm_qcmd_pool_init(&sync->qcmd_pool);
+	if (rc < 0)
+		return rc;
 
 #ifdef CONFIG_SEMC_IMX046_CAMERA
 	wake_lock_init(&sync->suspend_lock, WAKE_LOCK_SUSPEND, "msm_camera_suspend");
@@ -2630,8 +2849,10 @@ static int msm_sync_init(struct msm_sync *sync,
 	wake_lock_init(&sync->wake_lock, WAKE_LOCK_IDLE, "msm_camera");
 
 	rc = msm_camio_probe_on(pdev);
-	if (rc < 0)
+	if (rc < 0) {
+		msm_qcmd_pool_destroy(&sync->qcmd_pool);
 		return rc;
+	}
 	rc = sensor_probe(sync->sdata, &sctrl);
 	if (rc >= 0) {
 		sync->pdev = pdev;
@@ -2646,6 +2867,7 @@ static int msm_sync_init(struct msm_sync *sync,
 		wake_lock_destroy(&sync->suspend_lock);
 #endif /* CONFIG_SEMC_IMX046_CAMERA */
 		wake_lock_destroy(&sync->wake_lock);
+		msm_qcmd_pool_destroy(&sync->qcmd_pool);
 		return rc;
 	}
 
@@ -2661,6 +2883,7 @@ static int msm_sync_destroy(struct msm_sync *sync)
 	wake_lock_destroy(&sync->suspend_lock);
 #endif /* CONFIG_SEMC_IMX046_CAMERA */
 	wake_lock_destroy(&sync->wake_lock);
+	msm_qcmd_pool_destroy(&sync->qcmd_pool);
 	return 0;
 }
 
@@ -129,6 +129,12 @@ int msm_gemini_core_we_buf_update(struct msm_gemini_core_buf *buf)
 	return 0;
 }
 
+/* true if the write engine has somewhere to put the next frame */
+int msm_gemini_core_we_ready(void)
+{
+	return we_pingpong_buf.buf_status[0] || we_pingpong_buf.buf_status[1];
+}
+
 void *msm_gemini_core_we_pingpong_irq(int gemini_irq_status, void *context)
 {
 	GMN_DBG("%s:%d]\n", __func__, __LINE__);
@@ -180,20 +186,24 @@ irqreturn_t msm_gemini_core_irq(int irq_num, void *context)
 
 	msm_gemini_hw_irq_clear();
 
-	if (msm_gemini_hw_irq_is_frame_done(gemini_irq_status)) {
-		data = msm_gemini_core_framedone_irq(gemini_irq_status,
+	/* The fetch engine finishes reading a frame before the encoder is
+	 * done with it; retire the input first so that frame done may
+	 * start the next frame on a clean pingpong.
+	 */
+	if (msm_gemini_hw_irq_is_fe_pingpong(gemini_irq_status)) {
+		data = msm_gemini_core_fe_pingpong_irq(gemini_irq_status,
 			context);
 		if (msm_gemini_irq_handler)
-			msm_gemini_irq_handler(
-				MSM_GEMINI_HW_MASK_COMP_FRAMEDONE,
+			msm_gemini_irq_handler(MSM_GEMINI_HW_MASK_COMP_FE,
 				context, data);
 	}
 
-	if (msm_gemini_hw_irq_is_fe_pingpong(gemini_irq_status)) {
-		data = msm_gemini_core_fe_pingpong_irq(gemini_irq_status,
+	if (msm_gemini_hw_irq_is_frame_done(gemini_irq_status)) {
+		data = msm_gemini_core_framedone_irq(gemini_irq_status,
 			context);
 		if (msm_gemini_irq_handler)
-			msm_gemini_irq_handler(MSM_GEMINI_HW_MASK_COMP_FE,
+			msm_gemini_irq_handler(
+				MSM_GEMINI_HW_MASK_COMP_FRAMEDONE,
 				context, data);
 	}
 
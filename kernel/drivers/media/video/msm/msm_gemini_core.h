@@ -41,6 +41,7 @@ void msm_gemini_core_irq_remove(void);
 
 int msm_gemini_core_fe_buf_update(struct msm_gemini_core_buf *buf);
 int msm_gemini_core_we_buf_update(struct msm_gemini_core_buf *buf);
+int msm_gemini_core_we_ready(void);
 
 int msm_gemini_core_reset(uint8_t op_mode, void *base, int size);
 int msm_gemini_core_fe_start(void);
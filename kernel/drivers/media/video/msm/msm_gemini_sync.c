@@ -73,6 +73,7 @@
 #include <linux/sched.h>
 #include <linux/list.h>
 #include <linux/uaccess.h>
+#include <linux/math64.h>
 
 #include <media/msm_gemini.h>
 #include "msm_gemini_sync.h"
@@ -80,6 +81,8 @@
 #include "msm_gemini_platform.h"
 #include "msm_gemini_common.h"
 
+static void msm_gemini_pipeline_kick(struct msm_gemini_device *pgmn_dev);
+
 /*************** queue helper ****************/
 inline void msm_gemini_q_init(char const *name, struct msm_gemini_q *q_p)
 {
@@ -409,6 +412,8 @@ int msm_gemini_output_buf_enqueue(struct msm_gemini_device *pgmn_dev,
 	buf_p->vbuf = buf_cmd;
 
 	msm_gemini_q_in(&pgmn_dev->output_buf_q, buf_p);
+
+	msm_gemini_pipeline_kick(pgmn_dev);
 	return 0;
 }
 
@@ -431,13 +436,15 @@ int msm_gemini_fe_pingpong_irq(struct msm_gemini_device *pgmn_dev,
 		rc = -1;
 	}
 
-	buf_out = msm_gemini_q_out(&pgmn_dev->input_buf_q);
+	/* when pipelined the next frame is started from frame done */
+	buf_out = pgmn_dev->pipeline ? NULL :
+		msm_gemini_q_out(&pgmn_dev->input_buf_q);
 
 	if (buf_out) {
 		rc = msm_gemini_core_fe_buf_update(buf_out);
 		kfree(buf_out);
 		msm_gemini_core_fe_start();
-	} else {
+	} else if (!pgmn_dev->pipeline) {
 		GMN_PR_ERR("%s:%d] no input buffer\n", __func__, __LINE__);
 		rc = -2;
 	}
@@ -523,6 +530,114 @@ int msm_gemini_input_buf_enqueue(struct msm_gemini_device *pgmn_dev,
 
 	msm_gemini_q_in(&pgmn_dev->input_buf_q, buf_p);
 
+	msm_gemini_pipeline_kick(pgmn_dev);
+	return 0;
+}
+
+/*************** pipelined encode ****************/
+
+/* must be called with hw_lock held */
+static void msm_gemini_frame_begin(struct msm_gemini_device *pgmn_dev)
+{
+	pgmn_dev->fe_busy = 1;
+	pgmn_dev->frame_start = ktime_get();
+}
+
+/* must be called with hw_lock held */
+static void msm_gemini_frame_end(struct msm_gemini_device *pgmn_dev)
+{
+	struct msm_gemini_stats *stats = &pgmn_dev->stats;
+	uint32_t us;
+
+	if (!pgmn_dev->fe_busy)
+		return;
+	pgmn_dev->fe_busy = 0;
+
+	us = (uint32_t) ktime_us_delta(ktime_get(), pgmn_dev->frame_start);
+	stats->frames++;
+	stats->last_us = us;
+	if (!stats->min_us || us < stats->min_us)
+		stats->min_us = us;
+	if (us > stats->max_us)
+		stats->max_us = us;
+	pgmn_dev->total_us += us;
+	stats->avg_us = (uint32_t) div_u64(pgmn_dev->total_us, stats->frames);
+}
+
+/* must be called with hw_lock held */
+static int __msm_gemini_pipeline_kick(struct msm_gemini_device *pgmn_dev)
+{
+	struct msm_gemini_core_buf *buf_p;
+
+	if (!pgmn_dev->pipeline || !pgmn_dev->configured ||
+	    pgmn_dev->fe_busy)
+		return 0;
+
+	if (!msm_gemini_core_we_ready()) {
+		if (list_empty_careful(&pgmn_dev->output_buf_q.q))
+			return 0;
+		buf_p = msm_gemini_q_out(&pgmn_dev->output_buf_q);
+		if (!buf_p)
+			return 0;
+		msm_gemini_core_we_buf_update(buf_p);
+		kfree(buf_p);
+	}
+
+	if (list_empty_careful(&pgmn_dev->input_buf_q.q))
+		return 0;
+	buf_p = msm_gemini_q_out(&pgmn_dev->input_buf_q);
+	if (!buf_p)
+		return 0;
+
+	GMN_DBG("%s:%d] 0x%08x %d\n", __func__, __LINE__,
+		(int) buf_p->y_buffer_addr, buf_p->y_len);
+	msm_gemini_core_fe_buf_update(buf_p);
+	kfree(buf_p);
+	msm_gemini_core_fe_start();
+	msm_gemini_frame_begin(pgmn_dev);
+	return 1;
+}
+
+/*
+ * Start the next queued frame if the engine is idle.  Relies on the
+ * encoder configuration written by MSM_GMN_IOCTL_START staying valid,
+ * i.e. every frame of the burst has the same format.
+ */
+static void msm_gemini_pipeline_kick(struct msm_gemini_device *pgmn_dev)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&pgmn_dev->hw_lock, flags);
+	__msm_gemini_pipeline_kick(pgmn_dev);
+	spin_unlock_irqrestore(&pgmn_dev->hw_lock, flags);
+}
+
+int msm_gemini_set_pipeline(struct msm_gemini_device *pgmn_dev,
+	unsigned long arg)
+{
+	unsigned long flags;
+
+	GMN_DBG("%s:%d] %lu\n", __func__, __LINE__, arg);
+	spin_lock_irqsave(&pgmn_dev->hw_lock, flags);
+	pgmn_dev->pipeline = !!arg;
+	spin_unlock_irqrestore(&pgmn_dev->hw_lock, flags);
+	return 0;
+}
+
+int msm_gemini_get_stats(struct msm_gemini_device *pgmn_dev,
+	void __user *to)
+{
+	struct msm_gemini_stats stats;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pgmn_dev->hw_lock, flags);
+	stats = pgmn_dev->stats;
+	spin_unlock_irqrestore(&pgmn_dev->hw_lock, flags);
+
+	if (copy_to_user(to, &stats, sizeof(stats))) {
+		GMN_PR_ERR("%s:%d]\n", __func__, __LINE__);
+		return -EFAULT;
+	}
 	return 0;
 }
 
@@ -530,11 +645,16 @@ int msm_gemini_irq(int event, void *context, void *data)
 {
 	struct msm_gemini_device *pgmn_dev =
 		(struct msm_gemini_device *) context;
+	unsigned long flags;
 
+	spin_lock_irqsave(&pgmn_dev->hw_lock, flags);
 	switch (event) {
 	case MSM_GEMINI_HW_MASK_COMP_FRAMEDONE:
 		msm_gemini_framedone_irq(pgmn_dev, data);
 		msm_gemini_we_pingpong_irq(pgmn_dev, data);
+		msm_gemini_frame_end(pgmn_dev);
+		if (__msm_gemini_pipeline_kick(pgmn_dev))
+			pgmn_dev->stats.irq_starts++;
 		break;
 
 	case MSM_GEMINI_HW_MASK_COMP_FE:
@@ -554,6 +674,7 @@ int msm_gemini_irq(int event, void *context, void *data)
 		msm_gemini_err_irq(pgmn_dev, event);
 		break;
 	}
+	spin_unlock_irqrestore(&pgmn_dev->hw_lock, flags);
 
 	return 0;
 }
@@ -592,6 +713,12 @@ int __msm_gemini_open(struct msm_gemini_device *pgmn_dev)
 	msm_gemini_q_cleanup(&pgmn_dev->input_rtn_q);
 	msm_gemini_q_cleanup(&pgmn_dev->input_buf_q);
 
+	pgmn_dev->pipeline = 0;
+	pgmn_dev->configured = 0;
+	pgmn_dev->fe_busy = 0;
+	pgmn_dev->total_us = 0;
+	memset(&pgmn_dev->stats, 0, sizeof(pgmn_dev->stats));
+
 	GMN_DBG("%s:%d] success\n", __func__, __LINE__);
 	return rc;
 }
@@ -687,11 +814,15 @@ int msm_gemini_ioctl_hw_cmds(struct msm_gemini_device *pgmn_dev,
 int msm_gemini_start(struct msm_gemini_device *pgmn_dev, void * __user arg)
 {
 	struct msm_gemini_core_buf *buf_out;
+	unsigned long flags;
+	int configured;
 	int i, rc;
 
 	GMN_DBG("%s:%d] Enter\n", __func__, __LINE__);
 
-	for (i = 0; i < 2; i++) {
+	/* a pipelined frame must not share the fetch pingpong with the
+	 * next one */
+	for (i = 0; i < (pgmn_dev->pipeline ? 1 : 2); i++) {
 		buf_out = msm_gemini_q_out(&pgmn_dev->input_buf_q);
 
 		if (buf_out) {
@@ -716,11 +847,41 @@ int msm_gemini_start(struct msm_gemini_device *pgmn_dev, void * __user arg)
 		}
 	}
 
+	/* the frame may complete before the hw cmds return, so it has to
+	 * be marked busy before the core is started */
+	spin_lock_irqsave(&pgmn_dev->hw_lock, flags);
+	configured = pgmn_dev->configured;
+	pgmn_dev->configured = 1;
+	msm_gemini_frame_begin(pgmn_dev);
+	spin_unlock_irqrestore(&pgmn_dev->hw_lock, flags);
+
 	rc = msm_gemini_ioctl_hw_cmds(pgmn_dev, arg);
+	if (rc) {
+		spin_lock_irqsave(&pgmn_dev->hw_lock, flags);
+		pgmn_dev->configured = configured;
+		pgmn_dev->fe_busy = 0;
+		spin_unlock_irqrestore(&pgmn_dev->hw_lock, flags);
+	}
+
 	GMN_DBG("%s:%d]\n", __func__, __LINE__);
 	return rc;
 }
 
+int msm_gemini_stop(struct msm_gemini_device *pgmn_dev, void * __user arg)
+{
+	unsigned long flags;
+
+	GMN_DBG("%s:%d] Enter\n", __func__, __LINE__);
+
+	/* no more frames from the irq once the core is being stopped */
+	spin_lock_irqsave(&pgmn_dev->hw_lock, flags);
+	pgmn_dev->configured = 0;
+	pgmn_dev->fe_busy = 0;
+	spin_unlock_irqrestore(&pgmn_dev->hw_lock, flags);
+
+	return msm_gemini_ioctl_hw_cmds(pgmn_dev, arg);
+}
+
 int msm_gemini_ioctl_reset(struct msm_gemini_device *pgmn_dev,
 	void * __user arg)
 {
@@ -734,6 +895,8 @@ int msm_gemini_ioctl_reset(struct msm_gemini_device *pgmn_dev,
 	}
 
 	pgmn_dev->op_mode = ctrl_cmd.type;
+	pgmn_dev->configured = 0;
+	pgmn_dev->fe_busy = 0;
 
 	rc = msm_gemini_core_reset(pgmn_dev->op_mode, pgmn_dev->base,
 		resource_size(pgmn_dev->mem));
@@ -763,7 +926,7 @@ long __msm_gemini_ioctl(struct msm_gemini_device *pgmn_dev,
 		break;
 
 	case MSM_GMN_IOCTL_STOP:
-		rc = msm_gemini_ioctl_hw_cmds(pgmn_dev, (void __user *) arg);
+		rc = msm_gemini_stop(pgmn_dev, (void __user *) arg);
 		break;
 
 	case MSM_GMN_IOCTL_START:
@@ -816,6 +979,14 @@ long __msm_gemini_ioctl(struct msm_gemini_device *pgmn_dev,
 		rc = msm_gemini_ioctl_test_dump_region(pgmn_dev, arg);
 		break;
 
+	case MSM_GMN_IOCTL_SET_PIPELINE:
+		rc = msm_gemini_set_pipeline(pgmn_dev, arg);
+		break;
+
+	case MSM_GMN_IOCTL_GET_STATS:
+		rc = msm_gemini_get_stats(pgmn_dev, (void __user *) arg);
+		break;
+
 	default:
 		GMN_PR_ERR(KERN_INFO "%s:%d] cmd = %d not supported\n",
 			__func__, __LINE__, _IOC_NR(cmd));
@@ -836,6 +1007,7 @@ struct msm_gemini_device *__msm_gemini_init(struct platform_device *pdev)
 	}
 
 	mutex_init(&pgmn_dev->lock);
+	spin_lock_init(&pgmn_dev->hw_lock);
 
 	pgmn_dev->pdev = pdev;
 
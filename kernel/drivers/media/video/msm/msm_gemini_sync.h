@@ -33,6 +33,9 @@
 #include <linux/list.h>
 #include <linux/cdev.h>
 #include <linux/platform_device.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <media/msm_gemini.h>
 #include "msm_gemini_core.h"
 
 struct msm_gemini_q {
@@ -79,6 +82,17 @@ struct msm_gemini_device {
 	/* input buf queue
 	 */
 	struct msm_gemini_q input_buf_q;
+
+	/* pipelined encode: each queued input is a whole frame and the
+	 * next one is started from the frame done interrupt
+	 */
+	spinlock_t hw_lock;
+	int pipeline;
+	int configured;	/* MSM_GMN_IOCTL_START has programmed the core */
+	int fe_busy;
+	ktime_t frame_start;
+	uint64_t total_us;
+	struct msm_gemini_stats stats;
 };
 
 int __msm_gemini_open(struct msm_gemini_device *pgmn_dev);
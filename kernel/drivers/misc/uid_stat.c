@@ -15,11 +15,14 @@
 
 #include <asm/atomic.h>
 
+#include <linux/cpufreq_times.h>
 #include <linux/err.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
 #include <linux/proc_fs.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/stat.h>
@@ -34,6 +37,8 @@ struct uid_stat {
 	uid_t uid;
 	atomic_t tcp_rcv;
 	atomic_t tcp_snd;
+	/* Time at each cpufreq state of this uid's exited tasks. */
+	cputime64_t *time_in_state;
 };
 
 static struct uid_stat *find_uid_stat(uid_t uid) {
@@ -102,6 +107,7 @@ static struct uid_stat *create_stat(uid_t uid) {
 	/* Counters start at INT_MIN, so we can track 4GB of network traffic. */
 	atomic_set(&new_uid->tcp_rcv, INT_MIN);
 	atomic_set(&new_uid->tcp_snd, INT_MIN);
+	new_uid->time_in_state = NULL;
 
 	spin_lock_irqsave(&uid_lock, flags);
 	list_add_tail(&new_uid->link, &uid_list);
@@ -140,6 +146,153 @@ int update_tcp_rcv(uid_t uid, int size) {
 	return 0;
 }
 
+#ifdef CONFIG_CPU_FREQ_TASK_TIMES
+/* Fold the times of an exiting task into its uid. */
+int update_time_in_state(uid_t uid, const cputime_t *times,
+			 unsigned int num_states)
+{
+	unsigned long flags;
+	struct uid_stat *entry;
+	cputime64_t *tis;
+	int i;
+
+	if ((entry = find_uid_stat(uid)) == NULL &&
+		((entry = create_stat(uid)) == NULL)) {
+			return -1;
+	}
+
+	if (!entry->time_in_state) {
+		tis = kzalloc(num_states * sizeof(*tis), GFP_KERNEL);
+		if (!tis)
+			return -1;
+		spin_lock_irqsave(&uid_lock, flags);
+		if (!entry->time_in_state)
+			entry->time_in_state = tis;
+		else
+			kfree(tis);
+		spin_unlock_irqrestore(&uid_lock, flags);
+	}
+
+	spin_lock_irqsave(&uid_lock, flags);
+	for (i = 0; i < num_states; i++)
+		entry->time_in_state[i] = cputime64_add(entry->time_in_state[i],
+			cputime_to_cputime64(times[i]));
+	spin_unlock_irqrestore(&uid_lock, flags);
+	return 0;
+}
+
+#define UID_TIS_MAX_NEW 64
+
+/* Make sure every uid that currently owns a task has an entry. */
+static void uid_time_in_state_add_live(void)
+{
+	struct task_struct *g, *t;
+	uid_t *uids;
+	uid_t uid;
+	int i, n = 0;
+
+	uids = kmalloc(UID_TIS_MAX_NEW * sizeof(*uids), GFP_KERNEL);
+	if (!uids)
+		return;
+
+	rcu_read_lock();
+	do_each_thread(g, t) {
+		if (!t->cpufreq_times)
+			continue;
+		uid = task_uid(t);
+		if (find_uid_stat(uid))
+			continue;
+		for (i = 0; i < n; i++)
+			if (uids[i] == uid)
+				break;
+		if (i == n && n < UID_TIS_MAX_NEW)
+			uids[n++] = uid;
+	} while_each_thread(g, t);
+	rcu_read_unlock();
+
+	for (i = 0; i < n; i++)
+		if (!find_uid_stat(uids[i]))
+			create_stat(uids[i]);
+	kfree(uids);
+}
+
+static int uid_time_in_state_show(struct seq_file *m, void *v)
+{
+	unsigned long flags;
+	struct uid_stat *entry;
+	cputime64_t *tis;
+	uid_t *uids;
+	unsigned int num_states = cpufreq_task_times_num_states();
+	int i, j, n = 0, max = 0;
+
+	if (!num_states)
+		return 0;
+
+	uid_time_in_state_add_live();
+
+	/* Entries are never removed, so a snapshot of the uids is enough
+	 * to walk the list without holding uid_lock. */
+	spin_lock_irqsave(&uid_lock, flags);
+	list_for_each_entry(entry, &uid_list, link)
+		max++;
+	spin_unlock_irqrestore(&uid_lock, flags);
+
+	uids = kmalloc(max * sizeof(*uids), GFP_KERNEL);
+	tis = kmalloc(num_states * sizeof(*tis), GFP_KERNEL);
+	if (!uids || !tis) {
+		kfree(uids);
+		kfree(tis);
+		return -ENOMEM;
+	}
+
+	spin_lock_irqsave(&uid_lock, flags);
+	list_for_each_entry(entry, &uid_list, link) {
+		if (n == max)
+			break;
+		uids[n++] = entry->uid;
+	}
+	spin_unlock_irqrestore(&uid_lock, flags);
+
+	seq_printf(m, "uid:");
+	for (j = 0; j < num_states; j++)
+		seq_printf(m, " %u", cpufreq_task_times_freq(j));
+	seq_printf(m, "\n");
+
+	for (i = 0; i < n; i++) {
+		entry = find_uid_stat(uids[i]);
+		spin_lock_irqsave(&uid_lock, flags);
+		for (j = 0; j < num_states; j++)
+			tis[j] = entry->time_in_state ?
+				entry->time_in_state[j] : 0;
+		spin_unlock_irqrestore(&uid_lock, flags);
+
+		cpufreq_task_times_add_uid(uids[i], tis);
+
+		seq_printf(m, "%d:", uids[i]);
+		for (j = 0; j < num_states; j++)
+			seq_printf(m, " %llu", (unsigned long long)
+				cputime64_to_clock_t(tis[j]));
+		seq_printf(m, "\n");
+	}
+
+	kfree(uids);
+	kfree(tis);
+	return 0;
+}
+
+static int uid_time_in_state_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, uid_time_in_state_show, NULL);
+}
+
+static const struct file_operations uid_time_in_state_fops = {
+	.open		= uid_time_in_state_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif
+
 static int __init uid_stat_init(void)
 {
 	parent = proc_mkdir("uid_stat", NULL);
@@ -147,6 +300,11 @@ static int __init uid_stat_init(void)
 		pr_err("uid_stat: failed to create proc entry\n");
 		return -1;
 	}
+#ifdef CONFIG_CPU_FREQ_TASK_TIMES
+	/* Kept outside /proc/uid_stat, which only holds uid directories. */
+	proc_create("uid_time_in_state", S_IRUGO, NULL,
+		    &uid_time_in_state_fops);
+#endif
 	return 0;
 }
 
@@ -38,6 +38,19 @@
 #define SMD_PORT_ETHER0 11
 #define POLL_DELAY 1000000 /* 1 second delay interval */
 
+/* Receive budget per NAPI poll, per channel */
+#define RMNET_NAPI_WEIGHT 64
+
+/* Every rx skb is MTU sized so tx skbs can be recycled into the pool */
+#define RMNET_RX_BUF_SIZE (ETH_FRAME_LEN + NET_IP_ALIGN)
+#define RMNET_RX_POOL_MAX 32
+
+/* Stop the netif queue when this many skbs wait for SMD space and wake
+ * it once the backlog has drained to the low mark.
+ */
+#define RMNET_TXQ_HIGH 32
+#define RMNET_TXQ_LOW 8
+
 static const char *ch_name[3] = {
 	"DATA5",
 	"DATA6",
@@ -56,13 +69,19 @@ struct rmnet_private
 	short restart_count; /* Number of polls seems so far */
 	unsigned long wakeups_xmit;
 	unsigned long wakeups_rcv;
+	unsigned long tx_stops;
+	unsigned long tx_wakes;
+	unsigned long tx_notifies;
 	unsigned long timeout_us;
 	unsigned long awake_time_ms;
 	struct delayed_work work;
 #endif
-	struct sk_buff *skb;
+	struct sk_buff_head txq;
 	spinlock_t lock;
 	struct tasklet_struct tsklt;
+
+	struct napi_struct napi;
+	struct sk_buff_head rx_pool;
 };
 
 static int count_this_packet(void *_hdr, int len)
@@ -212,6 +231,34 @@ static ssize_t wakeups_xmit_show(struct device *d,
 
 DEVICE_ATTR(wakeups_xmit, 0444, wakeups_xmit_show, NULL);
 
+static ssize_t tx_stops_show(struct device *d, struct device_attribute *attr,
+			     char *buf)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	return sprintf(buf, "%lu\n", p->tx_stops);
+}
+
+DEVICE_ATTR(tx_stops, 0444, tx_stops_show, NULL);
+
+static ssize_t tx_wakes_show(struct device *d, struct device_attribute *attr,
+			     char *buf)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	return sprintf(buf, "%lu\n", p->tx_wakes);
+}
+
+DEVICE_ATTR(tx_wakes, 0444, tx_wakes_show, NULL);
+
+/* Number of SMD interrupts raised towards the modem for tx bursts */
+static ssize_t tx_notifies_show(struct device *d,
+				struct device_attribute *attr, char *buf)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	return sprintf(buf, "%lu\n", p->tx_notifies);
+}
+
+DEVICE_ATTR(tx_notifies, 0444, tx_notifies_show, NULL);
+
 static ssize_t wakeups_rcv_show(struct device *d, struct device_attribute *attr,
 		char *buf)
 {
@@ -256,58 +303,101 @@ DEVICE_ATTR(awake_time_ms, 0444, awake_time_show, NULL);
 
 #endif
 
+static struct sk_buff *rmnet_alloc_rx_skb(struct rmnet_private *p)
+{
+	struct sk_buff *skb;
+
+	skb = skb_dequeue(&p->rx_pool);
+	if (!skb)
+		skb = dev_alloc_skb(RMNET_RX_BUF_SIZE);
+	if (skb)
+		skb_reserve(skb, NET_IP_ALIGN);
+	return skb;
+}
+
+/* Sent skbs are fully copied into SMD, so keep the plain linear ones
+ * for the receive side instead of freeing them.
+ */
+static void rmnet_recycle_skb(struct rmnet_private *p, struct sk_buff *skb)
+{
+	if (!irqs_disabled() &&
+	    skb_queue_len(&p->rx_pool) < RMNET_RX_POOL_MAX &&
+	    skb_recycle_check(skb, RMNET_RX_BUF_SIZE))
+		skb_queue_head(&p->rx_pool, skb);
+	else
+		dev_kfree_skb_any(skb);
+}
+
+static int rmnet_rx_pending(struct rmnet_private *p)
+{
+	int sz = smd_cur_packet_size(p->ch);
+
+	return sz && smd_read_avail(p->ch) >= sz;
+}
+
 /* Called in soft-irq context */
-static void smd_net_data_handler(unsigned long arg)
+static int rmnet_poll(struct napi_struct *napi, int budget)
 {
-	struct net_device *dev = (struct net_device *) arg;
+	struct net_device *dev = napi->dev;
 	struct rmnet_private *p = netdev_priv(dev);
 	struct sk_buff *skb;
-	void *ptr = 0;
-	int sz;
+	void *ptr;
+	int sz, work = 0;
 
-	for (;;) {
+	while (work < budget && rmnet_rx_pending(p)) {
 		sz = smd_cur_packet_size(p->ch);
-		if (sz == 0) break;
-		if (smd_read_avail(p->ch) < sz) break;
+		work++;
 
-		if (sz > 1514) {
+		ptr = 0;
+		skb = NULL;
+		if (sz > ETH_FRAME_LEN) {
 			pr_err("rmnet_recv() discarding %d len\n", sz);
-			ptr = 0;
 		} else {
-			skb = dev_alloc_skb(sz + NET_IP_ALIGN);
-			if (skb == NULL) {
-				pr_err("rmnet_recv() cannot allocate skb\n");
-			} else {
-				skb->dev = dev;
-				skb_reserve(skb, NET_IP_ALIGN);
+			skb = rmnet_alloc_rx_skb(p);
+			if (skb)
 				ptr = skb_put(skb, sz);
-				wake_lock_timeout(&p->wake_lock, HZ / 2);
-				if (smd_read(p->ch, ptr, sz) != sz) {
-					pr_err("rmnet_recv() smd lied about avail?!");
-					ptr = 0;
-					dev_kfree_skb_irq(skb);
-				} else {
-					skb->protocol = eth_type_trans(skb, dev);
-					if (count_this_packet(ptr, skb->len)) {
+			else
+				pr_err("rmnet_recv() cannot allocate skb\n");
+		}
+
+		if (smd_read(p->ch, ptr, sz) != sz) {
+			pr_err("rmnet_recv() smd lied about avail?!");
+			if (skb)
+				rmnet_recycle_skb(p, skb);
+			continue;
+		}
+		if (!skb) {
+			p->stats.rx_dropped++;
+			continue;
+		}
+
+		skb->dev = dev;
+		skb->protocol = eth_type_trans(skb, dev);
+		if (count_this_packet(ptr, skb->len)) {
 #ifdef CONFIG_MSM_RMNET_DEBUG
-						p->wakeups_rcv +=
-							rmnet_cause_wakeup(p);
+			p->wakeups_rcv += rmnet_cause_wakeup(p);
 #endif
-						p->stats.rx_packets++;
-						p->stats.rx_bytes += skb->len;
-					}
-					netif_rx(skb);
-				}
-				continue;
-			}
+			p->stats.rx_packets++;
+			p->stats.rx_bytes += skb->len;
 		}
-		if (smd_read(p->ch, ptr, sz) != sz)
-			pr_err("rmnet_recv() smd lied about avail?!");
+		napi_gro_receive(napi, skb);
 	}
-}
 
-static DECLARE_TASKLET(smd_net_data_tasklet, smd_net_data_handler, 0);
+	if (work)
+		wake_lock_timeout(&p->wake_lock, HZ / 2);
 
+	if (work < budget) {
+		napi_complete(napi);
+		/* smd_net_notify may have found us still scheduled */
+		if (rmnet_rx_pending(p))
+			napi_reschedule(napi);
+	}
+	return work;
+}
+
+/* Called with the tx queue head already unlinked; the modem is only
+ * signalled by the caller once the whole burst is in the fifo.
+ */
 static int _rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct rmnet_private *p = netdev_priv(dev);
@@ -315,7 +405,7 @@ static int _rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 	int smd_ret;
 
 	dev->trans_start = jiffies;
-	smd_ret = smd_write(ch, skb->data, skb->len);
+	smd_ret = smd_write_nonotify(ch, skb->data, skb->len);
 	if (smd_ret != skb->len) {
 		pr_err("%s: smd_write returned error %d", __func__, smd_ret);
 		goto xmit_out;
@@ -331,28 +421,52 @@ static int _rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 
 xmit_out:
 	/* data xmited, safe to release skb */
-	dev_kfree_skb_irq(skb);
+	rmnet_recycle_skb(p, skb);
 	return 0;
 }
 
-static void _rmnet_resume_flow(unsigned long param)
+/* Move as much of the tx queue into SMD as fits, signal the modem once
+ * for the lot, and restart the netif queue below the low watermark.
+ */
+static void rmnet_tx_drain(unsigned long param)
 {
 	struct net_device *dev = (struct net_device *)param;
 	struct rmnet_private *p = netdev_priv(dev);
-	struct sk_buff *skb = NULL;
+	struct sk_buff *skb;
 	unsigned long flags;
+	int sent = 0;
 
-	/* xmit and enable the flow only once even if
-	   multiple tasklets were scheduled by smd_net_notify */
-	spin_lock_irqsave(&p->lock, flags);
-	if (p->skb && (smd_write_avail(p->ch) >= p->skb->len)) {
-		skb = p->skb;
-		p->skb = NULL;
+	for (;;) {
+		spin_lock_irqsave(&p->lock, flags);
+		skb = skb_peek(&p->txq);
+		if (skb && smd_write_avail(p->ch) >= skb->len)
+			__skb_unlink(skb, &p->txq);
+		else
+			skb = NULL;
 		spin_unlock_irqrestore(&p->lock, flags);
+
+		if (!skb)
+			break;
 		_rmnet_xmit(skb, dev);
+		sent++;
+	}
+
+	if (sent) {
+		smd_notify_other_cpu(p->ch);
+#ifdef CONFIG_MSM_RMNET_DEBUG
+		p->tx_notifies++;
+#endif
+	}
+
+	spin_lock_irqsave(&p->lock, flags);
+	if (netif_queue_stopped(dev) &&
+	    skb_queue_len(&p->txq) <= RMNET_TXQ_LOW) {
 		netif_wake_queue(dev);
-	} else
-		spin_unlock_irqrestore(&p->lock, flags);
+#ifdef CONFIG_MSM_RMNET_DEBUG
+		p->tx_wakes++;
+#endif
+	}
+	spin_unlock_irqrestore(&p->lock, flags);
 }
 
 static void smd_net_notify(void *_dev, unsigned event)
@@ -363,16 +477,14 @@ static void smd_net_notify(void *_dev, unsigned event)
 		return;
 
 	spin_lock(&p->lock);
-	if (p->skb && (smd_write_avail(p->ch) >= p->skb->len))
+	if (!skb_queue_empty(&p->txq) &&
+	    smd_write_avail(p->ch) >= skb_peek(&p->txq)->len)
 		tasklet_hi_schedule(&p->tsklt);
 
 	spin_unlock(&p->lock);
 
-	if (smd_read_avail(p->ch) &&
-	    (smd_read_avail(p->ch) >= smd_cur_packet_size(p->ch))) {
-		smd_net_data_tasklet.data = (unsigned long) _dev;
-		tasklet_schedule(&smd_net_data_tasklet);
-	}
+	if (rmnet_rx_pending(p))
+		napi_schedule(&p->napi);
 }
 
 static int rmnet_open(struct net_device *dev)
@@ -388,6 +500,11 @@ static int rmnet_open(struct net_device *dev)
 			return -ENODEV;
 	}
 
+	napi_enable(&p->napi);
+	/* pick up anything that arrived while we were down */
+	if (rmnet_rx_pending(p))
+		napi_schedule(&p->napi);
+
 	netif_start_queue(dev);
 	return 0;
 }
@@ -395,19 +512,33 @@ static int rmnet_open(struct net_device *dev)
 static int rmnet_stop(struct net_device *dev)
 {
 	struct rmnet_private *p = netdev_priv(dev);
+	struct sk_buff_head txq;
+	unsigned long flags;
 
 	pr_info("rmnet_stop()\n");
 
 	netif_stop_queue(dev);
 	tasklet_kill(&p->tsklt);
 
+	/* smd_net_notify peeks at txq under p->lock */
+	skb_queue_head_init(&txq);
+	spin_lock_irqsave(&p->lock, flags);
+	skb_queue_splice_init(&p->txq, &txq);
+	spin_unlock_irqrestore(&p->lock, flags);
+	skb_queue_purge(&txq);
+
+	napi_disable(&p->napi);
+	skb_queue_purge(&p->rx_pool);
+
 	return 0;
 }
 
+/* Queue only; the tx tasklet runs once the stack has handed us the
+ * rest of the burst and writes it all out with a single SMD signal.
+ */
 static int rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct rmnet_private *p = netdev_priv(dev);
-	smd_channel_t *ch = p->ch;
 	unsigned long flags;
 
 	if (netif_queue_stopped(dev)) {
@@ -416,16 +547,16 @@ static int rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 	}
 
 	spin_lock_irqsave(&p->lock, flags);
-	if (smd_write_avail(ch) < skb->len) {
+	__skb_queue_tail(&p->txq, skb);
+	if (skb_queue_len(&p->txq) >= RMNET_TXQ_HIGH) {
 		netif_stop_queue(dev);
-		p->skb = skb;
-		spin_unlock_irqrestore(&p->lock, flags);
-		return 0;
+#ifdef CONFIG_MSM_RMNET_DEBUG
+		p->tx_stops++;
+#endif
 	}
 	spin_unlock_irqrestore(&p->lock, flags);
 
-	_rmnet_xmit(skb, dev);
-
+	tasklet_hi_schedule(&p->tsklt);
 	return 0;
 }
 
@@ -457,6 +588,8 @@ static void __init rmnet_setup(struct net_device *dev)
 
 	ether_setup(dev);
 
+	dev->features |= NETIF_F_GRO;
+
 	dev->change_mtu = 0; /* ??? */
 
 	random_ether_addr(dev->dev_addr);
@@ -492,14 +625,16 @@ static int __init rmnet_init(void)
 		d = &(dev->dev);
 		p = netdev_priv(dev);
 		p->chname = ch_name[n];
-		p->skb = NULL;
+		skb_queue_head_init(&p->txq);
 		spin_lock_init(&p->lock);
-		tasklet_init(&p->tsklt, _rmnet_resume_flow,
-				(unsigned long)dev);
+		tasklet_init(&p->tsklt, rmnet_tx_drain, (unsigned long)dev);
+		skb_queue_head_init(&p->rx_pool);
+		netif_napi_add(dev, &p->napi, rmnet_poll, RMNET_NAPI_WEIGHT);
 		wake_lock_init(&p->wake_lock, WAKE_LOCK_SUSPEND, ch_name[n]);
 #ifdef CONFIG_MSM_RMNET_DEBUG
 		p->timeout_us = timeout_us;
 		p->awake_time_ms = p->wakeups_xmit = p->wakeups_rcv = 0;
+		p->tx_stops = p->tx_wakes = p->tx_notifies = 0;
 		p->active_countdown = p->restart_count = 0;
 		INIT_DELAYED_WORK_DEFERRABLE(&p->work, do_check_active);
 #endif
@@ -515,6 +650,12 @@ static int __init rmnet_init(void)
 			continue;
 		if (device_create_file(d, &dev_attr_wakeups_xmit))
 			continue;
+		if (device_create_file(d, &dev_attr_tx_stops))
+			continue;
+		if (device_create_file(d, &dev_attr_tx_wakes))
+			continue;
+		if (device_create_file(d, &dev_attr_tx_notifies))
+			continue;
 		if (device_create_file(d, &dev_attr_wakeups_rcv))
 			continue;
 		if (device_create_file(d, &dev_attr_awake_time_ms))
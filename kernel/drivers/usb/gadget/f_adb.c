@@ -44,10 +44,10 @@
 #define INFO(d, fmt, args...) \
 	dev_info(&(d)->gadget->dev , fmt , ## args)
 
-#define BULK_BUFFER_SIZE           4096
+#define BULK_BUFFER_SIZE           16384
 
 /* number of tx requests to allocate */
-#define TX_REQ_MAX 4
+#define TX_REQ_MAX 8
 
 static const char shortname[] = "android_adb";
 
@@ -61,6 +61,7 @@
 #include <linux/kref.h>
 #include <linux/kthread.h>
 #include <linux/limits.h>
+#include <linux/module.h>
 #include <linux/rwsem.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
@@ -77,7 +78,11 @@
 
 #include "gadget_chips.h"
 
-#define BULK_BUFFER_SIZE           16384
+/* msm72k chains dTDs, so one request per buffer covers all of it */
+#define BULK_BUFFER_SIZE           65536
+
+/* Start writeback once this much contiguous data has been dirtied */
+#define WRITE_BEHIND_BYTES         (1024 * 1024)
 
 /*-------------------------------------------------------------------------*/
 
@@ -258,6 +263,9 @@ struct lun {
 	u32		sense_data_info;
 	u32		unit_attention_data;
 
+	loff_t		wb_start;	/* Dirty run not yet under writeback */
+	loff_t		wb_end;
+
 	struct device	dev;
 };
 
@@ -273,12 +281,19 @@ static struct lun *dev_to_lun(struct device *dev)
 #define EP0_BUFSIZE	256
 #define DELAYED_STATUS	(EP0_BUFSIZE + 999)	/* An impossibly large value */
 
-/* Number of buffers for CBW, DATA and CSW */
+/* Number of buffers for CBW, DATA and CSW.  Each one is buf_size
+ * bytes, so the ring keeps num_buffers * buf_size in flight while
+ * the thread is blocked in vfs_read or vfs_write. */
 #ifdef CONFIG_USB_CSW_HACK
-#define NUM_BUFFERS	4
+#define MIN_BUFFERS	4
 #else
-#define NUM_BUFFERS	2
+#define MIN_BUFFERS	2
 #endif
+#define MAX_BUFFERS	32
+
+static unsigned int num_buffers = 8;
+module_param(num_buffers, uint, S_IRUGO);
+MODULE_PARM_DESC(num_buffers, "Number of bulk data buffers in the ring");
 
 enum fsg_buffer_state {
 	BUF_STATE_EMPTY = 0,
@@ -362,7 +377,8 @@ struct fsg_dev {
 
 	struct fsg_buffhd	*next_buffhd_to_fill;
 	struct fsg_buffhd	*next_buffhd_to_drain;
-	struct fsg_buffhd	buffhds[NUM_BUFFERS];
+	struct fsg_buffhd	*buffhds;
+	unsigned int		num_buffers;
 
 	int			thread_wakeup_needed;
 	struct completion	thread_notifier;
@@ -937,6 +953,25 @@ static int do_read(struct fsg_dev *fsg)
 
 /*-------------------------------------------------------------------------*/
 
+/*
+ * Kick off asynchronous writeback for each WRITE_BEHIND_BYTES of
+ * sequential data, so the page cache drains to the card while the
+ * host is still sending instead of all at once in fsync_sub().
+ */
+static void write_behind(struct lun *curlun, loff_t start, loff_t end)
+{
+	if (start != curlun->wb_end)
+		curlun->wb_start = start;
+	curlun->wb_end = end;
+
+	if (end - curlun->wb_start < WRITE_BEHIND_BYTES)
+		return;
+
+	do_sync_mapping_range(curlun->filp->f_mapping, curlun->wb_start,
+			end - 1, SYNC_FILE_RANGE_WRITE);
+	curlun->wb_start = end;
+}
+
 static int do_write(struct fsg_dev *fsg)
 {
 	struct lun		*curlun = fsg->curlun;
@@ -1116,6 +1151,9 @@ static int do_write(struct fsg_dev *fsg)
 				nwritten -= (nwritten & 511);
 						/* Round down to a block */
 			}
+			if (nwritten > 0)
+				write_behind(curlun, file_offset,
+						file_offset + nwritten);
 			file_offset += nwritten;
 			amount_left_to_write -= nwritten;
 			fsg->residue -= nwritten;
@@ -1154,12 +1192,13 @@ static int do_write(struct fsg_dev *fsg)
 				 * yet from the host. So there is no point in
 				 * csw right away without the complete data.
 				 */
-				for (i = 0; i < NUM_BUFFERS; i++) {
+				for (i = 0; i < fsg->num_buffers; i++) {
 					if (fsg->buffhds[i].state ==
 							BUF_STATE_BUSY)
 						break;
 				}
-				if (!amount_left_to_req && i == NUM_BUFFERS) {
+				if (!amount_left_to_req &&
+						i == fsg->num_buffers) {
 					csw_hack_sent = 1;
 					send_status(fsg);
 				}
@@ -1795,7 +1834,7 @@ static int finish_reply(struct fsg_dev *fsg)
 			if (fsg->curlun->can_stall &&
 				fsg->residue == fsg->data_size_from_cmnd) {
 				bh->state = BUF_STATE_EMPTY;
-				for (i = 0; i < NUM_BUFFERS; ++i) {
+				for (i = 0; i < fsg->num_buffers; ++i) {
 					struct fsg_buffhd
 							*bh = &fsg->buffhds[i];
 					while (bh->state != BUF_STATE_EMPTY) {
@@ -2411,7 +2450,7 @@ static int do_set_interface(struct fsg_dev *fsg, int altsetting)
 
 reset:
 	/* Deallocate the requests */
-	for (i = 0; i < NUM_BUFFERS; ++i) {
+	for (i = 0; i < fsg->num_buffers; ++i) {
 		struct fsg_buffhd *bh = &fsg->buffhds[i];
 
 		if (bh->inreq) {
@@ -2455,7 +2494,7 @@ reset:
 	fsg->bulk_out_maxpacket = le16_to_cpu(d->wMaxPacketSize);
 
 	/* Allocate the requests */
-	for (i = 0; i < NUM_BUFFERS; ++i) {
+	for (i = 0; i < fsg->num_buffers; ++i) {
 		struct fsg_buffhd	*bh = &fsg->buffhds[i];
 
 		rc = alloc_request(fsg, fsg->bulk_in, &bh->inreq);
@@ -2574,7 +2613,7 @@ static void handle_exception(struct fsg_dev *fsg)
 	 * state, and the exception.  Then invoke the handler. */
 	spin_lock_irq(&fsg->lock);
 
-	for (i = 0; i < NUM_BUFFERS; ++i) {
+	for (i = 0; i < fsg->num_buffers; ++i) {
 		bh = &fsg->buffhds[i];
 		bh->state = BUF_STATE_EMPTY;
 	}
@@ -2733,6 +2772,7 @@ static int open_backing_file(struct fsg_dev *fsg, struct lun *curlun,
 	loff_t				size;
 	loff_t				num_sectors;
 	loff_t				min_sectors;
+	unsigned long			ra_pages;
 
 	/* R/W if we can, R/O if we must */
 	ro = curlun->ro;
@@ -2796,6 +2836,12 @@ static int open_backing_file(struct fsg_dev *fsg, struct lun *curlun,
 		goto out;
 	}
 
+	/* Read ahead at least as far as the buffer ring reaches, so
+	 * do_read() finds the next buffer's worth already cached. */
+	ra_pages = (fsg->num_buffers * fsg->buf_size) >> PAGE_CACHE_SHIFT;
+	if (filp->f_ra.ra_pages < ra_pages)
+		filp->f_ra.ra_pages = ra_pages;
+
 	get_file(filp);
 	curlun->ro = ro;
 	curlun->filp = filp;
@@ -2828,6 +2874,7 @@ static void close_backing_file(struct fsg_dev *fsg, struct lun *curlun)
 
 		last_offset = 0;
 		random_write_count = 0;
+		curlun->wb_start = curlun->wb_end = 0;
 
 		/* drop_pagecache and drop_slab are no longer available */
 		/* drop_pagecache(); */
@@ -2952,6 +2999,7 @@ static void fsg_release(struct kref *ref)
 {
 	struct fsg_dev	*fsg = container_of(ref, struct fsg_dev, ref);
 
+	kfree(fsg->buffhds);
 	kfree(fsg->luns_all);
 	kfree(fsg);
 }
@@ -3025,7 +3073,7 @@ fsg_function_unbind(struct usb_configuration *c, struct usb_function *f)
 	}
 
 	/* Free the data buffers */
-	for (i = 0; i < NUM_BUFFERS; ++i)
+	for (i = 0; i < fsg->num_buffers; ++i)
 		kfree(fsg->buffhds[i].buf);
 	switch_dev_unregister(&fsg->sdev);
 }
@@ -3186,7 +3234,7 @@ fsg_function_bind(struct usb_configuration *c, struct usb_function *f)
 	}
 
 	/* Allocate the data buffers */
-	for (i = 0; i < NUM_BUFFERS; ++i) {
+	for (i = 0; i < fsg->num_buffers; ++i) {
 		struct fsg_buffhd	*bh = &fsg->buffhds[i];
 
 		/* Allocate for the bulk-in endpoint.  We assume that
@@ -3197,7 +3245,7 @@ fsg_function_bind(struct usb_configuration *c, struct usb_function *f)
 			goto out;
 		bh->next = bh + 1;
 	}
-	fsg->buffhds[NUM_BUFFERS - 1].next = &fsg->buffhds[0];
+	fsg->buffhds[fsg->num_buffers - 1].next = &fsg->buffhds[0];
 
 	fsg->thread_task = kthread_create(fsg_main_thread, fsg,
 			shortname);
@@ -3359,6 +3407,14 @@ int mass_storage_bind_config(struct usb_configuration *c)
 	init_completion(&fsg->thread_notifier);
 
 	the_fsg->buf_size = BULK_BUFFER_SIZE;
+	the_fsg->num_buffers = clamp_t(unsigned int, num_buffers,
+			MIN_BUFFERS, MAX_BUFFERS);
+	the_fsg->buffhds = kcalloc(the_fsg->num_buffers,
+			sizeof(struct fsg_buffhd), GFP_KERNEL);
+	if (!the_fsg->buffhds) {
+		rc = -ENOMEM;
+		goto err_switch_dev_register;
+	}
 	the_fsg->sdev.name = DRIVER_NAME;
 	the_fsg->sdev.print_name = print_switch_name;
 	the_fsg->sdev.print_state = print_switch_state;
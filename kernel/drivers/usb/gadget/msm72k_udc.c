@@ -62,6 +62,12 @@ static const char driver_name[] = "msm72k_udc";
 
 #define SETUP_BUF_SIZE      4096
 
+/* A dTD moves at most 16K; longer requests are described to the
+ * controller as a chain of dTDs that completes as one transfer.
+ */
+#define DTD_MAX_BYTES       0x4000
+#define REQ_MAX_DTDS        32
+
 
 static const char *const ep_name[] = {
 	"ep0out", "ep1out", "ep2out", "ep3out",
@@ -100,6 +106,18 @@ struct msm_request {
 	dma_addr_t item_dma;
 
 	struct ept_queue_item *item;
+
+	/* dTDs following item for requests over DTD_MAX_BYTES; grown
+	 * on demand and kept until the request is freed
+	 */
+	struct msm_dtd *chain;
+	unsigned chain_alloced;
+	unsigned chain_used;
+};
+
+struct msm_dtd {
+	struct ept_queue_item *item;
+	dma_addr_t dma;
 };
 
 #define to_msm_request(r) container_of(r, struct msm_request, req)
@@ -249,6 +267,7 @@ static int msm72k_wakeup(struct usb_gadget *_gadget);
 static int msm72k_pullup(struct usb_gadget *_gadget, int is_active);
 static int msm72k_set_halt(struct usb_ep *_ep, int value);
 static void flush_endpoint(struct msm_endpoint *ept);
+static void flush_endpoint_hw(struct usb_info *ui, unsigned bits);
 static void msm72k_pm_qos_update(int);
 #ifdef CONFIG_USB_POWER_REENUMERATION
 static void usb_do_reenum_work(struct work_struct *w);
@@ -603,13 +622,110 @@ fail1:
 
 static void do_free_req(struct usb_info *ui, struct msm_request *req)
 {
+	unsigned n;
+
 	if (req->alloced)
 		kfree(req->req.buf);
 
+	for (n = 0; n < req->chain_alloced; n++)
+		dma_pool_free(ui->pool, req->chain[n].item, req->chain[n].dma);
+	kfree(req->chain);
+
 	dma_pool_free(ui->pool, req->item, req->item_dma);
 	kfree(req);
 }
 
+/* n-th dTD of a request; 0 is the one allocated with the request */
+static inline struct ept_queue_item *req_dtd(struct msm_request *req,
+					     unsigned n)
+{
+	return n ? req->chain[n - 1].item : req->item;
+}
+
+static inline struct ept_queue_item *req_last_dtd(struct msm_request *req)
+{
+	return req_dtd(req, req->chain_used);
+}
+
+/* return dTDs @first to the end of the chain to the idle state */
+static void req_reset_dtds(struct msm_request *req, unsigned first)
+{
+	struct ept_queue_item *item;
+	unsigned n;
+
+	for (n = first; n <= req->chain_used; n++) {
+		item = req_dtd(req, n);
+		item->next = TERMINATE;
+		item->info = 0;
+	}
+}
+
+static int req_grow_chain(struct usb_info *ui, struct msm_request *req,
+			  unsigned count)
+{
+	struct msm_dtd *chain;
+	unsigned n;
+
+	if (count <= req->chain_alloced)
+		return 0;
+
+	chain = kzalloc(count * sizeof(*chain), GFP_ATOMIC);
+	if (!chain)
+		return -ENOMEM;
+	if (req->chain)
+		memcpy(chain, req->chain,
+		       req->chain_alloced * sizeof(*chain));
+
+	for (n = req->chain_alloced; n < count; n++) {
+		chain[n].item = dma_pool_alloc(ui->pool, GFP_ATOMIC,
+					       &chain[n].dma);
+		if (!chain[n].item)
+			goto fail;
+	}
+
+	kfree(req->chain);
+	req->chain = chain;
+	req->chain_alloced = count;
+	return 0;
+
+fail:
+	while (n-- > req->chain_alloced)
+		dma_pool_free(ui->pool, chain[n].item, chain[n].dma);
+	kfree(chain);
+	return -ENOMEM;
+}
+
+/* Describe the mapped request buffer with one dTD per DTD_MAX_BYTES.
+ * IN chains interrupt only on the last dTD.  OUT chains interrupt on
+ * every dTD so that a short packet ending the transfer early is seen.
+ */
+static void req_fill_dtds(struct msm_endpoint *ept, struct msm_request *req)
+{
+	struct ept_queue_item *item;
+	unsigned length = req->req.length;
+	unsigned count = req->chain_used + 1;
+	dma_addr_t dma = req->dma;
+	unsigned n, xfer;
+
+	for (n = 0; n < count; n++) {
+		item = req_dtd(req, n);
+		xfer = min(length, (unsigned) DTD_MAX_BYTES);
+
+		item->next = (n + 1 < count) ? req->chain[n].dma : TERMINATE;
+		item->info = INFO_BYTES(xfer) | INFO_ACTIVE;
+		if (n + 1 == count || !(ept->flags & EPT_FLAG_IN))
+			item->info |= INFO_IOC;
+		item->page0 = dma;
+		item->page1 = (dma + 0x1000) & 0xfffff000;
+		item->page2 = (dma + 0x2000) & 0xfffff000;
+		item->page3 = (dma + 0x3000) & 0xfffff000;
+		item->page4 = (dma + 0x4000) & 0xfffff000;
+
+		dma += xfer;
+		length -= xfer;
+	}
+}
+
 
 static void usb_ept_enable(struct msm_endpoint *ept, int yes,
 		unsigned char ep_type)
@@ -657,7 +773,7 @@ static void usb_ept_start(struct msm_endpoint *ept)
 	/* mark this chain of requests as live */
 	while (req) {
 		req->live = 1;
-		if (req->item->next == TERMINATE)
+		if (req_last_dtd(req)->next == TERMINATE)
 			break;
 		req = req->next;
 	}
@@ -676,10 +792,11 @@ int usb_ept_queue_xfer(struct msm_endpoint *ept, struct usb_request *_req)
 	struct msm_request *req = to_msm_request(_req);
 	struct msm_request *last;
 	struct usb_info *ui = ept->ui;
-	struct ept_queue_item *item = req->item;
 	unsigned length = req->req.length;
+	unsigned count;
 
-	if (length > 0x4000)
+	count = length ? DIV_ROUND_UP(length, DTD_MAX_BYTES) : 1;
+	if (count > REQ_MAX_DTDS)
 		return -EMSGSIZE;
 
 	spin_lock_irqsave(&ui->lock, flags);
@@ -716,6 +833,13 @@ int usb_ept_queue_xfer(struct msm_endpoint *ept, struct usb_request *_req)
 		schedule_delayed_work(&ui->rw_work, REMOTE_WAKEUP_DELAY);
 	}
 
+	if (req_grow_chain(ui, req, count - 1)) {
+		req->req.status = -ENOMEM;
+		spin_unlock_irqrestore(&ui->lock, flags);
+		return -ENOMEM;
+	}
+	req->chain_used = count - 1;
+
 	req->busy = 1;
 	req->live = 0;
 	req->next = 0;
@@ -725,13 +849,8 @@ int usb_ept_queue_xfer(struct msm_endpoint *ept, struct usb_request *_req)
 				  (ept->flags & EPT_FLAG_IN) ?
 				  DMA_TO_DEVICE : DMA_FROM_DEVICE);
 
-	/* prepare the transaction descriptor item for the hardware */
-	item->next = TERMINATE;
-	item->info = INFO_BYTES(length) | INFO_IOC | INFO_ACTIVE;
-	item->page0 = req->dma;
-	item->page1 = (req->dma + 0x1000) & 0xfffff000;
-	item->page2 = (req->dma + 0x2000) & 0xfffff000;
-	item->page3 = (req->dma + 0x3000) & 0xfffff000;
+	/* prepare the transaction descriptor items for the hardware */
+	req_fill_dtds(ept, req);
 
 	/* Add the new request to the end of the queue */
 	last = ept->last;
@@ -747,7 +866,7 @@ int usb_ept_queue_xfer(struct msm_endpoint *ept, struct usb_request *_req)
 		 * that request is not live
 		 */
 		if (!last->live)
-			last->item->next = req->item_dma;
+			req_last_dtd(last)->next = req->item_dma;
 	} else {
 		/* queue was empty -- kick the hardware */
 		ept->req = req;
@@ -1006,12 +1125,44 @@ ack:
 	ep0_setup_ack(ui);
 }
 
+/* Walk the dTDs of a live request.  Returns the info word that decides
+ * its fate: INFO_ACTIVE while still in flight, an error status, or the
+ * last retired dTD.  *actual gets the bytes moved so far.  When a
+ * short packet ended an OUT chain before its last dTD, *cut is set to
+ * the first dTD the short packet left unused, otherwise to 0.
+ */
+static unsigned req_chain_status(struct msm_request *req,
+				 unsigned *actual, unsigned *cut)
+{
+	unsigned length = req->req.length;
+	unsigned n, xfer, left, info = 0;
+
+	*actual = 0;
+	*cut = 0;
+	for (n = 0; n <= req->chain_used; n++) {
+		info = req_dtd(req, n)->info;
+		if (info & (INFO_ACTIVE | INFO_HALTED |
+			    INFO_BUFFER_ERROR | INFO_TXN_ERROR))
+			return info;
+
+		xfer = min(length, (unsigned) DTD_MAX_BYTES);
+		left = (info >> 16) & 0x7FFF;
+		*actual += xfer - left;
+		length -= xfer;
+		if (left && n < req->chain_used) {
+			*cut = n + 1;
+			break;
+		}
+	}
+	return info;
+}
+
 static void handle_endpoint(struct usb_info *ui, unsigned bit)
 {
 	struct msm_endpoint *ept = ui->ept + bit;
-	struct msm_request *req;
+	struct msm_request *req, *r;
 	unsigned long flags;
-	unsigned info;
+	unsigned info, actual, cut;
 
 	/*
 	INFO("handle_endpoint() %d %s req=%p(%08x)\n",
@@ -1024,7 +1175,6 @@ static void handle_endpoint(struct usb_info *ui, unsigned bit)
 	while ((req = ept->req)) {
 		/* clean speculative fetches on req->item->info */
 		dma_coherent_post_ops();
-		info = req->item->info;
 
 		/* if we've processed all live requests, time to
 		 * restart the hardware on the next non-live request
@@ -1034,10 +1184,27 @@ static void handle_endpoint(struct usb_info *ui, unsigned bit)
 			break;
 		}
 
+		info = req_chain_status(req, &actual, &cut);
+
 		/* if the transaction is still in-flight, stop here */
 		if (info & INFO_ACTIVE)
 			break;
 
+		/* The controller has moved on to the rest of this
+		 * request's chain.  Flush it off before the buffer is
+		 * unmapped and given back, so that the next packet
+		 * from the host can't land there, and retire the
+		 * unused dTDs.  The loop then re-primes the endpoint
+		 * at the next request.  Like dequeue, the flush runs
+		 * under ui->lock; only one endpoint is flushed.
+		 */
+		if (cut) {
+			flush_endpoint_hw(ui, 1 << ept->bit);
+			req_reset_dtds(req, cut);
+			for (r = req->next; r; r = r->next)
+				r->live = 0;
+		}
+
 		/* advance ept queue to the next request */
 		ept->req = req->next;
 		if (ept->req == 0)
@@ -1057,8 +1224,7 @@ static void handle_endpoint(struct usb_info *ui, unsigned bit)
 			       info);
 		} else {
 			req->req.status = 0;
-			req->req.actual =
-				req->req.length - ((info >> 16) & 0x7FFF);
+			req->req.actual = actual;
 		}
 		req->busy = 0;
 		req->live = 0;
@@ -2049,20 +2215,19 @@ static int msm72k_dequeue(struct usb_ep *_ep, struct usb_request *_req)
 
 	if (ep->req == req) {
 		ep->req = req->next;
-		ep->head->next = req->item->next;
+		ep->head->next = req_last_dtd(req)->next;
 	} else {
 		req->prev->next = req->next;
 		if (req->next)
 			req->next->prev = req->prev;
-		req->prev->item->next = req->item->next;
+		req_last_dtd(req->prev)->next = req_last_dtd(req)->next;
 	}
 
 	if (!req->next)
 		ep->last = req->prev;
 
 	/* initialize request to default */
-	req->item->next = TERMINATE;
-	req->item->info = 0;
+	req_reset_dtds(req, 0);
 	req->live = 0;
 	dma_unmap_single(NULL, req->dma, req->req.length,
 		(ep->flags & EPT_FLAG_IN) ?
@@ -506,8 +506,41 @@ static void nt35580_lcd_power_on(struct platform_device *pdev)
 		panel->panel_ext->power_on();
 }
 
+/*
+ * Column/page window currently programmed into the panel. Partial
+ * updates move it; unchanged windows cost no register writes.
+ */
+static uint16 win_x1, win_x2, win_y1, win_y2;
+
+static void nt35580_lcd_window_adjust(uint16 x1, uint16 x2,
+				      uint16 y1, uint16 y2)
+{
+	if (x1 == win_x1 && x2 == win_x2 && y1 == win_y1 && y2 == win_y2)
+		return;
+
+	write_client_reg(SET_HORIZONTAL_ADDRESS_0, x1 >> 8);
+	write_client_reg(SET_HORIZONTAL_ADDRESS_1, x1 & 0xff);
+	write_client_reg(SET_HORIZONTAL_ADDRESS_2, x2 >> 8);
+	write_client_reg(SET_HORIZONTAL_ADDRESS_3, x2 & 0xff);
+
+	write_client_reg(SET_VERTICAL_ADDRESS_0, y1 >> 8);
+	write_client_reg(SET_VERTICAL_ADDRESS_1, y1 & 0xff);
+	write_client_reg(SET_VERTICAL_ADDRESS_2, y2 >> 8);
+	write_client_reg(SET_VERTICAL_ADDRESS_3, y2 & 0xff);
+
+	win_x1 = x1;
+	win_x2 = x2;
+	win_y1 = y1;
+	win_y2 = y2;
+}
+
 static void nt35580_lcd_driver_initialization(void)
 {
+	win_x1 = 0;
+	win_x2 = 0x01DF;
+	win_y1 = 0;
+	win_y2 = 0x0355;
+
 	write_client_reg(SET_HORIZONTAL_ADDRESS_0, 0x0000);
 	write_client_reg(SET_HORIZONTAL_ADDRESS_1, 0x0000);
 	write_client_reg(SET_HORIZONTAL_ADDRESS_2, 0x0001);
@@ -733,6 +766,9 @@ static int __init mddi_nt35580_lcd_lcd_probe(struct platform_device *pdev)
 
 	panel_data->on  = mddi_nt35580_lcd_lcd_on;
 	panel_data->off = mddi_nt35580_lcd_lcd_off;
+	if (panel_data->panel_ext && !panel_data->panel_ext->window_adjust)
+		panel_data->panel_ext->window_adjust =
+			nt35580_lcd_window_adjust;
 
 /*	nv_vsync = nt35580_lcd_get_nv_vsync();
 	nv_vsync >>= 16;
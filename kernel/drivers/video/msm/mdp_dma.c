@@ -171,8 +171,9 @@ static void mdp_dma2_update_lcd(struct msm_fb_data_type *mfd)
 #if defined(MDDI_HOST_WINDOW_WORKAROUND) \
 	|| defined(CONFIG_FB_MSM_MDDI_SEMC_LCD_WINDOW_ADJUST)
 				mddi_window_adjust(mfd, iBuf->dma_x,
-						   iBuf->dma_w - 1, iBuf->dma_y,
-						   iBuf->dma_h - 1);
+						   iBuf->dma_x + iBuf->dma_w - 1,
+						   iBuf->dma_y,
+						   iBuf->dma_y + iBuf->dma_h - 1);
 #endif
 			} else {
 				dma2_cfg_reg |=
@@ -181,8 +182,9 @@ static void mdp_dma2_update_lcd(struct msm_fb_data_type *mfd)
 #if defined(MDDI_HOST_WINDOW_WORKAROUND) \
 	|| defined(CONFIG_FB_MSM_MDDI_SEMC_LCD_WINDOW_ADJUST)
 				mddi_window_adjust(mfd, iBuf->dma_x,
-						   iBuf->dma_w - 1, iBuf->dma_y,
-						   iBuf->dma_h - 1);
+						   iBuf->dma_x + iBuf->dma_w - 1,
+						   iBuf->dma_y,
+						   iBuf->dma_y + iBuf->dma_h - 1);
 #endif
 			}
 		} else {
@@ -576,14 +578,26 @@ void mdp_set_dma_pan_info(struct fb_info *info, struct mdp_dirty_region *dirty,
 	iBuf->vsync_enable = sync;
 
 	if (dirty) {
+		uint32 x = dirty->xoffset % info->var.xres;
+		uint32 y = dirty->yoffset % info->var.yres;
+		uint32 x1 = x + dirty->width;
+		uint32 y1 = y + dirty->height;
+
 		/*
-		 * ToDo: dirty region check inside var.xoffset+xres
-		 * <-> var.yoffset+yres
+		 * msm_fb_pan_display() has checked the region against
+		 * xres/yres. If the sw refresher has not sent the
+		 * previous update yet, send the union of both regions.
 		 */
-		iBuf->dma_x = dirty->xoffset % info->var.xres;
-		iBuf->dma_y = dirty->yoffset % info->var.yres;
-		iBuf->dma_w = dirty->width;
-		iBuf->dma_h = dirty->height;
+		if (mfd->sw_currently_refreshing && !mfd->ibuf_flushed) {
+			x1 = max(x1, iBuf->dma_x + iBuf->dma_w);
+			y1 = max(y1, iBuf->dma_y + iBuf->dma_h);
+			x = min(x, iBuf->dma_x);
+			y = min(y, iBuf->dma_y);
+		}
+		iBuf->dma_x = x;
+		iBuf->dma_y = y;
+		iBuf->dma_w = x1 - x;
+		iBuf->dma_h = y1 - y;
 	} else {
 		iBuf->dma_x = 0;
 		iBuf->dma_y = 0;
@@ -1241,6 +1241,18 @@ int get_img(struct mdp_img *img, struct fb_info *info, unsigned long *start,
 	unsigned long vstart;
 #endif
 
+	/* Intermediate passes of a planned blit use the scratch buffer */
+	if (!msm_fb_blit_get_scratch(img->memory_id, start, len)) {
+		*pp_file = NULL;
+		return 0;
+	}
+
+	/* Asynchronous blits pinned their buffers at submit time */
+	ret = msm_fb_blit_get_pinned(img->memory_id, start, len, pp_file);
+	if (ret != -ENOENT)
+		return ret;
+	ret = 0;
+
 #ifdef CONFIG_ANDROID_PMEM
 	if (!get_pmem_file(img->memory_id, start, &vstart, len, pp_file))
 		return 0;
@@ -1263,6 +1275,9 @@ int get_img(struct mdp_img *img, struct fb_info *info, unsigned long *start,
 
 void put_img(struct file *p_src_file)
 {
+	/* Pinned files are released by the async blit owner */
+	if (msm_fb_blit_pinned_active())
+		return;
 #ifdef CONFIG_ANDROID_PMEM
 	if (p_src_file)
 		put_pmem_file(p_src_file);
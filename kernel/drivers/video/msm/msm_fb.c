@@ -39,6 +39,8 @@
 #include <linux/console.h>
 #include <linux/android_pmem.h>
 #include <linux/leds.h>
+#include <linux/file.h>
+#include <linux/major.h>
 
 #define MSM_FB_C
 #include "msm_fb.h"
@@ -106,6 +108,9 @@ static int msm_fb_blank_sub(int blank_mode, struct fb_info *info,
 			    boolean op_enable);
 static int msm_fb_suspend_sub(struct msm_fb_data_type *mfd);
 static int msm_fb_resume_sub(struct msm_fb_data_type *mfd);
+static void msmfb_blit_block(struct msm_fb_data_type *mfd, boolean block);
+static void msm_fb_pan_cache_clean(struct fb_info *info,
+			struct mdp_dirty_region *dirty);
 static int msm_fb_ioctl(struct fb_info *info, unsigned int cmd,
 			unsigned long arg);
 static int msm_fb_mmap(struct fb_info *info, struct vm_area_struct * vma);
@@ -367,6 +372,9 @@ static int msm_fb_suspend_sub(struct msm_fb_data_type *mfd)
 	mfd->suspend.op_enable = mfd->op_enable;
 	mfd->suspend.panel_power_on = mfd->panel_power_on;
 
+	/* Let queued blits finish and hold new ones until resume */
+	msmfb_blit_block(mfd, TRUE);
+
 	if (mfd->op_enable) {
 		ret =
 		     msm_fb_blank_sub(FB_BLANK_POWERDOWN, mfd->fbi,
@@ -374,6 +382,7 @@ static int msm_fb_suspend_sub(struct msm_fb_data_type *mfd)
 		if (ret) {
 			MSM_FB_INFO
 			    ("msm_fb_suspend: can't turn off display!\n");
+			msmfb_blit_block(mfd, FALSE);
 			return ret;
 		}
 		mfd->op_enable = FALSE;
@@ -454,6 +463,8 @@ static int msm_fb_resume_sub(struct msm_fb_data_type *mfd)
 			MSM_FB_INFO("msm_fb_resume: can't turn on display!\n");
 	}
 
+	msmfb_blit_block(mfd, FALSE);
+
 	return ret;
 }
 
@@ -1133,6 +1144,9 @@ static int msm_fb_register(struct msm_fb_data_type *mfd)
 			msm_fb_debugfs_file_create(sub_dir, "frame_count",
 						   (u32 *) &mfd->panel_info.
 						   frame_count);
+			msm_fb_debugfs_file_create(sub_dir,
+						   "partial_frame_count",
+						   &mfd->partial_frame_count);
 
 
 			switch (mfd->dest) {
@@ -1257,8 +1271,7 @@ static int msm_fb_pan_display(struct fb_var_screeninfo *var,
 		info->var.yoffset =
 		    (var->yoffset / info->fix.ypanstep) * info->fix.ypanstep;
 
-	/* "UPDT" */
-	if (var->reserved[0] == 0x54445055) {
+	if (var->reserved[0] == MSMFB_PAN_DIRTY_MAGIC) {
 		dirty.xoffset = var->reserved[1] & 0xffff;
 		dirty.yoffset = (var->reserved[1] >> 16) & 0xffff;
 
@@ -1291,12 +1304,15 @@ static int msm_fb_pan_display(struct fb_var_screeninfo *var,
 	}
 
 	down(&msm_fb_pan_sem);
+	msm_fb_pan_cache_clean(info, dirtyPtr);
 	mdp_set_dma_pan_info(info, dirtyPtr,
 			     (var->activate == FB_ACTIVATE_VBL));
 	mdp_dma_pan_update(info);
 	up(&msm_fb_pan_sem);
 
 	++mfd->panel_info.frame_count;
+	if (dirtyPtr)
+		++mfd->partial_frame_count;
 	return 0;
 }
 
@@ -1608,6 +1624,270 @@ static int mdp_blit_split_height(struct fb_info *info,
 }
 #endif
 
+/*
+ * Blit planner.
+ *
+ * A single PPP pass already converts colour space, scales, rotates,
+ * flips and blends, so a composite request normally runs as one pass.
+ * A pass is only split when the scale factor in either direction is
+ * beyond what the PPP scaler can do at once. The scaling is then
+ * staged through a scratch buffer: the first pass also converts YUV
+ * to RGB, the intermediate passes only scale, and the last pass does
+ * the rotation, flips and blending into the real destination. Each
+ * pass still goes through mdp_blit(), so the MDP3x stripe workarounds
+ * apply to every pass.
+ *
+ * Runs under msm_fb_ioctl_ppp_sem, which also protects the scratch
+ * buffer. Only the PPP touches the scratch, so it is plain pages mapped
+ * for DMA once rather than memory from the small coherent pool. It is
+ * kept while blits keep coming and freed after MDP_BLIT_SCRATCH_IDLE_MS
+ * without a planned blit. Each half is limited to a full panel at
+ * 32bpp.
+ */
+#define MDP_BLIT_MAX_PASSES	3
+#define MDP_BLIT_SCRATCH_IDLE_MS	2000
+
+/* memory_id of the scratch buffer; never a valid file descriptor */
+#define MSMFB_SCRATCH_ID	(-2)
+
+DECLARE_MUTEX(msm_fb_ioctl_ppp_sem);
+
+static void *mdp_blit_scratch;
+static dma_addr_t mdp_blit_scratch_phys;
+static size_t mdp_blit_scratch_size;
+/* part of the scratch buffer used by the running plan */
+static size_t mdp_blit_scratch_len;
+static int mdp_blit_planning;
+/* jiffies at the end of the last planned blit */
+static unsigned long mdp_blit_scratch_used;
+
+static void mdp_blit_scratch_release(struct work_struct *work);
+static DECLARE_DELAYED_WORK(mdp_blit_scratch_work, mdp_blit_scratch_release);
+
+int msm_fb_blit_get_scratch(int memory_id, unsigned long *start,
+			    unsigned long *len)
+{
+	if (memory_id != MSMFB_SCRATCH_ID || !mdp_blit_planning)
+		return -ENOENT;
+
+	*start = mdp_blit_scratch_phys;
+	*len = mdp_blit_scratch_len;
+	return 0;
+}
+
+/* Called with msm_fb_ioctl_ppp_sem held. */
+static void mdp_blit_scratch_free(void)
+{
+	if (!mdp_blit_scratch)
+		return;
+
+	dma_unmap_single(NULL, mdp_blit_scratch_phys, mdp_blit_scratch_size,
+			 DMA_BIDIRECTIONAL);
+	free_pages_exact(mdp_blit_scratch, mdp_blit_scratch_size);
+	mdp_blit_scratch = NULL;
+	mdp_blit_scratch_size = 0;
+}
+
+static void mdp_blit_scratch_release(struct work_struct *work)
+{
+	unsigned long idle = msecs_to_jiffies(MDP_BLIT_SCRATCH_IDLE_MS);
+	unsigned long left = idle;
+
+	/* don't wait behind a running blit, just look again later */
+	if (!down_trylock(&msm_fb_ioctl_ppp_sem)) {
+		if (time_after_eq(jiffies, mdp_blit_scratch_used + idle))
+			mdp_blit_scratch_free();
+		else
+			left = mdp_blit_scratch_used + idle - jiffies;
+		up(&msm_fb_ioctl_ppp_sem);
+		if (!mdp_blit_scratch)
+			return;
+	}
+	schedule_delayed_work(&mdp_blit_scratch_work, left);
+}
+
+static int mdp_blit_scratch_reserve(size_t len)
+{
+	if (len <= mdp_blit_scratch_size)
+		return 0;
+
+	/* don't hold both buffers at once */
+	mdp_blit_scratch_free();
+
+	mdp_blit_scratch = alloc_pages_exact(len, GFP_KERNEL | __GFP_NOWARN);
+	if (!mdp_blit_scratch)
+		return -ENOMEM;
+	/* Write back and drop any lines the pages still have in the
+	 * cache, so none can be evicted over what the PPP writes. The
+	 * CPU never touches the buffer after this. */
+	mdp_blit_scratch_phys = dma_map_single(NULL, mdp_blit_scratch, len,
+					       DMA_BIDIRECTIONAL);
+	mdp_blit_scratch_size = len;
+	return 0;
+}
+
+static int mdp_blit_scale_ok(uint32_t src, uint32_t dst)
+{
+	uint32_t ratio = (MDP_SCALE_Q_FACTOR * dst) / src;
+
+	return ratio <= MDP_MAX_X_SCALE_FACTOR &&
+		ratio >= MDP_MIN_X_SCALE_FACTOR;
+}
+
+/*
+ * Fill in the intermediate sizes needed to scale @src to @dst, one per
+ * extra pass. Returns the number of extra passes, or -1 if more than
+ * MDP_BLIT_MAX_PASSES would be needed.
+ */
+static int mdp_blit_plan_dim(uint32_t src, uint32_t dst, uint32_t *steps)
+{
+	uint32_t cur = src;
+	int n = 0;
+
+	while (!mdp_blit_scale_ok(cur, dst)) {
+		if (n == MDP_BLIT_MAX_PASSES - 1)
+			return -1;
+		if (dst > cur)
+			cur = (cur * MDP_MAX_X_SCALE_FACTOR) /
+				MDP_SCALE_Q_FACTOR;
+		else
+			cur = DIV_ROUND_UP(cur * MDP_MIN_X_SCALE_FACTOR,
+					   MDP_SCALE_Q_FACTOR);
+		steps[n++] = cur;
+	}
+	return n;
+}
+
+static uint32_t mdp_blit_scratch_format(struct mdp_blit_req *req)
+{
+	switch (req->src.format) {
+	case MDP_ARGB_8888:
+	case MDP_RGBA_8888:
+	case MDP_BGRA_8888:
+		/* keep per-pixel alpha for the final blend */
+		return req->src.format;
+	default:
+		break;
+	}
+	if (req->dst.format == MDP_RGB_565 || req->dst.format == MDP_BGR_565)
+		return req->dst.format;
+	return MDP_RGB_565;
+}
+
+static int mdp_blit_planned(struct fb_info *info, struct mdp_blit_req *req)
+{
+	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+	uint32_t xsteps[MDP_BLIT_MAX_PASSES], ysteps[MDP_BLIT_MAX_PASSES];
+	uint32_t dst_w, dst_h, w, h, fmt, bpp;
+	struct mdp_blit_req pass;
+	size_t half = 0;
+	int nx, ny, n, i, ret = 0;
+
+	if (req->src.format == MDP_FB_FORMAT)
+		req->src.format = mfd->fb_imgType;
+	if (req->dst.format == MDP_FB_FORMAT)
+		req->dst.format = mfd->fb_imgType;
+
+	if (req->flags & MDP_ROT_90) {
+		dst_w = req->dst_rect.h;
+		dst_h = req->dst_rect.w;
+	} else {
+		dst_w = req->dst_rect.w;
+		dst_h = req->dst_rect.h;
+	}
+
+	nx = mdp_blit_plan_dim(req->src_rect.w, dst_w, xsteps);
+	ny = mdp_blit_plan_dim(req->src_rect.h, dst_h, ysteps);
+	if (nx < 0 || ny < 0)
+		return -EINVAL;
+
+	/* Pad the shorter plan with passes that don't scale */
+	n = max(nx, ny);
+	for (i = nx; i < n; i++)
+		xsteps[i] = i ? xsteps[i - 1] : req->src_rect.w;
+	for (i = ny; i < n; i++)
+		ysteps[i] = i ? ysteps[i - 1] : req->src_rect.h;
+
+	fmt = mdp_blit_scratch_format(req);
+	bpp = mdp_get_bytes_per_pixel(fmt);
+	for (i = 0; i < n; i++)
+		half = max(half, (size_t)ALIGN(xsteps[i] * ysteps[i] * bpp,
+					       PAGE_SIZE));
+	if (half > ALIGN(mfd->panel_info.xres * mfd->panel_info.yres * 4,
+			 PAGE_SIZE) || get_order(2 * half) >= MAX_ORDER)
+		return -EINVAL;
+
+	/* Two halves so consecutive passes can ping-pong */
+	mdp_blit_scratch_len = (n > 1 ? 2 : 1) * half;
+	ret = mdp_blit_scratch_reserve(mdp_blit_scratch_len);
+	if (ret)
+		return ret;
+
+	mdp_blit_planning = 1;
+
+	pass = *req;
+	for (i = 0; i <= n; i++) {
+		if (i > 0) {
+			/* read what the previous pass wrote */
+			pass.src = pass.dst;
+			pass.src_rect = pass.dst_rect;
+		}
+
+		if (i == n) {
+			/* last pass: the real destination and all effects */
+			pass.dst = req->dst;
+			pass.dst_rect = req->dst_rect;
+			pass.flags = req->flags & ~MDP_DEINTERLACE;
+			pass.alpha = req->alpha;
+			pass.transp_mask = req->transp_mask;
+		} else {
+			w = xsteps[i];
+			h = ysteps[i];
+			pass.dst.width = w;
+			pass.dst.height = h;
+			pass.dst.format = fmt;
+			pass.dst.offset = (i & 1) * half;
+			pass.dst.memory_id = MSMFB_SCRATCH_ID;
+			pass.dst_rect.x = 0;
+			pass.dst_rect.y = 0;
+			pass.dst_rect.w = w;
+			pass.dst_rect.h = h;
+			/* only the first pass may deinterlace */
+			pass.flags = i ? 0 : req->flags & MDP_DEINTERLACE;
+			pass.alpha = MDP_ALPHA_NOP;
+			pass.transp_mask = MDP_TRANSP_NOP;
+		}
+
+		ret = mdp_blit(info, &pass);
+		if (ret)
+			break;
+	}
+
+	mdp_blit_planning = 0;
+
+	mdp_blit_scratch_used = jiffies;
+	schedule_delayed_work(&mdp_blit_scratch_work,
+			      msecs_to_jiffies(MDP_BLIT_SCRATCH_IDLE_MS));
+
+	return ret;
+}
+
+static int mdp_blit_needs_plan(struct mdp_blit_req *req)
+{
+	uint32_t dst_w, dst_h;
+
+	if (req->flags & MDP_ROT_90) {
+		dst_w = req->dst_rect.h;
+		dst_h = req->dst_rect.w;
+	} else {
+		dst_w = req->dst_rect.w;
+		dst_h = req->dst_rect.h;
+	}
+
+	return !mdp_blit_scale_ok(req->src_rect.w, dst_w) ||
+		!mdp_blit_scale_ok(req->src_rect.h, dst_h);
+}
+
 int mdp_blit(struct fb_info *info, struct mdp_blit_req *req)
 {
 	int ret;
@@ -1642,6 +1922,17 @@ int mdp_blit(struct fb_info *info, struct mdp_blit_req *req)
 	if (unlikely(req->dst_rect.h == 0 || req->dst_rect.w == 0))
 		return 0;
 
+	/* The scratch buffer is only ever named by the planner */
+	if (!mdp_blit_planning && (req->src.memory_id == MSMFB_SCRATCH_ID ||
+				   req->dst.memory_id == MSMFB_SCRATCH_ID))
+		return -EINVAL;
+
+	if (mdp_blit_needs_plan(req)) {
+		if (mdp_blit_planning)
+			return -EINVAL;
+		return mdp_blit_planned(info, req);
+	}
+
 #if defined CONFIG_FB_MSM_MDP31
 	/* MDP width split workaround */
 	remainder = (req->dst_rect.w)%32;
@@ -1948,28 +2239,144 @@ int mdp_blit(struct fb_info *info, struct mdp_blit_req *req)
 
 typedef void (*msm_dma_barrier_function_pointer) (void *, size_t);
 
+/*
+ * Bytes of cache cleaned and invalidated for MDP DMA. The frame counters
+ * are rolled over on every pan, so msm_fb_frame_* describe the last
+ * complete frame.
+ */
+static u32 msm_fb_cache_clean_bytes;
+static u32 msm_fb_cache_inv_bytes;
+static u32 msm_fb_frame_clean_bytes;
+static u32 msm_fb_frame_inv_bytes;
+static u32 msm_fb_total_clean_bytes;
+static u32 msm_fb_total_inv_bytes;
+
+static void msm_fb_cache_frame_done(void)
+{
+	msm_fb_frame_clean_bytes = msm_fb_cache_clean_bytes;
+	msm_fb_frame_inv_bytes = msm_fb_cache_inv_bytes;
+	msm_fb_cache_clean_bytes = 0;
+	msm_fb_cache_inv_bytes = 0;
+}
+
+/*
+ * Apply a barrier to @h rows of @row bytes, @stride bytes apart.
+ * Rectangles narrower than half the stride are done a row at a time so
+ * the gaps between rows are left alone; wider ones are done as one
+ * span, which is cheaper than many short calls.
+ */
+static void msm_fb_dma_barrier_for_span(unsigned long start, size_t stride,
+			size_t row, uint32_t h,
+			msm_dma_barrier_function_pointer dma_barrier_fp)
+{
+	uint32_t i;
+
+	if (!h || !row)
+		return;
+
+	if (h == 1 || (row << 1) >= stride) {
+		(*dma_barrier_fp) ((void *) start, (h - 1) * stride + row);
+		return;
+	}
+
+	for (i = 0; i < h; i++, start += stride)
+		(*dma_barrier_fp) ((void *) start, row);
+}
+
 static inline void msm_fb_dma_barrier_for_rect(struct fb_info *info,
 			struct mdp_img *img, struct mdp_rect *rect,
 			msm_dma_barrier_function_pointer dma_barrier_fp
 			)
 {
 	/*
-	 * Compute the start and end addresses of the rectangles.
-	 * NOTE: As currently implemented, the data between
-	 *       the end of one row and the start of the next is
-	 *       included in the address range rather than
-	 *       doing multiple calls for each row.
+	 * Compute the start address and stride of the rectangle.
 	 */
-
 	char * const pmem_start = info->screen_base;
 	int bytes_per_pixel = mdp_get_bytes_per_pixel(img->format);
 	unsigned long start = (unsigned long)pmem_start + img->offset +
 		(img->width * rect->y + rect->x) * bytes_per_pixel;
-	size_t size  = (rect->h * img->width + rect->w) * bytes_per_pixel;
-	(*dma_barrier_fp) ((void *) start, size);
 
+	msm_fb_dma_barrier_for_span(start, img->width * bytes_per_pixel,
+			rect->w * bytes_per_pixel, rect->h, dma_barrier_fp);
+}
+
+#ifdef CONFIG_ARCH_QSD8X50
+
+/*
+ * Rectangles collected from one window of blit requests. Overlapping
+ * rectangles of the same image are folded into their bounding box so
+ * shared areas (typically the destination framebuffer) are only
+ * maintained once. Protected by msm_fb_ioctl_ppp_sem.
+ */
+struct msm_fb_barrier_rect {
+	struct mdp_img *img;
+	struct mdp_rect rect;
+};
+
+#define MSM_FB_MAX_BARRIER_RECTS (2 * MDP_ASYNC_BLIT_MAX)
+
+static struct msm_fb_barrier_rect msm_fb_barrier_rects[MSM_FB_MAX_BARRIER_RECTS];
+static int msm_fb_nr_barrier_rects;
+
+static int msm_fb_same_img(struct mdp_img *a, struct mdp_img *b)
+{
+	return a->memory_id == b->memory_id && a->offset == b->offset &&
+		a->width == b->width && a->format == b->format;
 }
 
+static int msm_fb_rects_overlap(struct mdp_rect *a, struct mdp_rect *b)
+{
+	return a->x < b->x + b->w && b->x < a->x + a->w &&
+		a->y < b->y + b->h && b->y < a->y + a->h;
+}
+
+static void msm_fb_barrier_add_rect(struct fb_info *info,
+			struct mdp_img *img, struct mdp_rect *rect,
+			msm_dma_barrier_function_pointer dma_barrier_fp)
+{
+	struct msm_fb_barrier_rect *br;
+	uint32_t x1, y1;
+	int i;
+
+	for (i = 0; i < msm_fb_nr_barrier_rects; i++) {
+		br = &msm_fb_barrier_rects[i];
+		if (!msm_fb_same_img(br->img, img) ||
+		    !msm_fb_rects_overlap(&br->rect, rect))
+			continue;
+
+		x1 = max(br->rect.x + br->rect.w, rect->x + rect->w);
+		y1 = max(br->rect.y + br->rect.h, rect->y + rect->h);
+		br->rect.x = min(br->rect.x, rect->x);
+		br->rect.y = min(br->rect.y, rect->y);
+		br->rect.w = x1 - br->rect.x;
+		br->rect.h = y1 - br->rect.y;
+		return;
+	}
+
+	if (msm_fb_nr_barrier_rects == MSM_FB_MAX_BARRIER_RECTS) {
+		msm_fb_dma_barrier_for_rect(info, img, rect, dma_barrier_fp);
+		return;
+	}
+
+	br = &msm_fb_barrier_rects[msm_fb_nr_barrier_rects++];
+	br->img = img;
+	br->rect = *rect;
+}
+
+static void msm_fb_barrier_flush_rects(struct fb_info *info,
+			msm_dma_barrier_function_pointer dma_barrier_fp)
+{
+	int i;
+
+	for (i = 0; i < msm_fb_nr_barrier_rects; i++)
+		msm_fb_dma_barrier_for_rect(info,
+				msm_fb_barrier_rects[i].img,
+				&msm_fb_barrier_rects[i].rect,
+				dma_barrier_fp);
+	msm_fb_nr_barrier_rects = 0;
+}
+#endif
+
 static inline void msm_dma_nc_pre(void)
 {
 	dmb();
@@ -1981,11 +2388,50 @@ static inline void msm_dma_wt_pre(void)
 static inline void msm_dma_todevice_wb_pre(void *start, size_t size)
 {
 	dma_cache_pre_ops(start, size, DMA_TO_DEVICE);
+	msm_fb_cache_clean_bytes += size;
+	msm_fb_total_clean_bytes += size;
 }
 
 static inline void msm_dma_fromdevice_wb_pre(void *start, size_t size)
 {
 	dma_cache_pre_ops(start, size, DMA_FROM_DEVICE);
+	msm_fb_cache_inv_bytes += size;
+	msm_fb_total_inv_bytes += size;
+}
+
+/*
+ * Clean the part of the frame being panned to out of a cached
+ * framebuffer mapping: the dirty region if there is one, otherwise the
+ * whole visible frame. Also closes the frame for the cache counters.
+ */
+static void msm_fb_pan_cache_clean(struct fb_info *info,
+			struct mdp_dirty_region *dirty)
+{
+	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+	int bpp = info->var.bits_per_pixel / 8;
+	size_t stride = info->fix.line_length;
+	unsigned long start = (unsigned long)info->screen_base +
+		info->var.yoffset * stride + info->var.xoffset * bpp;
+
+	switch (mfd->mdp_fb_page_protection) {
+	case MDP_FB_PAGE_PROTECTION_WRITEBACKCACHE:
+	case MDP_FB_PAGE_PROTECTION_WRITEBACKWACACHE:
+		if (dirty) {
+			start += dirty->yoffset * stride + dirty->xoffset * bpp;
+			msm_fb_dma_barrier_for_span(start, stride,
+					dirty->width * bpp, dirty->height,
+					msm_dma_todevice_wb_pre);
+		} else {
+			msm_fb_dma_barrier_for_span(start, stride,
+					info->var.xres * bpp, info->var.yres,
+					msm_dma_todevice_wb_pre);
+		}
+		break;
+	default:
+		break;
+	}
+
+	msm_fb_cache_frame_done();
 }
 
 static inline void msm_dma_nc_post(void)
@@ -1996,6 +2442,8 @@ static inline void msm_dma_nc_post(void)
 static inline void msm_dma_fromdevice_wt_post(void *start, size_t size)
 {
 	dma_cache_post_ops(start, size, DMA_FROM_DEVICE);
+	msm_fb_cache_inv_bytes += size;
+	msm_fb_total_inv_bytes += size;
 }
 
 static inline void msm_dma_todevice_wb_post(void *start, size_t size)
@@ -2006,6 +2454,8 @@ static inline void msm_dma_todevice_wb_post(void *start, size_t size)
 static inline void msm_dma_fromdevice_wb_post(void *start, size_t size)
 {
 	dma_cache_post_ops(start, size, DMA_FROM_DEVICE);
+	msm_fb_cache_inv_bytes += size;
+	msm_fb_total_inv_bytes += size;
 }
 
 /*
@@ -2070,19 +2520,20 @@ static void msm_fb_ensure_memory_coherency_before_dma(struct fb_info *info,
 			if (!(req_list[i].flags &
 					MDP_NO_DMA_BARRIER_START)) {
 
-				msm_fb_dma_barrier_for_rect(info,
+				msm_fb_barrier_add_rect(info,
 						&(req_list[i].src),
 						&(req_list[i].src_rect),
 						msm_dma_todevice_wb_pre
 						);
 
-				msm_fb_dma_barrier_for_rect(info,
+				msm_fb_barrier_add_rect(info,
 						&(req_list[i].dst),
 						&(req_list[i].dst_rect),
 						msm_dma_todevice_wb_pre
 						);
 			}
 		}
+		msm_fb_barrier_flush_rects(info, msm_dma_todevice_wb_pre);
 		break;
 	}
 #else
@@ -2129,13 +2580,14 @@ static void msm_fb_ensure_memory_coherency_after_dma(struct fb_info *info,
 			if (!(req_list[i].flags &
 					MDP_NO_DMA_BARRIER_END)) {
 
-				msm_fb_dma_barrier_for_rect(info,
+				msm_fb_barrier_add_rect(info,
 						&(req_list[i].dst),
 						&(req_list[i].dst_rect),
 						msm_dma_fromdevice_wt_post
 						);
 			}
 		}
+		msm_fb_barrier_flush_rects(info, msm_dma_fromdevice_wt_post);
 		break;
 	case MDP_FB_PAGE_PROTECTION_WRITEBACKCACHE:
 	case MDP_FB_PAGE_PROTECTION_WRITEBACKWACACHE:
@@ -2143,13 +2595,14 @@ static void msm_fb_ensure_memory_coherency_after_dma(struct fb_info *info,
 			if (!(req_list[i].flags &
 					MDP_NO_DMA_BARRIER_END)) {
 
-				msm_fb_dma_barrier_for_rect(info,
+				msm_fb_barrier_add_rect(info,
 						&(req_list[i].dst),
 						&(req_list[i].dst_rect),
 						msm_dma_fromdevice_wb_post
 						);
 			}
 		}
+		msm_fb_barrier_flush_rects(info, msm_dma_fromdevice_wb_post);
 		break;
 	}
 #else
@@ -2157,6 +2610,53 @@ static void msm_fb_ensure_memory_coherency_after_dma(struct fb_info *info,
 #endif
 }
 
+/*
+ * Run one window of blit requests with the cache maintenance around it.
+ * Called with msm_fb_ioctl_ppp_sem held.
+ */
+static int msmfb_blit_window(struct fb_info *info,
+		struct mdp_blit_req *req_list, int req_list_count)
+{
+	int i;
+
+	/*
+	 * Ensure that any data CPU may have previously written to
+	 * internal state (but not yet committed to memory) is
+	 * guaranteed to be committed to memory now.
+	 */
+	msm_fb_ensure_memory_coherency_before_dma(info,
+			req_list, req_list_count);
+
+	/*
+	 * Do the blit DMA, if required -- returning early only if
+	 * there is a failure.
+	 */
+	for (i = 0; i < req_list_count; i++) {
+		if (!(req_list[i].flags & MDP_NO_BLIT)) {
+			/* Do the actual blit. */
+			int ret = mdp_blit(info, &(req_list[i]));
+
+			/*
+			 * Note that early returns don't guarantee
+			 * memory coherency.
+			 */
+			if (ret)
+				return ret;
+		}
+	}
+
+	/*
+	 * Ensure that CPU cache and other internal CPU state is
+	 * updated to reflect any change in memory modified by MDP blit
+	 * DMA.
+	 */
+	msm_fb_ensure_memory_coherency_after_dma(info,
+			req_list,
+			req_list_count);
+
+	return 0;
+}
+
 /*
  * NOTE: The userspace issues blit operations in a sequence, the sequence
  * start with a operation marked START and ends in an operation marked
@@ -2178,7 +2678,7 @@ static int msmfb_blit(struct fb_info *info, void __user *p)
 	struct mdp_blit_req req_list[MAX_LIST_WINDOW];
 	struct mdp_blit_req_list req_list_header;
 
-	int count, i, req_list_count;
+	int count, req_list_count, ret;
 
 	/* Get the count size for the total BLIT request. */
 	if (copy_from_user(&req_list_header, p, sizeof(req_list_header)))
@@ -2201,40 +2701,9 @@ static int msmfb_blit(struct fb_info *info, void __user *p)
 				sizeof(struct mdp_blit_req)*req_list_count))
 			return -EFAULT;
 
-		/*
-		 * Ensure that any data CPU may have previously written to
-		 * internal state (but not yet committed to memory) is
-		 * guaranteed to be committed to memory now.
-		 */
-		msm_fb_ensure_memory_coherency_before_dma(info,
-				req_list, req_list_count);
-
-		/*
-		 * Do the blit DMA, if required -- returning early only if
-		 * there is a failure.
-		 */
-		for (i = 0; i < req_list_count; i++) {
-			if (!(req_list[i].flags & MDP_NO_BLIT)) {
-				/* Do the actual blit. */
-				int ret = mdp_blit(info, &(req_list[i]));
-
-				/*
-				 * Note that early returns don't guarantee
-				 * memory coherency.
-				 */
-				if (ret)
-					return ret;
-			}
-		}
-
-		/*
-		 * Ensure that CPU cache and other internal CPU state is
-		 * updated to reflect any change in memory modified by MDP blit
-		 * DMA.
-		 */
-		msm_fb_ensure_memory_coherency_after_dma(info,
-				req_list,
-				req_list_count);
+		ret = msmfb_blit_window(info, req_list, req_list_count);
+		if (ret)
+			return ret;
 
 		/* Go to next window of requests. */
 		count -= req_list_count;
@@ -2349,10 +2818,310 @@ static int msmfb_overlay_play_enable(struct fb_info *info, unsigned long *argp)
 
 #endif
 
-DECLARE_MUTEX(msm_fb_ioctl_ppp_sem);
 DEFINE_MUTEX(msm_fb_ioctl_lut_sem);
 DEFINE_MUTEX(msm_fb_ioctl_hist_sem);
 
+/*
+ * Asynchronous blits.
+ *
+ * MSMFB_ASYNC_BLIT copies the request list, pins the source and
+ * destination buffers and hands the list to a worker that runs it on
+ * the PPP, so the compositor can prepare the next layer meanwhile.
+ * Every list gets a sequence number; MSMFB_BLIT_WAIT sleeps until a
+ * given number has retired. Lists retire in submission order, and a
+ * synchronous MSMFB_BLIT first waits for all queued lists so the two
+ * paths never reorder. While the fb is suspended new lists wait in
+ * MSMFB_ASYNC_BLIT until resume.
+ *
+ * memory_id is a file descriptor of the submitting process, which the
+ * worker can't resolve. The files are pinned at submit time and
+ * get_img() looks them up through msm_fb_blit_get_pinned() while the
+ * worker runs the list.
+ */
+struct msmfb_blit_pin {
+	int memory_id;
+	struct file *file;
+	unsigned long start;
+	unsigned long len;
+	int pmem;
+};
+
+struct msmfb_blit_job {
+	struct list_head list;
+	struct fb_info *info;
+	u32 seqno;
+	int count;
+	int nr_pins;
+	struct msmfb_blit_pin *pins;
+	struct mdp_blit_req req[0];
+};
+
+static struct workqueue_struct *msm_fb_blit_wq;
+static LIST_HEAD(msm_fb_blit_queue);
+static DEFINE_SPINLOCK(msm_fb_blit_lock);
+static DECLARE_WAIT_QUEUE_HEAD(msm_fb_blit_wait);
+static u32 msm_fb_blit_submitted;
+static u32 msm_fb_blit_retired;
+
+/* job being run by the worker, under msm_fb_ioctl_ppp_sem */
+static struct msmfb_blit_job *msm_fb_blit_active;
+
+static int msmfb_blit_pin_img(struct fb_info *info, struct mdp_img *img,
+			      struct msmfb_blit_job *job)
+{
+	struct msmfb_blit_pin *pin;
+	struct file *file;
+	int i;
+#ifdef CONFIG_ANDROID_PMEM
+	unsigned long vstart;
+#endif
+
+	for (i = 0; i < job->nr_pins; i++)
+		if (job->pins[i].memory_id == img->memory_id)
+			return 0;
+
+	pin = &job->pins[job->nr_pins];
+	pin->memory_id = img->memory_id;
+
+#ifdef CONFIG_ANDROID_PMEM
+	if (!get_pmem_file(img->memory_id, &pin->start, &vstart,
+			   &pin->len, &pin->file)) {
+		pin->pmem = 1;
+		job->nr_pins++;
+		return 0;
+	}
+#endif
+	file = fget(img->memory_id);
+	if (file == NULL)
+		return -EBADF;
+
+	if (MAJOR(file->f_dentry->d_inode->i_rdev) != FB_MAJOR) {
+		fput(file);
+		return -EINVAL;
+	}
+
+	pin->file = file;
+	pin->start = info->fix.smem_start;
+	pin->len = info->fix.smem_len;
+	pin->pmem = 0;
+	job->nr_pins++;
+	return 0;
+}
+
+static void msmfb_blit_unpin(struct msmfb_blit_job *job)
+{
+	int i;
+
+	for (i = 0; i < job->nr_pins; i++) {
+#ifdef CONFIG_ANDROID_PMEM
+		if (job->pins[i].pmem) {
+			put_pmem_file(job->pins[i].file);
+			continue;
+		}
+#endif
+		fput(job->pins[i].file);
+	}
+	job->nr_pins = 0;
+}
+
+int msm_fb_blit_get_pinned(int memory_id, unsigned long *start,
+			   unsigned long *len, struct file **pp_file)
+{
+	struct msmfb_blit_job *job = msm_fb_blit_active;
+	int i;
+
+	if (!job)
+		return -ENOENT;
+
+	for (i = 0; i < job->nr_pins; i++) {
+		if (job->pins[i].memory_id == memory_id) {
+			*start = job->pins[i].start;
+			*len = job->pins[i].len;
+			*pp_file = job->pins[i].file;
+			return 0;
+		}
+	}
+	return -EBADF;
+}
+
+int msm_fb_blit_pinned_active(void)
+{
+	return msm_fb_blit_active != NULL;
+}
+
+static int msmfb_blit_retired(u32 seqno)
+{
+	int retired;
+
+	spin_lock(&msm_fb_blit_lock);
+	retired = (s32)(msm_fb_blit_retired - seqno) >= 0;
+	spin_unlock(&msm_fb_blit_lock);
+
+	return retired;
+}
+
+static void msmfb_blit_drain(void)
+{
+	u32 seqno;
+
+	spin_lock(&msm_fb_blit_lock);
+	seqno = msm_fb_blit_submitted;
+	spin_unlock(&msm_fb_blit_lock);
+
+	wait_event(msm_fb_blit_wait, msmfb_blit_retired(seqno));
+}
+
+static void msmfb_blit_block(struct msm_fb_data_type *mfd, boolean block)
+{
+	spin_lock(&msm_fb_blit_lock);
+	mfd->blit_blocked = block;
+	spin_unlock(&msm_fb_blit_lock);
+
+	if (block)
+		msmfb_blit_drain();
+	else
+		wake_up_all(&msm_fb_blit_wait);
+}
+
+static void msmfb_blit_work_func(struct work_struct *work)
+{
+	struct msm_fb_data_type *mfd;
+	struct msmfb_blit_job *job;
+	int ret;
+
+	for (;;) {
+		spin_lock(&msm_fb_blit_lock);
+		if (list_empty(&msm_fb_blit_queue)) {
+			spin_unlock(&msm_fb_blit_lock);
+			break;
+		}
+		job = list_first_entry(&msm_fb_blit_queue,
+				       struct msmfb_blit_job, list);
+		list_del(&job->list);
+		spin_unlock(&msm_fb_blit_lock);
+
+		down(&msm_fb_ioctl_ppp_sem);
+		msm_fb_blit_active = job;
+		ret = msmfb_blit_window(job->info, job->req, job->count);
+		msm_fb_blit_active = NULL;
+		up(&msm_fb_ioctl_ppp_sem);
+
+		msmfb_blit_unpin(job);
+
+		mfd = (struct msm_fb_data_type *)job->info->par;
+		spin_lock(&msm_fb_blit_lock);
+		if (ret && !mfd->blit_error)
+			mfd->blit_error = ret;
+		msm_fb_blit_retired = job->seqno;
+		spin_unlock(&msm_fb_blit_lock);
+
+		wake_up_all(&msm_fb_blit_wait);
+		kfree(job);
+	}
+}
+
+static DECLARE_WORK(msm_fb_blit_work, msmfb_blit_work_func);
+
+static int msmfb_async_blit(struct fb_info *info, void __user *p)
+{
+	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+	struct mdp_async_blit_req_list __user *ureq = p;
+	struct msmfb_blit_job *job;
+	u32 count, seqno;
+	int i, ret;
+
+	if (!msm_fb_blit_wq)
+		return -ENODEV;
+
+	if (get_user(count, &ureq->count))
+		return -EFAULT;
+	/* Once queued the list runs, so fault on the seqno before that */
+	if (put_user(0, &ureq->seqno))
+		return -EFAULT;
+	if (count == 0 || count > MDP_ASYNC_BLIT_MAX)
+		return -EINVAL;
+
+	job = kzalloc(sizeof(*job) + count * sizeof(struct mdp_blit_req) +
+		      2 * count * sizeof(struct msmfb_blit_pin), GFP_KERNEL);
+	if (!job)
+		return -ENOMEM;
+
+	job->info = info;
+	job->count = count;
+	job->pins = (struct msmfb_blit_pin *)&job->req[count];
+
+	if (copy_from_user(job->req, ureq->req,
+			   count * sizeof(struct mdp_blit_req))) {
+		ret = -EFAULT;
+		goto err;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (job->req[i].flags & MDP_NO_BLIT)
+			continue;
+		ret = msmfb_blit_pin_img(info, &job->req[i].src, job);
+		if (ret)
+			goto err;
+		ret = msmfb_blit_pin_img(info, &job->req[i].dst, job);
+		if (ret)
+			goto err;
+	}
+
+	spin_lock(&msm_fb_blit_lock);
+	while (mfd->blit_blocked) {
+		spin_unlock(&msm_fb_blit_lock);
+		ret = wait_event_interruptible(msm_fb_blit_wait,
+					       !mfd->blit_blocked);
+		if (ret)
+			goto err;
+		spin_lock(&msm_fb_blit_lock);
+	}
+	seqno = ++msm_fb_blit_submitted;
+	job->seqno = seqno;
+	list_add_tail(&job->list, &msm_fb_blit_queue);
+	spin_unlock(&msm_fb_blit_lock);
+
+	queue_work(msm_fb_blit_wq, &msm_fb_blit_work);
+
+	/* The list is queued, so report success even if this faults now */
+	put_user(seqno, &ureq->seqno);
+	return 0;
+
+err:
+	msmfb_blit_unpin(job);
+	kfree(job);
+	return ret;
+}
+
+static int msmfb_blit_wait(struct fb_info *info, void __user *p)
+{
+	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+	u32 seqno;
+	int ret;
+
+	if (get_user(seqno, (u32 __user *)p))
+		return -EFAULT;
+
+	/* Tokens that were never handed out would never retire */
+	spin_lock(&msm_fb_blit_lock);
+	if ((s32)(msm_fb_blit_submitted - seqno) < 0)
+		seqno = msm_fb_blit_submitted;
+	spin_unlock(&msm_fb_blit_lock);
+
+	ret = wait_event_interruptible(msm_fb_blit_wait,
+				       msmfb_blit_retired(seqno));
+	if (ret)
+		return ret;
+
+	/* Report, and clear, this fb's first failure since the last wait */
+	spin_lock(&msm_fb_blit_lock);
+	ret = mfd->blit_error;
+	mfd->blit_error = 0;
+	spin_unlock(&msm_fb_blit_lock);
+
+	return ret;
+}
+
 /* Set color conversion matrix from user space */
 
 #ifndef CONFIG_FB_MSM_MDP40
@@ -2442,12 +3211,21 @@ static int msm_fb_ioctl(struct fb_info *info, unsigned int cmd,
 		break;
 #endif
 	case MSMFB_BLIT:
+		msmfb_blit_drain();
 		down(&msm_fb_ioctl_ppp_sem);
 		ret = msmfb_blit(info, argp);
 		up(&msm_fb_ioctl_ppp_sem);
 
 		break;
 
+	case MSMFB_ASYNC_BLIT:
+		ret = msmfb_async_blit(info, argp);
+		break;
+
+	case MSMFB_BLIT_WAIT:
+		ret = msmfb_blit_wait(info, argp);
+		break;
+
 	/* Ioctl for setting ccs matrix from user space */
 	case MSMFB_SET_CCS_MATRIX:
 #ifndef CONFIG_FB_MSM_MDP40
@@ -2709,6 +3487,11 @@ int __init msm_fb_init(void)
 	if (msm_fb_register_driver())
 		return rc;
 
+	msm_fb_blit_wq = create_singlethread_workqueue("msm_fb_blit");
+	if (!msm_fb_blit_wq)
+		printk(KERN_ERR "msm_fb: no blit workqueue, "
+			"MSMFB_ASYNC_BLIT disabled\n");
+
 #ifdef MSM_FB_ENABLE_DBGFS
 	{
 		struct dentry *root;
@@ -2722,6 +3505,18 @@ int __init msm_fb_init(void)
 						   (u32 *) &mddi_msg_level);
 			msm_fb_debugfs_file_create(root, "msm_fb_debug_enabled",
 						   (u32 *) &msm_fb_debug_enabled);
+			msm_fb_debugfs_file_create(root,
+						   "frame_cache_clean_bytes",
+						   &msm_fb_frame_clean_bytes);
+			msm_fb_debugfs_file_create(root,
+						   "frame_cache_inv_bytes",
+						   &msm_fb_frame_inv_bytes);
+			msm_fb_debugfs_file_create(root,
+						   "total_cache_clean_bytes",
+						   &msm_fb_total_clean_bytes);
+			msm_fb_debugfs_file_create(root,
+						   "total_cache_inv_bytes",
+						   &msm_fb_total_inv_bytes);
 		}
 	}
 #endif
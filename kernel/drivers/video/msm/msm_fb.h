@@ -96,6 +96,11 @@ struct msm_fb_data_type {
 
 	boolean pan_waiting;
 	struct completion pan_comp;
+	u32 partial_frame_count;
+
+	/* async blits, under msm_fb_blit_lock */
+	int blit_error;
+	boolean blit_blocked;
 
 	/* vsync */
 	boolean use_mdp_vsync;
@@ -169,6 +174,12 @@ void msm_fb_add_device(struct platform_device *pdev);
 
 int msm_fb_detect_client(const char *name);
 
+int msm_fb_blit_get_pinned(int memory_id, unsigned long *start,
+			   unsigned long *len, struct file **pp_file);
+int msm_fb_blit_pinned_active(void);
+int msm_fb_blit_get_scratch(int memory_id, unsigned long *start,
+			    unsigned long *len);
+
 #ifdef CONFIG_FB_BACKLIGHT
 void msm_fb_config_backlight(struct msm_fb_data_type *mfd);
 #endif
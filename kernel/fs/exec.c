@@ -52,6 +52,7 @@
 #include <linux/tracehook.h>
 #include <linux/kmod.h>
 #include <linux/fsnotify.h>
+#include <linux/cpufreq_times.h>
 
 #include <asm/uaccess.h>
 #include <asm/mmu_context.h>
@@ -989,6 +990,7 @@ int flush_old_exec(struct linux_binprm * bprm)
 	}
 	tcomm[i] = '\0';
 	set_task_comm(current, tcomm);
+	cpufreq_task_times_init(current);
 
 	current->flags &= ~PF_RANDOMIZE;
 	flush_thread();
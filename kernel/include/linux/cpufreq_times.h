@@ -0,0 +1,44 @@
+/* include/linux/cpufreq_times.h
+ *
+ * Per-task accounting of time spent at each CPU frequency.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _LINUX_CPUFREQ_TIMES_H
+#define _LINUX_CPUFREQ_TIMES_H
+
+#include <linux/types.h>
+#include <asm/cputime.h>
+
+struct task_struct;
+struct seq_file;
+
+#ifdef CONFIG_CPU_FREQ_TASK_TIMES
+void cpufreq_task_times_account(struct task_struct *p, cputime_t cputime);
+void cpufreq_task_times_init(struct task_struct *p);
+void cpufreq_task_times_exit(struct task_struct *p);
+void cpufreq_task_times_free(struct task_struct *p);
+int cpufreq_task_times_show(struct seq_file *m, struct task_struct *p,
+			    int whole);
+
+unsigned int cpufreq_task_times_num_states(void);
+unsigned int cpufreq_task_times_freq(unsigned int index);
+void cpufreq_task_times_add_uid(uid_t uid, cputime64_t *times);
+#else
+static inline void cpufreq_task_times_account(struct task_struct *p,
+					      cputime_t cputime) {}
+static inline void cpufreq_task_times_init(struct task_struct *p) {}
+static inline void cpufreq_task_times_exit(struct task_struct *p) {}
+static inline void cpufreq_task_times_free(struct task_struct *p) {}
+#endif
+
+#endif /* _LINUX_CPUFREQ_TIMES_H */
@@ -65,6 +65,9 @@
 					unsigned short)
 #define AUDIO_GET_BITSTREAM_ERROR_INFO _IOR(AUDIO_IOCTL_MAGIC, 42, \
 			       struct msm_audio_bitstream_error_info)
+#define AUDIO_MMAP_SUBMIT    _IOW(AUDIO_IOCTL_MAGIC, 43, unsigned)
+#define AUDIO_GET_LATENCY_STATS _IOR(AUDIO_IOCTL_MAGIC, 44, \
+				struct msm_audio_latency_stats)
 /* Qualcomm extensions */
 #define AUDIO_SET_STREAM_CONFIG   _IOW(AUDIO_IOCTL_MAGIC, 80, \
 				struct msm_audio_stream_config)
@@ -163,6 +166,30 @@ struct msm_audio_stats {
 	uint32_t unused[2];
 };
 
+/* Low-latency PCM output.  mmap() of the pcm_out device maps this
+ * control page followed by the two DSP period buffers, each starting
+ * on a page boundary at buf_offset[].  Userspace fills buffer
+ * (appl_ptr & 1) and hands it over with AUDIO_MMAP_SUBMIT (byte
+ * count); the DSP advances hw_ptr as each period is played.
+ */
+struct msm_audio_mmap_ctl {
+	uint32_t period_size;
+	uint32_t buf_offset[2];
+	uint32_t appl_ptr;
+	uint32_t hw_ptr;
+	uint32_t unused[3];
+};
+
+/* Submit-to-done time of output periods, in microseconds */
+struct msm_audio_latency_stats {
+	uint32_t periods;
+	uint32_t last_us;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint32_t avg_us;
+	uint32_t unused[3];
+};
+
 struct msm_audio_pmem_info {
 	int fd;
 	void *vaddr;
@@ -71,13 +71,19 @@ struct kgsl_devinfo {
 
 /* this structure defines the region of memory that can be mmap()ed from this
    driver. The timestamp fields are volatile because they are written by the
-   GPU
+   GPU. ts_cmp_enable and ref_wait_ts are written by the driver: while
+   ts_cmp_enable is set the CP raises an interrupt once a timestamp at or
+   beyond ref_wait_ts has been issued.
 */
 struct kgsl_devmemstore {
 	volatile unsigned int soptimestamp;
 	unsigned int sbz;
 	volatile unsigned int eoptimestamp;
 	unsigned int sbz2;
+	volatile unsigned int ts_cmp_enable;
+	unsigned int sbz3;
+	volatile unsigned int ref_wait_ts;
+	unsigned int sbz4;
 };
 
 #define KGSL_DEVICE_MEMSTORE_OFFSET(field) \
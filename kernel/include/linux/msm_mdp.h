@@ -41,6 +41,17 @@
 #define MSMFB_OVERLAY_GET      _IOR(MSMFB_IOCTL_MAGIC, 140, \
 						struct mdp_overlay)
 #define MSMFB_OVERLAY_PLAY_ENABLE     _IOW(MSMFB_IOCTL_MAGIC, 141, unsigned int)
+#define MSMFB_ASYNC_BLIT        _IOWR(MSMFB_IOCTL_MAGIC, 142, \
+						struct mdp_async_blit_req_list)
+#define MSMFB_BLIT_WAIT         _IOW(MSMFB_IOCTL_MAGIC, 143, unsigned int)
+
+/*
+ * Partial update: FBIOPAN_DISPLAY with var.reserved[0] set to
+ * MSMFB_PAN_DIRTY_MAGIC sends only the region
+ * [reserved[1] & 0xffff, reserved[2] & 0xffff) x
+ * [reserved[1] >> 16, reserved[2] >> 16) of the panned-to frame.
+ */
+#define MSMFB_PAN_DIRTY_MAGIC 0x54445055	/* "UPDT" */
 
 #define MDP_IMGTYPE2_START 0x10000
 
@@ -148,6 +159,19 @@ struct mdp_blit_req_list {
 	struct mdp_blit_req req[];
 };
 
+/*
+ * MSMFB_ASYNC_BLIT queues the list to the PPP and returns at once;
+ * seqno is filled in with a token that can be passed to MSMFB_BLIT_WAIT.
+ * Tokens retire in submission order.
+ */
+#define MDP_ASYNC_BLIT_MAX 64
+
+struct mdp_async_blit_req_list {
+	uint32_t count;
+	uint32_t seqno;
+	struct mdp_blit_req req[];
+};
+
 struct msmfb_data {
 	uint32_t offset;
 	int memory_id;
@@ -39,6 +39,14 @@
 /* SCHED_ISO: reserved but not implemented yet */
 #define SCHED_IDLE		5
 
+/*
+ * CFS latency classes, see sched_set_latency_class().
+ */
+#define SCHED_LATENCY_NORMAL		0
+#define SCHED_LATENCY_INTERACTIVE	1
+#define SCHED_LATENCY_BATCH		2
+#define SCHED_LATENCY_NR		3
+
 #ifdef __KERNEL__
 
 struct sched_param {
@@ -1052,6 +1060,11 @@ struct sched_entity {
 	u64			last_wakeup;
 	u64			avg_overlap;
 
+	unsigned int		latency_class;
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	u64			wakeup_stamp;
+#endif
+
 #ifdef CONFIG_SCHEDSTATS
 	u64			wait_start;
 	u64			wait_max;
@@ -1346,6 +1359,9 @@ struct task_struct {
 	unsigned long ptrace_message;
 	siginfo_t *last_siginfo; /* For ptrace use.  */
 	struct task_io_accounting ioac;
+#ifdef CONFIG_CPU_FREQ_TASK_TIMES
+	cputime_t *cpufreq_times;	/* time at each cpufreq state */
+#endif
 #if defined(CONFIG_TASK_XACCT)
 	u64 acct_rss_mem1;	/* accumulated rss usage */
 	u64 acct_vm_mem1;	/* accumulated virtual memory usage */
@@ -1738,6 +1754,8 @@ extern unsigned int sysctl_sched_min_granularity;
 extern unsigned int sysctl_sched_wakeup_granularity;
 extern unsigned int sysctl_sched_shares_ratelimit;
 extern unsigned int sysctl_sched_shares_thresh;
+extern unsigned int sysctl_sched_interactive_gran_shift;
+extern unsigned int sysctl_sched_batch_slice_shift;
 #ifdef CONFIG_SCHED_DEBUG
 extern unsigned int sysctl_sched_child_runs_first;
 extern unsigned int sysctl_sched_features;
@@ -1778,6 +1796,7 @@ extern int idle_cpu(int cpu);
 extern int sched_setscheduler(struct task_struct *, int, struct sched_param *);
 extern int sched_setscheduler_nocheck(struct task_struct *, int,
 				      struct sched_param *);
+extern int sched_set_latency_class(struct task_struct *p, unsigned int class);
 extern struct task_struct *idle_task(int cpu);
 extern struct task_struct *curr_task(int cpu);
 extern void set_curr_task(int cpu, struct task_struct *p);
@@ -191,4 +191,8 @@ unsigned long __round_jiffies_up_relative(unsigned long j, int cpu);
 unsigned long round_jiffies_up(unsigned long j);
 unsigned long round_jiffies_up_relative(unsigned long j);
 
+unsigned long round_jiffies_slack(unsigned long j, unsigned long slack);
+unsigned long round_jiffies_slack_relative(unsigned long j,
+					   unsigned long slack);
+
 #endif
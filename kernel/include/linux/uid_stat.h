@@ -16,9 +16,15 @@
 #ifndef __uid_stat_h
 #define __uid_stat_h
 
+#include <asm/cputime.h>
+
 /* Contains definitions for resource tracking per uid. */
 
 extern int update_tcp_snd(uid_t uid, int size);
 extern int update_tcp_rcv(uid_t uid, int size);
+#ifdef CONFIG_CPU_FREQ_TASK_TIMES
+extern int update_time_in_state(uid_t uid, const cputime_t *times,
+				unsigned int num_states);
+#endif
 
 #endif /* _LINUX_UID_STAT_H */
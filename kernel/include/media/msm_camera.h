@@ -361,6 +361,34 @@ struct msm_frame {
 	int croplen;
 };
 
+/*
+ * Preview frame ring.  The frame node can be mmap()ed (one page, offset 0)
+ * to receive preview frames without a MSM_CAM_IOCTL_GETFRAME per frame.
+ * The driver fills desc[head % entries] and then advances head; the client
+ * consumes desc[tail % entries] and then advances tail.  Both are free
+ * running counters.  When the ring is full frames fall back to GETFRAME
+ * and overruns is incremented.  Crop information is not carried in the
+ * ring, and buffers still go back with MSM_CAM_IOCTL_RELEASE_FRAME_BUFFER.
+ */
+#define MSM_FRAME_RING_ENTRIES 16
+
+struct msm_frame_desc {
+	struct timespec ts;
+	int path;
+	unsigned long buffer;
+	uint32_t y_off;
+	uint32_t cbcr_off;
+	int fd;
+};
+
+struct msm_frame_ring {
+	uint32_t head;		/* written by the driver */
+	uint32_t tail;		/* written by the client */
+	uint32_t entries;
+	uint32_t overruns;
+	struct msm_frame_desc desc[MSM_FRAME_RING_ENTRIES];
+};
+
 struct msm_stats_buf {
 	int type;
 	unsigned long buffer;
@@ -80,6 +80,12 @@
 #define MSM_GMN_IOCTL_TEST_DUMP_REGION \
 	_IOW(MSM_GMN_IOCTL_MAGIC, 15, unsigned long)
 
+#define MSM_GMN_IOCTL_SET_PIPELINE \
+	_IOW(MSM_GMN_IOCTL_MAGIC, 16, int)
+
+#define MSM_GMN_IOCTL_GET_STATS \
+	_IOR(MSM_GMN_IOCTL_MAGIC, 17, struct msm_gemini_stats *)
+
 #define MSM_GEMINI_MODE_REALTIME_ENCODE 0
 #define MSM_GEMINI_MODE_OFFLINE_ENCODE 1
 #define MSM_GEMINI_MODE_REALTIME_ROTATION 2
@@ -139,4 +145,16 @@ struct msm_gemini_hw_cmds {
 	struct msm_gemini_hw_cmd hw_cmd[1];
 };
 
+/* Encode latency, from starting the fetch engine on a frame to its
+ * frame done interrupt.  Reset on open.
+ */
+struct msm_gemini_stats {
+	uint32_t frames;
+	uint32_t irq_starts; /* frames started from the frame done irq */
+	uint32_t last_us;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint32_t avg_us;
+};
+
 #endif /* __LINUX_MSM_GEMINI_H */
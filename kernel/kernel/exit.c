@@ -47,6 +47,7 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/tracehook.h>
 #include <linux/init_task.h>
+#include <linux/cpufreq_times.h>
 #include <trace/sched.h>
 
 #include <asm/uaccess.h>
@@ -1054,6 +1055,7 @@ NORET_TYPE void do_exit(long code)
 				preempt_count());
 
 	acct_update_integrals(tsk);
+	cpufreq_task_times_exit(tsk);
 
 	group_dead = atomic_dec_and_test(&tsk->signal->live);
 	if (group_dead) {
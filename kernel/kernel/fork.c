@@ -60,6 +60,7 @@
 #include <linux/tty.h>
 #include <linux/proc_fs.h>
 #include <linux/blkdev.h>
+#include <linux/cpufreq_times.h>
 #include <trace/sched.h>
 
 #include <asm/pgtable.h>
@@ -144,6 +145,7 @@ void free_task(struct task_struct *tsk)
 	free_thread_info(tsk->stack);
 	rt_mutex_debug_task_free(tsk);
 	ftrace_graph_exit_task(tsk);
+	cpufreq_task_times_free(tsk);
 	free_task_struct(tsk);
 }
 EXPORT_SYMBOL(free_task);
@@ -265,6 +267,9 @@ static struct task_struct *dup_task_struct(struct task_struct *orig)
 	tsk->btrace_seq = 0;
 #endif
 	tsk->splice_pipe = NULL;
+#ifdef CONFIG_CPU_FREQ_TASK_TIMES
+	tsk->cpufreq_times = NULL;
+#endif
 	return tsk;
 
 out:
@@ -1054,6 +1059,7 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 	p->stimescaled = cputime_zero;
 	p->prev_utime = cputime_zero;
 	p->prev_stime = cputime_zero;
+	cpufreq_task_times_init(p);
 
 	p->default_timer_slack_ns = current->timer_slack_ns;
 
@@ -72,6 +72,7 @@
 #include <linux/debugfs.h>
 #include <linux/ctype.h>
 #include <linux/ftrace.h>
+#include <linux/cpufreq_times.h>
 #include <trace/sched.h>
 
 #include <asm/tlb.h>
@@ -399,6 +400,13 @@ static inline struct task_group *task_group(struct task_struct *p)
 
 #endif	/* CONFIG_GROUP_SCHED */
 
+/*
+ * Wakeup-to-run latency histogram buckets: <100us, <200us, ... <6.4ms and
+ * everything above.
+ */
+#define SCHED_WAKEUP_LAT_BUCKETS	8
+#define SCHED_WAKEUP_LAT_BASE_US	100
+
 /* CFS-related fields in a runqueue */
 struct cfs_rq {
 	struct load_weight load;
@@ -635,6 +643,11 @@ struct rq {
 	/* BKL stats */
 	unsigned int bkl_count;
 #endif
+
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	/* CFS wakeup-to-run latency, per latency class */
+	unsigned long wakeup_lat[SCHED_LATENCY_NR][SCHED_WAKEUP_LAT_BUCKETS];
+#endif
 };
 
 static DEFINE_PER_CPU_SHARED_ALIGNED(struct rq, runqueues);
@@ -4224,6 +4237,7 @@ void account_user_time(struct task_struct *p, cputime_t cputime,
 	p->utime = cputime_add(p->utime, cputime);
 	p->utimescaled = cputime_add(p->utimescaled, cputime_scaled);
 	account_group_user_time(p, cputime);
+	cpufreq_task_times_account(p, cputime);
 
 	/* Add user time to cpustat. */
 	tmp = cputime_to_cputime64(cputime);
@@ -4282,6 +4296,7 @@ void account_system_time(struct task_struct *p, int hardirq_offset,
 	p->stime = cputime_add(p->stime, cputime);
 	p->stimescaled = cputime_add(p->stimescaled, cputime_scaled);
 	account_group_system_time(p, cputime);
+	cpufreq_task_times_account(p, cputime);
 
 	/* Add system time to cpustat. */
 	tmp = cputime_to_cputime64(cputime);
@@ -5476,6 +5491,35 @@ int sched_setscheduler_nocheck(struct task_struct *p, int policy,
 	return __sched_setscheduler(p, policy, param, false);
 }
 
+/**
+ * sched_set_latency_class - change the CFS latency class of a task.
+ * @p: the task in question.
+ * @class: SCHED_LATENCY_NORMAL, _INTERACTIVE or _BATCH.
+ *
+ * Interactive tasks preempt the running task with a finer wakeup
+ * granularity, batch tasks get a longer slice before they are preempted
+ * by the tick. Moving a task into the interactive class needs
+ * CAP_SYS_NICE, just like raising its priority.
+ */
+int sched_set_latency_class(struct task_struct *p, unsigned int class)
+{
+	unsigned long flags;
+	struct rq *rq;
+
+	if (class >= SCHED_LATENCY_NR)
+		return -EINVAL;
+
+	if (class == SCHED_LATENCY_INTERACTIVE &&
+	    p->se.latency_class != class && !capable(CAP_SYS_NICE))
+		return -EPERM;
+
+	rq = task_rq_lock(p, &flags);
+	p->se.latency_class = class;
+	task_rq_unlock(rq, &flags);
+
+	return 0;
+}
+
 static int
 do_sched_setscheduler(pid_t pid, int policy, struct sched_param __user *param)
 {
@@ -71,6 +71,15 @@ unsigned int __read_mostly sysctl_sched_compat_yield;
  */
 unsigned int sysctl_sched_wakeup_granularity = 5000000UL;
 
+/*
+ * Wakeup granularity is shifted right by this for tasks in the
+ * interactive latency class, and the slice batch class tasks run
+ * before the tick preempts them is shifted left by
+ * sysctl_sched_batch_slice_shift.
+ */
+unsigned int sysctl_sched_interactive_gran_shift = 2;
+unsigned int sysctl_sched_batch_slice_shift = 1;
+
 const_debug unsigned int sysctl_sched_migration_cost = 500000UL;
 
 static const struct sched_class fair_sched_class;
@@ -455,6 +464,21 @@ static u64 sched_vslice(struct cfs_rq *cfs_rq, struct sched_entity *se)
 	return calc_delta_fair(sched_slice(cfs_rq, se), se);
 }
 
+/*
+ * The slice the running entity gets before the tick preempts it. Batch
+ * tasks run longer, but only here: place_entity() uses the plain slice,
+ * so a forked batch task is not placed further right than others.
+ */
+static u64 sched_run_slice(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	u64 slice = sched_slice(cfs_rq, se);
+
+	if (unlikely(se->latency_class == SCHED_LATENCY_BATCH))
+		slice <<= sysctl_sched_batch_slice_shift;
+
+	return slice;
+}
+
 /*
  * Update the current task's runtime statistics. Skip current tasks that
  * are not in our scheduling class.
@@ -772,7 +796,7 @@ check_preempt_tick(struct cfs_rq *cfs_rq, struct sched_entity *curr)
 {
 	unsigned long ideal_runtime, delta_exec;
 
-	ideal_runtime = sched_slice(cfs_rq, curr);
+	ideal_runtime = sched_run_slice(cfs_rq, curr);
 	delta_exec = curr->sum_exec_runtime - curr->prev_sum_exec_runtime;
 	if (delta_exec > ideal_runtime) {
 		resched_task(rq_of(cfs_rq)->curr);
@@ -890,7 +914,7 @@ static void hrtick_start_fair(struct rq *rq, struct task_struct *p)
 	WARN_ON(task_rq(p) != rq);
 
 	if (hrtick_enabled(rq) && cfs_rq->nr_running > 1) {
-		u64 slice = sched_slice(cfs_rq, se);
+		u64 slice = sched_run_slice(cfs_rq, se);
 		u64 ran = se->sum_exec_runtime - se->prev_sum_exec_runtime;
 		s64 delta = slice - ran;
 
@@ -947,6 +971,11 @@ static void enqueue_task_fair(struct rq *rq, struct task_struct *p, int wakeup)
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &p->se;
 
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	if (wakeup && !se->wakeup_stamp)
+		se->wakeup_stamp = rq->clock;
+#endif
+
 	for_each_sched_entity(se) {
 		if (se->on_rq)
 			break;
@@ -968,6 +997,11 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int sleep)
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &p->se;
 
+#ifdef CONFIG_SCHED_LATENCY_HIST
+	if (sleep)
+		se->wakeup_stamp = 0;
+#endif
+
 	for_each_sched_entity(se) {
 		cfs_rq = cfs_rq_of(se);
 		dequeue_entity(cfs_rq, se, sleep);
@@ -1351,6 +1385,8 @@ wakeup_preempt_entity(struct sched_entity *curr, struct sched_entity *se)
 		return -1;
 
 	gran = wakeup_gran(curr);
+	if (unlikely(se->latency_class == SCHED_LATENCY_INTERACTIVE))
+		gran >>= sysctl_sched_interactive_gran_shift;
 	if (vdiff > gran)
 		return 1;
 
@@ -1453,6 +1489,33 @@ static void check_preempt_wakeup(struct rq *rq, struct task_struct *p, int sync)
 	}
 }
 
+#ifdef CONFIG_SCHED_LATENCY_HIST
+/*
+ * Account the time from wakeup until the task first gets the cpu, for
+ * the histograms in /proc/sched_wakeup_latency.
+ */
+static void update_wakeup_latency(struct rq *rq, struct sched_entity *se)
+{
+	unsigned long us;
+	int bucket;
+
+	if (!se->wakeup_stamp)
+		return;
+
+	us = (unsigned long)(rq->clock - se->wakeup_stamp) / NSEC_PER_USEC;
+	se->wakeup_stamp = 0;
+
+	bucket = fls(us / SCHED_WAKEUP_LAT_BASE_US);
+	if (bucket >= SCHED_WAKEUP_LAT_BUCKETS)
+		bucket = SCHED_WAKEUP_LAT_BUCKETS - 1;
+
+	rq->wakeup_lat[se->latency_class][bucket]++;
+}
+#else
+static inline void update_wakeup_latency(struct rq *rq,
+					 struct sched_entity *se) { }
+#endif
+
 static struct task_struct *pick_next_task_fair(struct rq *rq)
 {
 	struct task_struct *p;
@@ -1475,6 +1538,7 @@ static struct task_struct *pick_next_task_fair(struct rq *rq)
 
 	p = task_of(se);
 	hrtick_start_fair(rq, p);
+	update_wakeup_latency(rq, se);
 
 	return p;
 }
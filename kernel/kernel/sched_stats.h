@@ -1,4 +1,53 @@
 
+#ifdef CONFIG_SCHED_LATENCY_HIST
+static int show_wakeup_latency(struct seq_file *seq, void *v)
+{
+	static const char *names[SCHED_LATENCY_NR] = {
+		"normal", "interactive", "batch"
+	};
+	int cpu, class, b;
+
+	seq_printf(seq, "%-12s", "us");
+	for (b = 0; b < SCHED_WAKEUP_LAT_BUCKETS - 1; b++)
+		seq_printf(seq, " <%-7d", SCHED_WAKEUP_LAT_BASE_US << b);
+	seq_printf(seq, " >=%d\n", SCHED_WAKEUP_LAT_BASE_US << (b - 1));
+
+	for_each_online_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+
+		seq_printf(seq, "cpu%d\n", cpu);
+		for (class = 0; class < SCHED_LATENCY_NR; class++) {
+			seq_printf(seq, "%-12s", names[class]);
+			for (b = 0; b < SCHED_WAKEUP_LAT_BUCKETS; b++)
+				seq_printf(seq, " %-8lu",
+					   rq->wakeup_lat[class][b]);
+			seq_printf(seq, "\n");
+		}
+	}
+	return 0;
+}
+
+static int wakeup_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, show_wakeup_latency, NULL);
+}
+
+static const struct file_operations proc_wakeup_latency_operations = {
+	.open    = wakeup_latency_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+static int __init proc_wakeup_latency_init(void)
+{
+	proc_create("sched_wakeup_latency", 0444, NULL,
+		    &proc_wakeup_latency_operations);
+	return 0;
+}
+module_init(proc_wakeup_latency_init);
+#endif /* CONFIG_SCHED_LATENCY_HIST */
+
 #ifdef CONFIG_SCHEDSTATS
 /*
  * bump this up when changing the output format or the meaning of an existing
@@ -31,6 +31,9 @@
  * Display the information collected so far:
  * # cat /proc/timer_stats
  *
+ * Display only the expiries that woke the CPU out of idle:
+ * # cat /proc/timer_wakeups
+ *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License version 2 as
  * published by the Free Software Foundation.
@@ -70,6 +73,12 @@ struct entry {
 	unsigned long		count;
 	unsigned int		timer_flag;
 
+	/*
+	 * Number of those events that fired while the CPU was idle,
+	 * i.e. that broke up an idle period:
+	 */
+	unsigned long		idle_count;
+
 	/*
 	 * We save the command-line string to preserve
 	 * this information past task exit:
@@ -204,6 +213,7 @@ static struct entry *tstat_lookup(struct entry *entry, char *comm)
 	if (curr) {
 		*curr = *entry;
 		curr->count = 0;
+		curr->idle_count = 0;
 		curr->next = NULL;
 		memcpy(curr->comm, comm, TASK_COMM_LEN);
 
@@ -258,9 +268,11 @@ void timer_stats_update_stats(void *timer, pid_t pid, void *startf,
 		goto out_unlock;
 
 	entry = tstat_lookup(&input, comm);
-	if (likely(entry))
+	if (likely(entry)) {
 		entry->count++;
-	else
+		if (idle_cpu(raw_smp_processor_id()))
+			entry->idle_count++;
+	} else
 		atomic_inc(&overflow_count);
 
  out_unlock:
@@ -338,6 +350,74 @@ static int tstats_show(struct seq_file *m, void *v)
 	return 0;
 }
 
+/*
+ * Same sample as /proc/timer_stats, but only counting the expiries
+ * that interrupted the idle task. Deferrable timers normally never
+ * show up here; anything that does is keeping the CPU out of power
+ * collapse.
+ */
+static int twakeups_show(struct seq_file *m, void *v)
+{
+	struct timespec period;
+	struct entry *entry;
+	unsigned long ms;
+	long wakeups = 0, events = 0;
+	ktime_t time;
+	int i;
+
+	mutex_lock(&show_mutex);
+	if (active)
+		time_stop = ktime_get();
+
+	time = ktime_sub(time_stop, time_start);
+
+	period = ktime_to_timespec(time);
+	ms = period.tv_nsec / 1000000;
+
+	seq_puts(m, "Timer Wakeups Version: v0.1\n");
+	seq_printf(m, "Sample period: %ld.%03ld s\n", period.tv_sec, ms);
+	if (atomic_read(&overflow_count))
+		seq_printf(m, "Overflow: %d entries\n",
+			atomic_read(&overflow_count));
+
+	for (i = 0; i < nr_entries; i++) {
+		entry = entries + i;
+		events += entry->count;
+		if (!entry->idle_count)
+			continue;
+
+		seq_printf(m, "%4lu/%-4lu%c %5d %-16s ",
+			entry->idle_count, entry->count,
+			entry->timer_flag & TIMER_STATS_FLAG_DEFERRABLE ?
+				'D' : ' ',
+			entry->pid, entry->comm);
+
+		print_name_offset(m, (unsigned long)entry->start_func);
+		seq_puts(m, " (");
+		print_name_offset(m, (unsigned long)entry->expire_func);
+		seq_puts(m, ")\n");
+
+		wakeups += entry->idle_count;
+	}
+
+	ms += period.tv_sec * 1000;
+	if (!ms)
+		ms = 1;
+
+	if (wakeups && period.tv_sec)
+		seq_printf(m, "%ld idle wakeups of %ld events, "
+			   "%ld.%03ld wakeups/sec\n",
+			   wakeups, events, wakeups * 1000 / ms,
+			   (wakeups * 1000000 / ms) % 1000);
+	else
+		seq_printf(m, "%ld idle wakeups of %ld events\n",
+			   wakeups, events);
+
+	mutex_unlock(&show_mutex);
+
+	return 0;
+}
+
 /*
  * After a state change, make sure all concurrent lookup/update
  * activities have stopped:
@@ -403,6 +483,23 @@ static struct file_operations tstats_fops = {
 	.release	= single_release,
 };
 
+static int twakeups_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, twakeups_show, NULL);
+}
+
+/*
+ * Collection is started and stopped through either file; they share
+ * one sample.
+ */
+static struct file_operations twakeups_fops = {
+	.open		= twakeups_open,
+	.read		= seq_read,
+	.write		= tstats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 void __init init_timer_stats(void)
 {
 	int cpu;
@@ -418,6 +515,11 @@ static int __init init_tstats_procfs(void)
 	pe = proc_create("timer_stats", 0644, NULL, &tstats_fops);
 	if (!pe)
 		return -ENOMEM;
+	pe = proc_create("timer_wakeups", 0644, NULL, &twakeups_fops);
+	if (!pe) {
+		remove_proc_entry("timer_stats", NULL);
+		return -ENOMEM;
+	}
 	return 0;
 }
 __initcall(init_tstats_procfs);
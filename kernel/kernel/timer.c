@@ -312,6 +312,56 @@ unsigned long round_jiffies_up_relative(unsigned long j)
 }
 EXPORT_SYMBOL_GPL(round_jiffies_up_relative);
 
+/**
+ * round_jiffies_slack - coalesce a timeout onto a common slack boundary
+ * @j: the time in (absolute) jiffies that should be rounded
+ * @slack: how many jiffies late the caller can tolerate
+ *
+ * round_jiffies_slack() picks the value in [@j, @j + @slack] that is
+ * aligned to the largest power of two. Timers that are rounded this
+ * way tend to land on the same jiffies even when they have different
+ * periods and slack, so the CPU wakes up once for all of them instead
+ * of once for each. Combined with deferrable timers this lets NO_HZ
+ * idle sleep for longer.
+ *
+ * Like round_jiffies_up() this never rounds down. A @slack of zero
+ * returns @j unchanged.
+ */
+unsigned long round_jiffies_slack(unsigned long j, unsigned long slack)
+{
+	unsigned long limit, mask;
+
+	if (!slack)
+		return j;
+
+	limit = j + slack;
+
+	/* Highest bit that differs between the earliest and latest time */
+	mask = j ^ limit;
+	mask = (1UL << (fls_long(mask) - 1)) - 1;
+
+	return limit & ~mask;
+}
+EXPORT_SYMBOL_GPL(round_jiffies_slack);
+
+/**
+ * round_jiffies_slack_relative - coalesce a relative timeout
+ * @j: the time in (relative) jiffies that should be rounded
+ * @slack: how many jiffies late the caller can tolerate
+ *
+ * This is the same as round_jiffies_slack() but for a delay, as
+ * passed to queue_delayed_work() and friends.
+ */
+unsigned long round_jiffies_slack_relative(unsigned long j,
+					   unsigned long slack)
+{
+	unsigned long j0 = jiffies;
+
+	/* Use j0 because jiffies might change while we run */
+	return round_jiffies_slack(j + j0, slack) - j0;
+}
+EXPORT_SYMBOL_GPL(round_jiffies_slack_relative);
+
 
 static inline void set_running_timer(struct tvec_base *base,
 					struct timer_list *timer)